@@ -1,5 +1,16 @@
 #include <Arduino.h>
 #include "esp_camera.h"
+#include "img_converters.h" // jpg2rgb565 for on-CAM frame analysis
+#include <Preferences.h>        // NVS storage for the board calibration
+#include <esp_heap_caps.h>      // Largest free heap block for diagnostics
+#include "FS.h"
+#include "SD_MMC.h"             // Full-resolution archive on the microSD slot
+#include "esp_sleep.h"          // Light sleep in standby
+#include "driver/gpio.h"
+#include "driver/uart.h"
+
+#define USE_SD_ARCHIVE 1 // Set to 1 to keep a full-resolution JPEG of every move on the microSD card (needs PSRAM)
+#define USE_STANDBY 1 // Set to 1 to power the sensor down and light-sleep between commands on "STANDBY"
 
 // --- Pin Definitions (AI-Thinker Model) ---
 #define PWDN_GPIO_NUM     32
@@ -27,6 +38,178 @@
 // --- Camera Configuration ---
 camera_config_t camera_config;
 
+// Commands from the DevKit are read into a fixed buffer (no String, no heap use per command)
+const size_t COMMAND_MAX_LEN = 160; // Fits "CALIB:" + 9 coefficients
+static char command[COMMAND_MAX_LEN];
+
+// --- Burst Capture / Sharpness Scoring ---
+// A SNAP grabs BURST_FRAMES frames back to back and only sends the sharpest one,
+// so a frame taken while a hand is still moving away from the board is dropped on the CAM.
+const int BURST_FRAMES = 4;
+const size_t BEST_FRAME_BUFFER_SIZE = 30 * 1024; // Must not exceed the DevKit's imageBufferSize
+// Sharpness is scored on a JPEG decoded at 1/4 scale (QVGA -> 80x60), luma only.
+const jpg_scale_t SHARPNESS_DECODE_SCALE = JPG_SCALE_4X;
+const size_t SHARPNESS_MAX_W = 80;
+const size_t SHARPNESS_MAX_H = 60;
+
+uint8_t* bestFrameBuffer = nullptr; // Copy of the sharpest frame of the current burst
+static uint8_t sharpnessRgb565[SHARPNESS_MAX_W * SHARPNESS_MAX_H * 2];
+static uint8_t sharpnessLuma[SHARPNESS_MAX_W * SHARPNESS_MAX_H];
+
+// --- Motion-Settled Trigger ---
+// After SNAP the CAM watches a 1/8 scale (QVGA -> 40x30) luma stream and only starts the
+// burst once the frame-to-frame difference has stayed below MOTION_THRESHOLD for
+// settleWindowMs, or settleDeadlineMs has passed. Both are adjustable with "SETTLE:<window>,<deadline>".
+const jpg_scale_t MOTION_DECODE_SCALE = JPG_SCALE_8X;
+const size_t MOTION_MAX_W = 40;
+const size_t MOTION_MAX_H = 30;
+const uint32_t MOTION_THRESHOLD = 6; // Mean absolute luma difference per pixel (0-255)
+unsigned long settleWindowMs = 400;
+unsigned long settleDeadlineMs = 2000; // Keep below the DevKit's CAM_SETTLE_DEADLINE_MS
+
+static uint8_t motionRgb565[MOTION_MAX_W * MOTION_MAX_H * 2];
+static uint8_t motionLuma[2][MOTION_MAX_W * MOTION_MAX_H];
+
+// --- Inter-Frame Delta Encoding ---
+// With delta mode on ("DELTA:ON"), a SNAP sends only the DELTA_TILE_PX square tiles that changed
+// against the receiver's reference frame, each as its own small JPEG. Full JPEG keyframes are sent
+// every KEYFRAME_INTERVAL frames, on "KEYFRAME", and whenever a delta would not be smaller.
+// Delta payload (little-endian):
+//   "DLT1" | frame_id u16 | ref_id u16 | width u16 | height u16 | tile_px u8 | tile_count u8
+//   then tile_count x ( col u8 | row u8 | jpeg_len u16 | jpeg bytes )
+const size_t DELTA_TILE_PX = 40;           // QVGA -> 8x6 tiles
+const size_t DELTA_MAX_W = 320;
+const size_t DELTA_MAX_H = 240;
+const uint32_t DELTA_TILE_THRESHOLD = 8;   // Mean absolute luma difference per tile pixel (0-255)
+const uint8_t DELTA_TILE_JPEG_QUALITY = 80; // fmt2jpg quality, 0-100 (higher is better)
+const int KEYFRAME_INTERVAL = 10;
+
+bool deltaModeEnabled = false;
+bool keyframeRequested = true; // The first frame is always a keyframe
+uint16_t frameSeq = 0;         // Id of the last frame sent
+int framesSinceKeyframe = 0;
+uint8_t* referenceRgb565 = nullptr; // What the receiver holds after the last frame, DELTA_MAX_W x DELTA_MAX_H
+uint8_t* currentRgb565 = nullptr;
+uint8_t* deltaBuffer = nullptr;     // Encoded delta payload, BEST_FRAME_BUFFER_SIZE bytes
+size_t bestFrameWidth = 0;
+size_t bestFrameHeight = 0;
+static uint8_t deltaTileRgb565[DELTA_TILE_PX * DELTA_TILE_PX * 2];
+
+// --- Preview Thumbnails ---
+// With previews on ("PREVIEW:ON"), every frame is preceded by a tiny low-quality JPEG of the
+// same capture ("PREVIEW:<len>\n" + bytes), decoded at 1/4 scale (QVGA -> 80x60) and re-encoded.
+// The DevKit forwards it to the client before the full frame.
+const jpg_scale_t PREVIEW_DECODE_SCALE = JPG_SCALE_4X; // Decodes into sharpnessRgb565
+const uint8_t PREVIEW_JPEG_QUALITY = 30; // fmt2jpg quality, 0-100 (higher is better)
+const size_t PREVIEW_MAX_LEN = 4 * 1024; // Must not exceed the DevKit's previewBufferSize
+bool previewEnabled = false;
+static uint8_t previewJpeg[PREVIEW_MAX_LEN];
+
+// --- JPEG encoder output into a caller-owned buffer (fmt2jpg_cb) ---
+// fmt2jpg() would malloc the output for every tile and preview; this writes in place.
+struct JpegSink {
+  uint8_t* buffer;
+  size_t capacity;
+  size_t length;
+  bool overflow;
+};
+
+size_t jpegSinkWrite(void* arg, size_t index, const void* data, size_t len) {
+  JpegSink* sink = (JpegSink*) arg;
+  if (index + len > sink->capacity) {
+    sink->overflow = true;
+    return 0; // Stops the encoder
+  }
+  memcpy(sink->buffer + index, data, len);
+  sink->length = index + len;
+  return len;
+}
+
+// Encodes an RGB565 image into buffer; returns the JPEG size, 0 if it failed or didn't fit
+size_t encodeJpegInto(uint8_t* rgb565, size_t w, size_t h, uint8_t quality, uint8_t* buffer, size_t capacity) {
+  JpegSink sink = {buffer, capacity, 0, false};
+  if (!fmt2jpg_cb(rgb565, w * h * 2, w, h, PIXFORMAT_RGB565, quality, jpegSinkWrite, &sink) || sink.overflow) {
+    return 0;
+  }
+  return sink.length;
+}
+
+// --- Calibrated Tile Mode ---
+// Once calibrated ("CALIB:h00,h01,...,h22", from the server's /calibrate) and switched on
+// ("TILES:ON"), a SNAP sends only the rectified board instead of the whole frame. The homography
+// maps a pixel (u, v) of the TILE_GRID_SIDE square board to the frame pixel it is sampled from.
+// The piece classifier was trained on plain color squares, so the board stays in color, without
+// contrast stretching, at about the resolution a QVGA frame has of it (TILE_PX per square). It
+// goes out as one JPEG: "TIL2" | tile_px u8 | tile_count u8 (64) | JPEG of the
+// TILE_GRID_SIDE x TILE_GRID_SIDE board, a8 at the top left. The server cuts the squares.
+const size_t TILE_PX = 25;
+const size_t TILE_GRID_SIDE = 8 * TILE_PX;
+const uint8_t TILE_JPEG_QUALITY = 60;          // fmt2jpg quality, 0-100 (higher is better)
+const size_t TILES_PAYLOAD_CAPACITY = 32 * 1024; // Typically 7 KB; a larger board JPEG falls back to a keyframe
+
+float boardHomography[9];
+bool boardCalibrated = false;
+bool tileModeEnabled = false;
+uint8_t* boardRgb565 = nullptr; // The rectified board, TILE_GRID_SIDE x TILE_GRID_SIDE
+uint8_t* tilesBuffer = nullptr; // TILES_PAYLOAD_CAPACITY bytes
+Preferences preferences;
+
+// --- Full-Resolution Archive (microSD) ---
+// Live frames stay at QVGA for the UART and BLE links. With PSRAM and a card in the slot, the CAM
+// also keeps a full-resolution JPEG of every move for disputes and retraining. After the live frame
+// is sent, it switches the sensor to ARCHIVE_FRAMESIZE, grabs one frame into archiveBuffer and
+// hands it to a writer task, so the card write never holds up the next SNAP. The hub numbers
+// captures "SNAP:<game>,<ply>"; files are /archive/<game>_<ply>.jpg, listed in the append-only
+// /archive/index.csv ("game,ply,bytes,millis"), and read back with "FETCH:<game>,<ply>,<offset>".
+const framesize_t ARCHIVE_FRAMESIZE = FRAMESIZE_UXGA; // 1600x1200, the OV2640's full resolution
+const int ARCHIVE_JPEG_QUALITY = 10;                  // 0-63, lower is better
+const size_t ARCHIVE_BUFFER_SIZE = 512 * 1024;        // PSRAM
+const int ARCHIVE_DISCARD_FRAMES = 1;                 // Frames after a frame size change can still be the old size
+const size_t FETCH_BLOCK_SIZE = 8 * 1024;             // Per FETCH reply; sent from bestFrameBuffer
+const char* const ARCHIVE_DIR = "/archive";
+const char* const ARCHIVE_INDEX_PATH = "/archive/index.csv";
+
+struct ArchiveJob {
+  uint32_t game;
+  uint16_t ply;
+  size_t len;
+};
+bool archiveReady = false;
+uint8_t* archiveBuffer = nullptr;
+QueueHandle_t archiveQueue = nullptr;
+volatile bool archiveWriterBusy = false; // archiveBuffer belongs to the writer task until it clears this
+uint32_t archiveGameId = 0;              // Last game number on the card, kept in NVS across reboots
+long lastHubGame = -1;                   // Hub's game number of the last SNAP; a new one starts a new archive game
+volatile uint32_t archivedFrames = 0;
+volatile uint32_t archiveSkipped = 0;
+Preferences archivePreferences;
+
+// --- Standby ---
+// Between games the hub sends "STANDBY" (and with "IDLE:<ms>" the CAM goes there by itself after
+// that long without a command). The camera driver is shut down, the sensor held in power-down
+// through PWDN_GPIO_NUM, and loop() light-sleeps until UART activity or a high level on
+// WAKE_GPIO_NUM (an optional wire from the hub). The bytes that wake the UART are lost, so the hub
+// sends a few newlines and waits before the command. Other commands are answered from standby;
+// SNAP, CAMCFG and "WAKE" power the sensor up again and restore the settings it had (cached at
+// power-down). The hub sends WAKE when a clock starts, so the first capture doesn't wait for it.
+// Wake-to-frame is the power-up (measured, reported in DIAG) plus the settle wait, which the
+// deadline bounds while the exposure converges.
+const gpio_num_t WAKE_GPIO_NUM = GPIO_NUM_13; // Free in 1-bit SD mode
+const int UART_WAKE_THRESHOLD = 3;            // Rising edges on RX; the hub's "\n\n\n" is enough
+const unsigned long WAKE_BUDGET_MS = 800;     // Power-up above this is logged
+bool sensorPowered = false;
+bool standby = false;
+unsigned long standbyIdleMs = 0; // 0 = only on "STANDBY"
+unsigned long lastCommandMs = 0;
+camera_status_t cachedSensorStatus; // Sensor settings at the last power-down
+bool sensorStatusCached = false;
+uint32_t standbyCount = 0;
+unsigned long lastWakeMs = 0; // Driver init and settings restore at the last power-up
+unsigned long maxWakeMs = 0;
+
+enum FrameType { FRAME_KEY, FRAME_DELTA, FRAME_TILES };
+const char* frameTypeNames[] = {"KEY", "DELTA", "TILES"}; // As sent in the frame header
+
 void configCamera(){
   camera_config.ledc_channel = LEDC_CHANNEL_0;
   camera_config.ledc_timer = LEDC_TIMER_0;
@@ -60,6 +243,619 @@ void configCamera(){
   #endif
 }
 
+// --- Decode a JPEG frame to 8-bit luma at a reduced scale ---
+// rgb565Scratch must hold outW * outH * 2 bytes. Returns false if the frame
+// is not a JPEG of the expected size or fails to decode.
+bool decodeLuma(const camera_fb_t* fb, jpg_scale_t scale, uint8_t* rgb565Scratch,
+                uint8_t* luma, size_t outW, size_t outH) {
+  if (fb->format != PIXFORMAT_JPEG) {
+    return false;
+  }
+  size_t divisor = 1 << scale; // JPG_SCALE_NONE=0, 2X=1, 4X=2, 8X=3
+  if (fb->width / divisor != outW || fb->height / divisor != outH) {
+    return false;
+  }
+  if (!jpg2rgb565(fb->buf, fb->len, rgb565Scratch, scale)) {
+    return false;
+  }
+  for (size_t i = 0; i < outW * outH; i++) {
+    // jpg2rgb565 writes the high byte first
+    uint8_t hi = rgb565Scratch[2 * i];
+    uint8_t lo = rgb565Scratch[2 * i + 1];
+    uint8_t r = hi & 0xF8;
+    uint8_t g = ((hi & 0x07) << 5) | ((lo & 0xE0) >> 3);
+    uint8_t b = (lo & 0x1F) << 3;
+    luma[i] = (uint8_t)((77 * r + 150 * g + 29 * b) >> 8);
+  }
+  return true;
+}
+
+// --- Sharpness score: mean squared gradient of the decimated luma ---
+// Higher is sharper. Returns 0 if the frame could not be decoded.
+uint32_t scoreSharpness(const camera_fb_t* fb) {
+  size_t divisor = 1 << SHARPNESS_DECODE_SCALE;
+  size_t w = fb->width / divisor;
+  size_t h = fb->height / divisor;
+  if (w > SHARPNESS_MAX_W || h > SHARPNESS_MAX_H || w < 2 || h < 2) {
+    return 0;
+  }
+  if (!decodeLuma(fb, SHARPNESS_DECODE_SCALE, sharpnessRgb565, sharpnessLuma, w, h)) {
+    return 0;
+  }
+  uint64_t energy = 0;
+  for (size_t y = 0; y < h - 1; y++) {
+    const uint8_t* row = sharpnessLuma + y * w;
+    const uint8_t* next = row + w;
+    for (size_t x = 0; x < w - 1; x++) {
+      int dx = (int)row[x + 1] - (int)row[x];
+      int dy = (int)next[x] - (int)row[x];
+      energy += (uint32_t)(dx * dx + dy * dy);
+    }
+  }
+  return (uint32_t)(energy / ((w - 1) * (h - 1)));
+}
+
+// --- Wait until the scene has been still for settleWindowMs ---
+// Returns the time spent waiting; sets *timedOut if settleDeadlineMs passed first.
+unsigned long waitForSceneToSettle(bool* timedOut) {
+  unsigned long startTime = millis();
+  unsigned long stillSince = startTime;
+  int current = 0;
+  bool havePrevious = false;
+  *timedOut = false;
+
+  while (true) {
+    unsigned long now = millis();
+    if (now - startTime >= settleDeadlineMs) {
+      *timedOut = true;
+      return now - startTime;
+    }
+
+    camera_fb_t* fb = esp_camera_fb_get();
+    if (!fb) {
+      continue;
+    }
+    size_t divisor = 1 << MOTION_DECODE_SCALE;
+    size_t w = fb->width / divisor;
+    size_t h = fb->height / divisor;
+    bool decoded = (w <= MOTION_MAX_W && h <= MOTION_MAX_H) &&
+                   decodeLuma(fb, MOTION_DECODE_SCALE, motionRgb565, motionLuma[current], w, h);
+    esp_camera_fb_return(fb);
+    now = millis();
+    if (!decoded) {
+      // Can't measure motion at this frame size; fall back to an immediate capture
+      return now - startTime;
+    }
+
+    if (havePrevious) {
+      uint32_t diff = 0;
+      const uint8_t* prev = motionLuma[current ^ 1];
+      for (size_t i = 0; i < w * h; i++) {
+        diff += abs((int)motionLuma[current][i] - (int)prev[i]);
+      }
+      diff /= (w * h);
+      if (diff > MOTION_THRESHOLD) {
+        stillSince = now; // Still moving, restart the settle window
+      } else if (now - stillSince >= settleWindowMs) {
+        return now - startTime;
+      }
+    }
+    havePrevious = true;
+    current ^= 1;
+  }
+}
+
+// --- Grab a burst of frames and keep a copy of the sharpest ---
+// Returns the size of the frame copied into bestFrameBuffer, 0 on failure.
+size_t captureSharpestFrame(uint32_t* bestScoreOut) {
+  size_t bestLen = 0;
+  uint32_t bestScore = 0;
+  bool haveBest = false;
+
+  for (int i = 0; i < BURST_FRAMES; i++) {
+    camera_fb_t* fb = esp_camera_fb_get();
+    if (!fb) {
+      Serial.printf("Burst frame %d: capture failed\n", i); // Debug
+      continue;
+    }
+    uint32_t score = scoreSharpness(fb);
+    Serial.printf("Burst frame %d: %zu bytes, sharpness %lu\n", i, fb->len, (unsigned long)score); // Debug
+    if (fb->len <= BEST_FRAME_BUFFER_SIZE && (!haveBest || score > bestScore)) {
+      memcpy(bestFrameBuffer, fb->buf, fb->len);
+      bestLen = fb->len;
+      bestFrameWidth = fb->width;
+      bestFrameHeight = fb->height;
+      bestScore = score;
+      haveBest = true;
+    }
+    esp_camera_fb_return(fb);
+  }
+
+  *bestScoreOut = bestScore;
+  return bestLen;
+}
+
+// --- Mean absolute luma difference of one tile between two RGB565 frames ---
+static inline uint8_t rgb565Luma(const uint8_t* px) {
+  uint8_t r = px[0] & 0xF8;
+  uint8_t g = ((px[0] & 0x07) << 5) | ((px[1] & 0xE0) >> 3);
+  uint8_t b = (px[1] & 0x1F) << 3;
+  return (uint8_t)((77 * r + 150 * g + 29 * b) >> 8);
+}
+
+uint32_t tileDifference(const uint8_t* a, const uint8_t* b, size_t width,
+                        size_t x0, size_t y0, size_t tw, size_t th) {
+  uint32_t diff = 0;
+  for (size_t y = y0; y < y0 + th; y++) {
+    size_t offset = (y * width + x0) * 2;
+    for (size_t x = 0; x < tw; x++, offset += 2) {
+      diff += abs((int)rgb565Luma(a + offset) - (int)rgb565Luma(b + offset));
+    }
+  }
+  return diff / (tw * th);
+}
+
+// --- Encode the best frame as a delta against referenceRgb565 ---
+// Returns the payload size in deltaBuffer, or 0 if a keyframe should be sent instead
+// (decode failure, unexpected frame size, or a delta that would not be smaller than the JPEG).
+size_t encodeDeltaFrame(size_t jpegLen, uint16_t frameId, uint16_t refId) {
+  size_t w = bestFrameWidth;
+  size_t h = bestFrameHeight;
+  if (w == 0 || w > DELTA_MAX_W || h == 0 || h > DELTA_MAX_H) {
+    return 0;
+  }
+  if (!jpg2rgb565(bestFrameBuffer, jpegLen, currentRgb565, JPG_SCALE_NONE)) {
+    return 0;
+  }
+
+  size_t cols = (w + DELTA_TILE_PX - 1) / DELTA_TILE_PX;
+  size_t rows = (h + DELTA_TILE_PX - 1) / DELTA_TILE_PX;
+  uint8_t* out = deltaBuffer;
+  memcpy(out, "DLT1", 4);
+  out[4] = frameId & 0xFF; out[5] = frameId >> 8;
+  out[6] = refId & 0xFF;   out[7] = refId >> 8;
+  out[8] = w & 0xFF;       out[9] = w >> 8;
+  out[10] = h & 0xFF;      out[11] = h >> 8;
+  out[12] = DELTA_TILE_PX;
+  out[13] = 0; // Tile count, filled in below
+  size_t used = 14;
+  uint8_t tileCount = 0;
+
+  for (size_t row = 0; row < rows; row++) {
+    for (size_t col = 0; col < cols; col++) {
+      size_t x0 = col * DELTA_TILE_PX;
+      size_t y0 = row * DELTA_TILE_PX;
+      size_t tw = min(DELTA_TILE_PX, w - x0);
+      size_t th = min(DELTA_TILE_PX, h - y0);
+      if (tileDifference(currentRgb565, referenceRgb565, w, x0, y0, tw, th) <= DELTA_TILE_THRESHOLD) {
+        continue;
+      }
+
+      // Copy the tile into a contiguous buffer and compress it on its own
+      for (size_t y = 0; y < th; y++) {
+        memcpy(deltaTileRgb565 + y * tw * 2, currentRgb565 + ((y0 + y) * w + x0) * 2, tw * 2);
+      }
+      // Never larger than the keyframe it replaces: the tile must fit below jpegLen
+      if (used + 4 >= jpegLen) {
+        return 0;
+      }
+      size_t tileJpegLen = encodeJpegInto(deltaTileRgb565, tw, th, DELTA_TILE_JPEG_QUALITY,
+                                          out + used + 4, jpegLen - used - 4);
+      if (tileJpegLen == 0) {
+        return 0;
+      }
+      out[used++] = col;
+      out[used++] = row;
+      out[used++] = tileJpegLen & 0xFF;
+      out[used++] = tileJpegLen >> 8;
+      used += tileJpegLen;
+      tileCount++;
+
+      // The receiver now holds this tile; update our copy of its reference
+      for (size_t y = 0; y < th; y++) {
+        size_t offset = ((y0 + y) * w + x0) * 2;
+        memcpy(referenceRgb565 + offset, currentRgb565 + offset, tw * 2);
+      }
+    }
+  }
+  out[13] = tileCount;
+  return used;
+}
+
+// --- Adopt a keyframe as the receiver's new reference ---
+bool setKeyframeReference(size_t jpegLen) {
+  if (bestFrameWidth == 0 || bestFrameWidth > DELTA_MAX_W || bestFrameHeight > DELTA_MAX_H) {
+    return false;
+  }
+  return jpg2rgb565(bestFrameBuffer, jpegLen, referenceRgb565, JPG_SCALE_NONE);
+}
+
+// --- Warp the best frame into the rectified board and encode it as a tile grid ---
+// Returns the payload size in tilesBuffer, 0 if the frame can't be decoded or the JPEG doesn't fit.
+size_t encodeTileGrid(size_t jpegLen) {
+  size_t w = bestFrameWidth;
+  size_t h = bestFrameHeight;
+  if (w < 2 || w > DELTA_MAX_W || h < 2 || h > DELTA_MAX_H) {
+    return 0;
+  }
+  if (!jpg2rgb565(bestFrameBuffer, jpegLen, currentRgb565, JPG_SCALE_NONE)) {
+    return 0;
+  }
+
+  const float* H = boardHomography;
+  for (size_t v = 0; v < TILE_GRID_SIDE; v++) {
+    for (size_t u = 0; u < TILE_GRID_SIDE; u++) {
+      float sw = H[6] * u + H[7] * v + H[8];
+      float sx = (H[0] * u + H[1] * v + H[2]) / sw;
+      float sy = (H[3] * u + H[4] * v + H[5]) / sw;
+      uint8_t* out = boardRgb565 + (v * TILE_GRID_SIDE + u) * 2;
+      if (!(sx >= 0 && sy >= 0 && sx < w - 1 && sy < h - 1)) {
+        out[0] = out[1] = 0;
+        continue;
+      }
+      // Bilinear sample, per channel
+      size_t x0 = (size_t)sx;
+      size_t y0 = (size_t)sy;
+      float fx = sx - x0;
+      float fy = sy - y0;
+      const uint8_t* p[4] = {currentRgb565 + (y0 * w + x0) * 2, currentRgb565 + (y0 * w + x0 + 1) * 2,
+                             currentRgb565 + ((y0 + 1) * w + x0) * 2, currentRgb565 + ((y0 + 1) * w + x0 + 1) * 2};
+      float weight[4] = {(1 - fx) * (1 - fy), fx * (1 - fy), (1 - fx) * fy, fx * fy};
+      float r = 0, g = 0, b = 0;
+      for (int k = 0; k < 4; k++) {
+        r += weight[k] * (p[k][0] >> 3);
+        g += weight[k] * (((p[k][0] & 0x07) << 3) | (p[k][1] >> 5));
+        b += weight[k] * (p[k][1] & 0x1F);
+      }
+      uint16_t r5 = (uint16_t)(r + 0.5f), g6 = (uint16_t)(g + 0.5f), b5 = (uint16_t)(b + 0.5f);
+      out[0] = (uint8_t)((r5 << 3) | (g6 >> 3));
+      out[1] = (uint8_t)(((g6 & 0x07) << 5) | b5);
+    }
+  }
+
+  memcpy(tilesBuffer, "TIL2", 4);
+  tilesBuffer[4] = TILE_PX;
+  tilesBuffer[5] = 64;
+  size_t boardJpegLen = encodeJpegInto(boardRgb565, TILE_GRID_SIDE, TILE_GRID_SIDE, TILE_JPEG_QUALITY,
+                                       tilesBuffer + 6, TILES_PAYLOAD_CAPACITY - 6);
+  return boardJpegLen > 0 ? 6 + boardJpegLen : 0;
+}
+
+// --- Parse and store "CALIB:h00,h01,...,h22" ---
+bool storeCalibration(const char* values) {
+  float parsed[9];
+  const char* cursor = values;
+  for (int i = 0; i < 9; i++) {
+    char* end = nullptr;
+    parsed[i] = strtof(cursor, &end);
+    if (end == cursor || (i < 8 && *end != ',')) {
+      return false;
+    }
+    cursor = end + 1;
+  }
+  memcpy(boardHomography, parsed, sizeof(boardHomography));
+  boardCalibrated = true;
+  preferences.putBytes("homography", boardHomography, sizeof(boardHomography));
+  return true;
+}
+
+// --- Send a thumbnail of the best frame ahead of the frame itself ---
+// Skipped (no PREVIEW line) if the frame can't be decoded or the thumbnail is too large.
+void sendPreview(size_t jpegLen) {
+  size_t divisor = 1 << PREVIEW_DECODE_SCALE;
+  size_t w = bestFrameWidth / divisor;
+  size_t h = bestFrameHeight / divisor;
+  if (w == 0 || h == 0 || w > SHARPNESS_MAX_W || h > SHARPNESS_MAX_H) {
+    return;
+  }
+  if (!jpg2rgb565(bestFrameBuffer, jpegLen, sharpnessRgb565, PREVIEW_DECODE_SCALE)) {
+    return;
+  }
+  size_t previewLen = encodeJpegInto(sharpnessRgb565, w, h, PREVIEW_JPEG_QUALITY, previewJpeg, PREVIEW_MAX_LEN);
+  if (previewLen > 0) {
+    Serial.printf("PREVIEW:%zu\n", previewLen);
+    Serial.write(previewJpeg, previewLen);
+  }
+}
+
+// --- Send the best frame to the DevKit, as a keyframe, a delta or a tile grid ---
+// archiveGame: the archive game the full-resolution frame will be filed under (0 = not archived)
+void sendFrame(size_t frameLen, uint32_t sharpness, unsigned long settleMs, bool settleTimedOut, uint32_t archiveGame) {
+  if (previewEnabled) {
+    sendPreview(frameLen); // Thumbnail first so the client can show something early
+  }
+  uint16_t refId = frameSeq;
+  uint16_t frameId = frameSeq + 1;
+  const uint8_t* payload = bestFrameBuffer;
+  size_t payloadLen = frameLen;
+  FrameType frameType = FRAME_KEY;
+
+  if (tileModeEnabled && boardCalibrated && currentRgb565 != nullptr && boardRgb565 != nullptr && tilesBuffer != nullptr) {
+    size_t tilesLen = encodeTileGrid(frameLen);
+    if (tilesLen > 0) {
+      payload = tilesBuffer;
+      payloadLen = tilesLen;
+      frameType = FRAME_TILES;
+      keyframeRequested = true; // The receiver's image reference is no longer the last frame
+    }
+  }
+
+  if (frameType == FRAME_KEY && deltaModeEnabled && referenceRgb565 != nullptr && deltaBuffer != nullptr) {
+    bool keyframeDue = keyframeRequested || framesSinceKeyframe + 1 >= KEYFRAME_INTERVAL;
+    if (!keyframeDue) {
+      size_t deltaLen = encodeDeltaFrame(frameLen, frameId, refId);
+      if (deltaLen > 0) {
+        payload = deltaBuffer;
+        payloadLen = deltaLen;
+        frameType = FRAME_DELTA;
+      }
+    }
+    if (frameType == FRAME_DELTA) {
+      framesSinceKeyframe++;
+    } else {
+      // Keyframe: the receiver's reference becomes this frame. If it can't be decoded
+      // here, keep requesting keyframes until one can.
+      keyframeRequested = !setKeyframeReference(frameLen);
+      framesSinceKeyframe = 0;
+    }
+  }
+  frameSeq = frameId;
+
+  // Frame header: size first, then the sharpness score of the chosen frame, the settle result,
+  // the frame type/id (REF only for deltas) and the archive game (GAME only when archived)
+  if (frameType == FRAME_DELTA) {
+    Serial.printf("SIZE:%zu SHARP:%lu SETTLE:%lu SETTLE_TO:%d TYPE:DELTA ID:%u REF:%u", payloadLen,
+                  (unsigned long)sharpness, settleMs, settleTimedOut ? 1 : 0, frameId, refId);
+  } else {
+    Serial.printf("SIZE:%zu SHARP:%lu SETTLE:%lu SETTLE_TO:%d TYPE:%s ID:%u", payloadLen,
+                  (unsigned long)sharpness, settleMs, settleTimedOut ? 1 : 0, frameTypeNames[frameType], frameId);
+  }
+  if (archiveGame != 0) {
+    Serial.printf(" GAME:%lu", (unsigned long)archiveGame);
+  }
+  Serial.print("\n");
+  Serial.write(payload, payloadLen); // Send raw bytes
+  Serial.flush(); // Ensure data is sent before the end marker
+  Serial.println("FRAME_END"); // Send confirmation/end marker
+  Serial.printf("Photo sent (%s, %zu of %zu bytes).\n", frameTypeNames[frameType], payloadLen, frameLen); // Debug
+}
+
+// --- Frame size and JPEG quality ("CAMCFG:<QQVGA|HQVGA|QVGA>,<quality 4-63>"), used by the hub's BENCH ---
+// Only sizes up to the QVGA the driver was initialized with: its JPEG buffer is sized for that.
+bool applyCameraConfig(const char* args) {
+  const char* comma = strchr(args, ',');
+  sensor_t* sensor = esp_camera_sensor_get();
+  if (comma == nullptr || sensor == nullptr) {
+    return false;
+  }
+  size_t nameLen = comma - args;
+  framesize_t frameSize;
+  if (nameLen == 5 && strncmp(args, "QQVGA", 5) == 0) {
+    frameSize = FRAMESIZE_QQVGA;
+  } else if (nameLen == 5 && strncmp(args, "HQVGA", 5) == 0) {
+    frameSize = FRAMESIZE_HQVGA;
+  } else if (nameLen == 4 && strncmp(args, "QVGA", 4) == 0) {
+    frameSize = FRAMESIZE_QVGA;
+  } else {
+    return false;
+  }
+  int quality = atoi(comma + 1);
+  if (quality < 4 || quality > 63) {
+    return false;
+  }
+  sensor->set_framesize(sensor, frameSize);
+  sensor->set_quality(sensor, quality);
+  Serial.printf("Camera frame size %.*s, quality %d\n", (int)nameLen, args, quality); // Debug
+  return true;
+}
+
+// --- Archive file of one move ---
+void archivePath(char* buffer, size_t bufferSize, uint32_t game, uint16_t ply) {
+  snprintf(buffer, bufferSize, "%s/%lu_%u.jpg", ARCHIVE_DIR, (unsigned long)game, ply);
+}
+
+// --- Archive game for the hub's game number: a new hub game starts the next one on the card ---
+uint32_t archiveGameFor(long hubGame) {
+  if (!archiveReady || hubGame < 0) {
+    return 0;
+  }
+  if (hubGame != lastHubGame) {
+    lastHubGame = hubGame;
+    archiveGameId++;
+    archivePreferences.putUInt("game", archiveGameId);
+  }
+  return archiveGameId;
+}
+
+// --- Grab a full-resolution frame for the archive and queue it for the writer task ---
+// Runs right after the live frame is out. Skipped while the previous frame is still being
+// written, and when the hub already sent its next command: the board has moved on since this ply.
+void archiveFullResolution(uint32_t game, uint16_t ply) {
+  if (archiveWriterBusy || Serial.available() > 0) {
+    archiveSkipped++;
+    Serial.printf("Archive: ply %u skipped (%s)\n", ply, archiveWriterBusy ? "writer busy" : "next command waiting"); // Debug
+    return;
+  }
+  sensor_t* sensor = esp_camera_sensor_get();
+  framesize_t liveFrameSize = sensor->status.framesize;
+  int liveQuality = sensor->status.quality;
+  sensor->set_framesize(sensor, ARCHIVE_FRAMESIZE);
+  sensor->set_quality(sensor, ARCHIVE_JPEG_QUALITY);
+  size_t len = 0;
+  for (int i = 0; i <= ARCHIVE_DISCARD_FRAMES; i++) {
+    camera_fb_t* fb = esp_camera_fb_get();
+    if (!fb) {
+      continue;
+    }
+    if (i == ARCHIVE_DISCARD_FRAMES && fb->len <= ARCHIVE_BUFFER_SIZE) {
+      memcpy(archiveBuffer, fb->buf, fb->len);
+      len = fb->len;
+    }
+    esp_camera_fb_return(fb);
+  }
+  sensor->set_framesize(sensor, liveFrameSize);
+  sensor->set_quality(sensor, liveQuality);
+  camera_fb_t* fb = esp_camera_fb_get(); // Flush the last full-resolution frame before the next SNAP
+  if (fb) {
+    esp_camera_fb_return(fb);
+  }
+  if (len == 0) {
+    archiveSkipped++;
+    Serial.printf("Archive: capture failed for ply %u\n", ply); // Debug
+    return;
+  }
+  ArchiveJob job = {game, ply, len};
+  archiveWriterBusy = true;
+  xQueueSend(archiveQueue, &job, 0);
+  Serial.printf("Archive: %zu bytes for game %lu ply %u queued\n", len, (unsigned long)game, ply); // Debug
+}
+
+// --- Writer task: the frame file, then its index line ---
+// No Serial output here: it could land in the middle of a frame sent from loop().
+void archiveWriterTask(void* arg) {
+  ArchiveJob job;
+  char path[48];
+  char indexLine[64];
+  for (;;) {
+    if (xQueueReceive(archiveQueue, &job, portMAX_DELAY) != pdTRUE) {
+      continue;
+    }
+    archivePath(path, sizeof(path), job.game, job.ply);
+    File file = SD_MMC.open(path, FILE_WRITE);
+    bool written = file && file.write(archiveBuffer, job.len) == job.len;
+    if (file) {
+      file.close();
+    }
+    if (written) {
+      File index = SD_MMC.open(ARCHIVE_INDEX_PATH, FILE_APPEND);
+      if (index) {
+        int lineLen = snprintf(indexLine, sizeof(indexLine), "%lu,%u,%u,%lu\n", (unsigned long)job.game, job.ply,
+                               (unsigned)job.len, millis());
+        index.write((const uint8_t*)indexLine, lineLen);
+        index.close();
+      }
+      archivedFrames++;
+    } else {
+      archiveSkipped++;
+    }
+    archiveWriterBusy = false;
+  }
+}
+
+// --- One block of an archived frame ("FETCH:<game>,<ply>,<offset>") ---
+// Replies "FILE:<total>,<offset>,<len>" + len bytes + "FILE_END", or ERROR:NoArchive / NotFound / Busy.
+// The hub relays each block to its client before asking for the next.
+void sendArchiveBlock(const char* args) {
+  char* end;
+  unsigned long game = strtoul(args, &end, 10);
+  unsigned long ply = (*end == ',') ? strtoul(end + 1, &end, 10) : 0;
+  unsigned long offset = (*end == ',') ? strtoul(end + 1, &end, 10) : 0;
+  if (!archiveReady || *end != '\0' || game == 0) {
+    Serial.println("ERROR:NoArchive");
+    return;
+  }
+  if (archiveWriterBusy) {
+    Serial.println("ERROR:Busy"); // The file may be the one being written
+    return;
+  }
+  char path[48];
+  archivePath(path, sizeof(path), game, (uint16_t)ply);
+  File file = SD_MMC.open(path, FILE_READ);
+  if (!file) {
+    Serial.println("ERROR:NotFound");
+    return;
+  }
+  size_t total = file.size();
+  size_t len = 0;
+  if (offset < total && file.seek(offset)) {
+    size_t want = total - offset;
+    len = file.read(bestFrameBuffer, (want < FETCH_BLOCK_SIZE) ? want : FETCH_BLOCK_SIZE);
+  }
+  file.close();
+  Serial.printf("FILE:%u,%lu,%u\n", (unsigned)total, offset, (unsigned)len);
+  Serial.write(bestFrameBuffer, len);
+  Serial.flush();
+  Serial.println("FILE_END");
+}
+
+// --- Re-apply the settings the sensor had before power-down ---
+void restoreSensorStatus(sensor_t* sensor, const camera_status_t& status) {
+  sensor->set_framesize(sensor, status.framesize);
+  sensor->set_quality(sensor, status.quality);
+  sensor->set_brightness(sensor, status.brightness);
+  sensor->set_contrast(sensor, status.contrast);
+  sensor->set_saturation(sensor, status.saturation);
+  sensor->set_special_effect(sensor, status.special_effect);
+  sensor->set_whitebal(sensor, status.awb);
+  sensor->set_awb_gain(sensor, status.awb_gain);
+  sensor->set_wb_mode(sensor, status.wb_mode);
+  sensor->set_exposure_ctrl(sensor, status.aec);
+  sensor->set_aec2(sensor, status.aec2);
+  sensor->set_ae_level(sensor, status.ae_level);
+  sensor->set_aec_value(sensor, status.aec_value); // Starting point for the auto exposure too
+  sensor->set_gain_ctrl(sensor, status.agc);
+  sensor->set_agc_gain(sensor, status.agc_gain);
+  sensor->set_gainceiling(sensor, (gainceiling_t)status.gainceiling);
+  sensor->set_hmirror(sensor, status.hmirror);
+  sensor->set_vflip(sensor, status.vflip);
+}
+
+// --- Power the sensor up (no-op if it is on); leaves standby ---
+bool powerUpSensor() {
+  standby = false;
+  if (sensorPowered) {
+    return true;
+  }
+  unsigned long startTime = millis();
+  gpio_hold_dis((gpio_num_t)PWDN_GPIO_NUM);
+  esp_err_t err = esp_camera_init(&camera_config); // Drives PWDN low and loads the driver's register set
+  if (err != ESP_OK) {
+    err = esp_camera_init(&camera_config);
+  }
+  if (err != ESP_OK) {
+    Serial.printf("Camera power-up failed with error 0x%x\n", err); // Debug
+    return false;
+  }
+  sensor_t* sensor = esp_camera_sensor_get();
+  if (sensorStatusCached) {
+    restoreSensorStatus(sensor, cachedSensorStatus);
+  } else if (camera_config.frame_size != FRAMESIZE_QVGA) {
+    sensor->set_framesize(sensor, FRAMESIZE_QVGA);
+  }
+  sensorPowered = true;
+  lastWakeMs = millis() - startTime;
+  maxWakeMs = max(maxWakeMs, lastWakeMs);
+  Serial.printf("Sensor powered up in %lu ms%s\n", lastWakeMs, lastWakeMs > WAKE_BUDGET_MS ? " (over budget)" : ""); // Debug
+  return true;
+}
+
+// --- Power the sensor down and let loop() light-sleep between commands ---
+void enterStandby() {
+  if (sensorPowered) {
+    sensor_t* sensor = esp_camera_sensor_get();
+    if (sensor != nullptr) {
+      cachedSensorStatus = sensor->status;
+      sensorStatusCached = true;
+    }
+    esp_camera_deinit();
+    pinMode(PWDN_GPIO_NUM, OUTPUT);
+    digitalWrite(PWDN_GPIO_NUM, HIGH); // OV2640 power-down
+    gpio_hold_en((gpio_num_t)PWDN_GPIO_NUM); // Keep it there through light sleep
+    sensorPowered = false;
+  }
+  if (!standby) {
+    standby = true;
+    standbyCount++;
+    Serial.println("Standby"); // Debug
+  }
+}
+
+// --- Light-sleep until the hub writes to the UART or raises the wake line ---
+void sleepUntilCommand() {
+  Serial.flush(); // Debug output would be cut off
+  esp_light_sleep_start();
+}
+
 void setup() {
   Serial.begin(115200); // Used for communication with DevKit AND debugging
   delay(1000);
@@ -67,6 +863,13 @@ void setup() {
 
   // Configure and Initialize Camera
   configCamera();
+#if USE_SD_ARCHIVE
+  if (psramFound()) {
+    // Size the driver's frame buffer for full-resolution archive frames; live frames stay QVGA
+    camera_config.frame_size = ARCHIVE_FRAMESIZE;
+    camera_config.fb_location = CAMERA_FB_IN_PSRAM;
+  }
+#endif
   Serial.println("Attempting camera initialization..."); // Debug
   esp_err_t err = esp_camera_init(&camera_config);
   if (err != ESP_OK) {
@@ -76,6 +879,64 @@ void setup() {
     return; // Halt setup if camera fails
   }
   Serial.println("Camera init SUCCESS");
+  sensorPowered = true;
+  if (camera_config.frame_size != FRAMESIZE_QVGA) {
+    sensor_t* sensor = esp_camera_sensor_get();
+    sensor->set_framesize(sensor, FRAMESIZE_QVGA); // Live frame size
+  }
+
+  // Burst buffer: prefer PSRAM so the DRAM heap stays free for the camera driver
+  bestFrameBuffer = psramFound() ? (uint8_t*) ps_malloc(BEST_FRAME_BUFFER_SIZE)
+                                 : (uint8_t*) malloc(BEST_FRAME_BUFFER_SIZE);
+  if (bestFrameBuffer == nullptr) {
+    Serial.println("Failed to allocate burst frame buffer!");
+    return;
+  }
+
+  // Delta encoding needs two full decoded frames; only available with PSRAM
+  if (psramFound()) {
+    referenceRgb565 = (uint8_t*) ps_malloc(DELTA_MAX_W * DELTA_MAX_H * 2);
+    currentRgb565 = (uint8_t*) ps_malloc(DELTA_MAX_W * DELTA_MAX_H * 2);
+    deltaBuffer = (uint8_t*) ps_malloc(BEST_FRAME_BUFFER_SIZE);
+  }
+  if (referenceRgb565 == nullptr || currentRgb565 == nullptr || deltaBuffer == nullptr) {
+    Serial.println("Delta encoding unavailable (no PSRAM), keyframes only.");
+  }
+
+  // Calibrated tile mode: stored homography and mode survive a reboot
+  if (psramFound()) {
+    boardRgb565 = (uint8_t*) ps_malloc(TILE_GRID_SIDE * TILE_GRID_SIDE * 2);
+    tilesBuffer = (uint8_t*) ps_malloc(TILES_PAYLOAD_CAPACITY);
+  }
+  preferences.begin("board", false);
+  boardCalibrated = preferences.getBytes("homography", boardHomography, sizeof(boardHomography)) == sizeof(boardHomography);
+  tileModeEnabled = preferences.getBool("tiles", false);
+  Serial.printf("Board %s, tile mode %s\n", boardCalibrated ? "calibrated" : "not calibrated",
+                tileModeEnabled ? "on" : "off"); // Debug
+
+#if USE_SD_ARCHIVE
+  // 1-bit SD mode: GPIO4 (flash LED) and GPIO12/13 stay free
+  if (psramFound() && SD_MMC.begin("/sdcard", true)) {
+    archiveBuffer = (uint8_t*) ps_malloc(ARCHIVE_BUFFER_SIZE);
+    archiveQueue = xQueueCreate(1, sizeof(ArchiveJob));
+    SD_MMC.mkdir(ARCHIVE_DIR);
+    archivePreferences.begin("archive", false);
+    archiveGameId = archivePreferences.getUInt("game", 0);
+    archiveReady = archiveBuffer != nullptr && archiveQueue != nullptr &&
+                   xTaskCreatePinnedToCore(archiveWriterTask, "archive", 4096, nullptr, 1, nullptr, 0) == pdPASS;
+  }
+  Serial.printf("SD archive %s (last game %lu)\n", archiveReady ? "ready" : "unavailable",
+                (unsigned long)archiveGameId); // Debug
+#endif
+
+#if USE_STANDBY
+  uart_set_wakeup_threshold(UART_NUM_0, UART_WAKE_THRESHOLD);
+  esp_sleep_enable_uart_wakeup(UART_NUM_0);
+  pinMode(WAKE_GPIO_NUM, INPUT_PULLDOWN); // Low when the hub has no wake wire
+  gpio_wakeup_enable(WAKE_GPIO_NUM, GPIO_INTR_HIGH_LEVEL);
+  esp_sleep_enable_gpio_wakeup();
+#endif
+  lastCommandMs = millis();
 
   Serial.println("Camera Setup Complete. Waiting for commands on Serial (GPIO1/3)...");
 }
@@ -83,33 +944,119 @@ void setup() {
 void loop() {
   // Check Serial for commands from DevKit (e.g., "SNAP\n")
   if (Serial.available() > 0) {
-    String cmd = Serial.readStringUntil('\n');
-    cmd.trim(); // Remove potential whitespace/newlines
-    Serial.printf("Received command: '%s'\n", cmd.c_str()); // Debug echo
-    if (cmd == "SNAP") {
+    size_t len = Serial.readBytesUntil('\n', command, COMMAND_MAX_LEN - 1);
+    while (len > 0 && isspace((unsigned char)command[len - 1])) {
+      len--; // Remove potential whitespace/newlines
+    }
+    command[len] = '\0';
+    const char* cmd = command;
+    if (len > 0) {
+       Serial.printf("Received command: '%s'\n", cmd); // Debug echo
+       lastCommandMs = millis();
+    }
+    if (len == 0) {
+       // Wake-up newlines from the hub
+    } else if (!sensorPowered && (strncmp(cmd, "SNAP", 4) == 0 || strncmp(cmd, "CAMCFG:", 7) == 0) && !powerUpSensor()) {
+       Serial.println("ERROR:CameraInit");
+    } else if (strcmp(cmd, "SNAP") == 0 || strncmp(cmd, "SNAP:", 5) == 0) {
        Serial.println("SNAP command received, taking photo..."); // Restore original debug message
-       // Serial.println("ACK"); // <<< Remove temporary ACK
-       // /* <<< Remove start comment
-       // --- Original Photo Logic Restored ---
-       camera_fb_t * fb = esp_camera_fb_get();
-       if (fb) {
-          // Send size back via Serial
-          Serial.printf("SIZE:%zu\n", fb->len); // Send size first, followed by newline
-          // Send image bytes back via Serial
-          Serial.write(fb->buf, fb->len); // Send raw bytes
-          Serial.flush(); // Ensure data is sent before returning buffer
-          esp_camera_fb_return(fb);
-          Serial.println("FRAME_END"); // Send confirmation/end marker
-          Serial.println("Photo sent."); // Debug
+       // "SNAP:<game>,<ply>" from the hub's moves is archived; a plain SNAP (e.g. BENCH) is not
+       long hubGame = -1;
+       unsigned long ply = 0;
+       if (cmd[4] == ':') {
+          char* end;
+          hubGame = strtol(cmd + 5, &end, 10);
+          ply = (*end == ',') ? strtoul(end + 1, nullptr, 10) : 0;
+       }
+       bool settleTimedOut = false;
+       unsigned long settleMs = waitForSceneToSettle(&settleTimedOut);
+       Serial.printf("Scene settle: %lu ms%s\n", settleMs, settleTimedOut ? " (timed out)" : ""); // Debug
+       uint32_t sharpness = 0;
+       size_t frameLen = (bestFrameBuffer != nullptr) ? captureSharpestFrame(&sharpness) : 0;
+       if (frameLen > 0) {
+          uint32_t archiveGame = archiveGameFor(hubGame);
+          sendFrame(frameLen, sharpness, settleMs, settleTimedOut, archiveGame);
+          if (archiveGame != 0) {
+             archiveFullResolution(archiveGame, (uint16_t)ply);
+          }
        } else {
           Serial.println("ERROR:CaptureFail"); // Send error back via Serial
           Serial.println("Camera capture failed"); // Debug
        }
-       // */ <<< Remove end comment
+    } else if (strncmp(cmd, "SETTLE:", 7) == 0) {
+       // SETTLE:<window_ms>,<deadline_ms>
+       const char* comma = strchr(cmd, ',');
+       if (comma != nullptr && comma > cmd + 7) {
+          settleWindowMs = strtoul(cmd + 7, nullptr, 10);
+          settleDeadlineMs = strtoul(comma + 1, nullptr, 10);
+          Serial.printf("Settle window %lu ms, deadline %lu ms\n", settleWindowMs, settleDeadlineMs); // Debug
+       } else {
+          Serial.printf("Malformed SETTLE command: %s\n", cmd); // Debug
+       }
+    } else if (strcmp(cmd, "DELTA:ON") == 0 || strcmp(cmd, "DELTA:OFF") == 0) {
+       deltaModeEnabled = (strcmp(cmd, "DELTA:ON") == 0);
+       keyframeRequested = true; // Restart the delta chain from a keyframe
+       Serial.printf("Delta mode %s\n", deltaModeEnabled ? "on" : "off"); // Debug
+    } else if (strcmp(cmd, "PREVIEW:ON") == 0 || strcmp(cmd, "PREVIEW:OFF") == 0) {
+       previewEnabled = (strcmp(cmd, "PREVIEW:ON") == 0);
+       Serial.printf("Previews %s\n", previewEnabled ? "on" : "off"); // Debug
+    } else if (strncmp(cmd, "CALIB:", 6) == 0) {
+       if (storeCalibration(cmd + 6)) {
+          Serial.println("Board calibration stored"); // Debug
+       } else {
+          Serial.printf("Malformed CALIB command: %s\n", cmd); // Debug
+       }
+    } else if (strcmp(cmd, "TILES:ON") == 0 || strcmp(cmd, "TILES:OFF") == 0) {
+       tileModeEnabled = (strcmp(cmd, "TILES:ON") == 0);
+       preferences.putBool("tiles", tileModeEnabled);
+       Serial.printf("Tile mode %s%s\n", tileModeEnabled ? "on" : "off",
+                     (tileModeEnabled && !boardCalibrated) ? " (not calibrated, sending JPEGs)" : ""); // Debug
+    } else if (strcmp(cmd, "KEYFRAME") == 0) {
+       keyframeRequested = true;
+       Serial.println("Keyframe requested for next SNAP"); // Debug
+    } else if (strncmp(cmd, "CAMCFG:", 7) == 0) {
+       if (applyCameraConfig(cmd + 7)) {
+          keyframeRequested = true; // Frame size may have changed; the delta reference is stale
+       } else {
+          Serial.printf("Malformed CAMCFG command: %s\n", cmd); // Debug
+       }
+    } else if (strncmp(cmd, "FETCH:", 6) == 0) {
+       sendArchiveBlock(cmd + 6);
+    } else if (strcmp(cmd, "DIAG") == 0) {
+       // DIAG:<free_heap>,<min_free_heap>,<largest_block>,<loop_stack_hwm>,<free_psram>,<archived>,<archive_skipped>,
+       //      <standbys>,<last_wake_ms>,<max_wake_ms>
+       Serial.printf("DIAG:%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n", (unsigned long)ESP.getFreeHeap(),
+                     (unsigned long)ESP.getMinFreeHeap(),
+                     (unsigned long)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT),
+                     (unsigned long)uxTaskGetStackHighWaterMark(nullptr), (unsigned long)ESP.getFreePsram(),
+                     (unsigned long)archivedFrames, (unsigned long)archiveSkipped, (unsigned long)standbyCount,
+                     lastWakeMs, maxWakeMs);
+#if USE_STANDBY
+    } else if (strcmp(cmd, "STANDBY") == 0) {
+       enterStandby();
+    } else if (strcmp(cmd, "WAKE") == 0) {
+       powerUpSensor(); // A clock started; the first capture follows shortly
+    } else if (strncmp(cmd, "IDLE:", 5) == 0) {
+       standbyIdleMs = strtoul(cmd + 5, nullptr, 10);
+       Serial.printf("Standby after %lu ms without a command\n", standbyIdleMs); // Debug
+#endif
     } else {
-       Serial.printf("Unknown command: %s\n", cmd.c_str()); // Debug
+       Serial.printf("Unknown command: %s\n", cmd); // Debug
+    }
+  }
+
+#if USE_STANDBY
+  // The archive writer has to finish first: light sleep stops every task
+  if (Serial.available() == 0 && !archiveWriterBusy) {
+    if (!standby && standbyIdleMs > 0 && millis() - lastCommandMs >= standbyIdleMs) {
+      enterStandby();
+    }
+    if (standby) {
+      sleepUntilCommand();
+      return;
     }
   }
+#endif
 
   delay(10); // Small delay
 } 
\ No newline at end of file
@@ -0,0 +1,89 @@
+#pragma once
+// Notification transport used by the hub for everything it sends to the client, and the chunking
+// and pacing of large payloads (preview and full image) on top of it.
+//
+// The hub implements ClientTransport on its Bluedroid or NimBLE characteristic and on the framed
+// USB serial link (usb_link.h), both in main.cpp; tools/ble_loopback.h implements it on a simulated
+// link so tools/ble_transport_bench.cpp can compare pacing strategies off-device. No Arduino dependencies.
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+class ClientTransport {
+public:
+  virtual ~ClientTransport() {}
+
+  virtual bool connected() = 0;
+  // Largest notification payload (ATT MTU - 3 on BLE)
+  virtual size_t maxPayload() = 0;
+  // Queues one notification; false if it was not accepted
+  virtual bool notify(const uint8_t* data, size_t len) = 0;
+  // Notifications the stack can take right now without congestion, or -1 if unknown
+  virtual int sendableCount() { return -1; }
+  // Pacing delay between chunks (delay() on the hub)
+  virtual void wait(unsigned long ms) = 0;
+
+  bool notify(const char* message) {
+    return notify((const uint8_t*)message, strlen(message));
+  }
+};
+
+// How a payload is cut into notifications and paced
+struct ChunkPacing {
+  size_t chunkSize;           // Bytes per notification, capped at maxPayload(); 0 = maxPayload()
+  unsigned long chunkDelayMs; // Delay after every chunk
+  int chunksPerPass;          // Chunks per pumpChunks() call (0 = all of them)
+  bool waitForCredit;         // Hold chunks back while sendableCount() is 0
+};
+
+// A payload being sent a few chunks at a time (see pumpChunks())
+struct ChunkTransfer {
+  const uint8_t* data;
+  size_t size;
+  size_t sent;
+  bool active;
+};
+
+inline size_t chunkSizeFor(ClientTransport& transport, const ChunkPacing& pacing) {
+  size_t maxPayload = transport.maxPayload();
+  return (pacing.chunkSize == 0 || pacing.chunkSize > maxPayload) ? maxPayload : pacing.chunkSize;
+}
+
+// Sends the next chunks of the transfer; returns true once all bytes are out. A chunk the transport
+// refuses is retried on the next call.
+inline bool pumpChunks(ClientTransport& transport, ChunkTransfer& transfer, const ChunkPacing& pacing) {
+  size_t chunkSize = chunkSizeFor(transport, pacing);
+  for (int i = 0; (pacing.chunksPerPass == 0 || i < pacing.chunksPerPass) && transfer.sent < transfer.size; i++) {
+    if (pacing.waitForCredit && transport.sendableCount() == 0) {
+      break; // Stack is congested; try again next pass
+    }
+    size_t len = transfer.size - transfer.sent;
+    if (len > chunkSize) {
+      len = chunkSize;
+    }
+    if (!transport.notify(transfer.data + transfer.sent, len)) {
+      break;
+    }
+    transfer.sent += len;
+    if (pacing.chunkDelayMs > 0) {
+      transport.wait(pacing.chunkDelayMs);
+    }
+  }
+  return transfer.sent >= transfer.size;
+}
+
+// With credit pacing, waits (up to maxWaitMs) until the stack can take a notification, so
+// markers sent around a transfer aren't dropped either
+inline void waitForCredit(ClientTransport& transport, const ChunkPacing& pacing, unsigned long maxWaitMs = 100) {
+  for (unsigned long waited = 0; pacing.waitForCredit && transport.sendableCount() == 0 && waited < maxWaitMs; waited++) {
+    transport.wait(1);
+  }
+}
+
+// Sends a whole payload, blocking (used for the small preview)
+inline void sendChunked(ClientTransport& transport, const uint8_t* data, size_t size, const ChunkPacing& pacing) {
+  ChunkTransfer transfer = {data, size, 0, true};
+  while (transport.connected() && !pumpChunks(transport, transfer, pacing)) {
+    transport.wait(1);
+  }
+}
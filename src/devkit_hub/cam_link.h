@@ -0,0 +1,182 @@
+#pragma once
+// Receiver for the CAM -> hub frame protocol on Serial2. The CAM answers "SNAP" with
+//   [PREVIEW:<len>\n <len bytes>]  SIZE:<n> SHARP:<s> SETTLE:<ms> SETTLE_TO:<0|1> TYPE:<t> ID:<id> [REF:<id>] [GAME:<g>]\n
+//   <n bytes>  FRAME_END\n
+// or "ERROR:<reason>\n". Bytes are pushed in as they arrive and the caller owns the timeout, so the
+// same code runs on the hub and on a host against tools/cam_emulator.py (see tools/cam_link_bench.cpp).
+#include <ctype.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// --- Numeric value following key in a CAM header line, 0 if the key is absent ---
+inline unsigned long camHeaderField(const char* line, const char* key) {
+  const char* field = strstr(line, key);
+  return (field != nullptr) ? strtoul(field + strlen(key), nullptr, 10) : 0;
+}
+
+// Frame header fields (fields after SIZE are optional for older CAM firmware)
+struct CamFrameHeader {
+  size_t size;
+  unsigned long sharpness;
+  unsigned long settleMs;
+  bool settleTimedOut;
+  const char* frameType; // As sent to the client: "key", "delta" or "tiles"
+  bool isDelta;
+  unsigned long frameId;
+  unsigned long refId;
+  unsigned long archiveGame; // Game the CAM archives the full-resolution frame under, 0 if not archived
+};
+
+enum CamRecvStatus { CAM_RECV_BUSY, CAM_RECV_DONE, CAM_RECV_ERROR };
+
+class CamReceiver {
+public:
+  enum State { WAIT_FOR_SIZE, READ_PREVIEW, READ_IMAGE, WAIT_FOR_END, FINISHED };
+  static const size_t LINE_MAX_LEN = 128;
+
+  CamReceiver(uint8_t* image = nullptr, size_t imageCapacity = 0, uint8_t* preview = nullptr, size_t previewCapacity = 0) {
+    attach(image, imageCapacity, preview, previewCapacity);
+    begin();
+  }
+
+  // Sets where frames and previews are received to (null disables previews)
+  void attach(uint8_t* image, size_t imageCapacity, uint8_t* preview, size_t previewCapacity) {
+    image_ = image;
+    imageCapacity_ = imageCapacity;
+    preview_ = preview;
+    previewCapacity_ = previewCapacity;
+  }
+
+  // Called with every text line received (for debug logging); may be null
+  void (*onLine)(const char* line) = nullptr;
+
+  // Starts a new frame; call right before sending SNAP
+  void begin() {
+    state_ = WAIT_FOR_SIZE;
+    lineLen_ = 0;
+    bytesRead_ = 0;
+    previewSize_ = 0;
+    error_ = nullptr;
+    header_ = {0, 0, 0, false, "key", false, 0, 0, 0};
+  }
+
+  // Consumes received bytes. Stops at the end of the frame (or at an error); *consumed, if given,
+  // says how many bytes were used.
+  CamRecvStatus feed(const uint8_t* data, size_t len, size_t* consumed = nullptr) {
+    size_t i = 0;
+    while (i < len && state_ != FINISHED) {
+      if (state_ == READ_PREVIEW || state_ == READ_IMAGE) {
+        uint8_t* dest = (state_ == READ_PREVIEW) ? preview_ : image_;
+        size_t expected = (state_ == READ_PREVIEW) ? previewSize_ : header_.size;
+        size_t n = expected - bytesRead_;
+        if (n > len - i) {
+          n = len - i;
+        }
+        memcpy(dest + bytesRead_, data + i, n);
+        bytesRead_ += n;
+        i += n;
+        if (bytesRead_ == expected) {
+          state_ = (state_ == READ_PREVIEW) ? WAIT_FOR_SIZE : WAIT_FOR_END;
+        }
+        continue;
+      }
+      char c = (char)data[i++];
+      if (c != '\n') {
+        if (lineLen_ < LINE_MAX_LEN - 1) {
+          line_[lineLen_++] = c; // Longer lines are truncated
+        }
+        continue;
+      }
+      while (lineLen_ > 0 && isspace((unsigned char)line_[lineLen_ - 1])) {
+        lineLen_--;
+      }
+      line_[lineLen_] = '\0';
+      lineLen_ = 0;
+      if (onLine != nullptr) {
+        onLine(line_);
+      }
+      handleLine(line_);
+    }
+    if (consumed != nullptr) {
+      *consumed = i;
+    }
+    if (state_ != FINISHED) {
+      return CAM_RECV_BUSY;
+    }
+    return (error_ == nullptr) ? CAM_RECV_DONE : CAM_RECV_ERROR;
+  }
+
+  State state() const { return state_; }
+  // Between the first byte of a preview/frame and FRAME_END the CAM sends without pauses, so a
+  // silent link here means bytes were lost (the caller applies a short stall timeout)
+  bool midFrame() const { return state_ == READ_PREVIEW || state_ == READ_IMAGE || state_ == WAIT_FOR_END; }
+  const CamFrameHeader& header() const { return header_; }
+  size_t bytesRead() const { return bytesRead_; } // Of the part being read
+  size_t previewSize() const { return previewSize_; }
+  const char* error() const { return error_; }    // Why the frame failed, null on success
+
+private:
+  void fail(const char* reason) {
+    error_ = reason;
+    state_ = FINISHED;
+  }
+
+  void handleLine(const char* line) {
+    if (state_ == WAIT_FOR_END) {
+      if (strcmp(line, "FRAME_END") == 0) {
+        state_ = FINISHED;
+      } else if (strstr(line, "FRAME_END") != nullptr) {
+        fail("misaligned"); // Bytes were lost or added; the marker arrived inside the image
+      }
+      return; // Anything else is stray debug output
+    }
+    if (strncmp(line, "SIZE:", 5) == 0) {
+      header_.size = strtoul(line + 5, nullptr, 10);
+      header_.sharpness = camHeaderField(line, "SHARP:");
+      header_.settleMs = camHeaderField(line, "SETTLE:");
+      header_.settleTimedOut = camHeaderField(line, "SETTLE_TO:") != 0;
+      header_.isDelta = strstr(line, "TYPE:DELTA") != nullptr;
+      header_.frameType = header_.isDelta ? "delta" : strstr(line, "TYPE:TILES") ? "tiles" : "key";
+      header_.frameId = camHeaderField(line, " ID:");
+      header_.refId = camHeaderField(line, "REF:");
+      header_.archiveGame = camHeaderField(line, "GAME:");
+      if (header_.size == 0) {
+        fail("invalid_size");
+      } else if (image_ == nullptr || header_.size > imageCapacity_) {
+        fail("size_too_large");
+      } else {
+        bytesRead_ = 0;
+        state_ = READ_IMAGE;
+      }
+    } else if (strncmp(line, "PREVIEW:", 8) == 0) {
+      // Thumbnail ahead of the frame, then the usual SIZE header
+      previewSize_ = strtoul(line + 8, nullptr, 10);
+      if (preview_ == nullptr || previewSize_ == 0 || previewSize_ > previewCapacity_) {
+        previewSize_ = 0;
+        fail("invalid_preview"); // Stream position unknown
+      } else {
+        bytesRead_ = 0;
+        state_ = READ_PREVIEW;
+      }
+    } else if (strncmp(line, "ERROR:", 6) == 0) {
+      fail("cam_error");
+    } else if (strstr(line, "FRAME_END") != nullptr) {
+      fail("header_lost"); // A whole frame went by without a readable SIZE line
+    }
+    // Anything else is stray debug output; keep waiting for SIZE
+  }
+
+  uint8_t* image_;
+  size_t imageCapacity_;
+  uint8_t* preview_;
+  size_t previewCapacity_;
+  State state_;
+  char line_[LINE_MAX_LEN];
+  size_t lineLen_;
+  size_t bytesRead_;
+  size_t previewSize_;
+  const char* error_;
+  CamFrameHeader header_;
+};
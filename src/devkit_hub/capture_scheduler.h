@@ -0,0 +1,163 @@
+#pragma once
+// Board capture jobs, one per move, and which of them are still worth running.
+//
+// A capture shows the board as it is when it runs, not as it was at the press, so when moves come
+// faster than one capture-and-send cycle a queued job only delays the newest position. Jobs are
+// queued here and stale ones dropped by policy; the hub runs one job per loop() pass, after the
+// presses the interrupt queued meanwhile are in. No Arduino dependencies, like time_control.h.
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum CapturePolicy : uint8_t {
+  CAPTURE_LATEST,    // Only the newest job is kept
+  CAPTURE_EVERY_NTH, // Jobs for every Nth move are kept, plus the newest
+  CAPTURE_ALL,       // Every job is kept up to a queue depth; beyond it the oldest is dropped
+  CAPTURE_POLICY_COUNT
+};
+const char* const capturePolicyNames[CAPTURE_POLICY_COUNT] = {"LATEST", "EVERY", "ALL"};
+
+const int CAPTURE_QUEUE_LEN = 8;
+
+struct CaptureJob {
+  uint16_t ply;         // Moves made in the game when it was requested (0 = game start)
+  uint32_t requestedMs; // Press time
+};
+
+class CaptureScheduler {
+public:
+  // param: N for CAPTURE_EVERY_NTH, the depth limit for CAPTURE_ALL (clamped to the queue size)
+  void configure(CapturePolicy policy, uint16_t param) {
+    policy_ = policy;
+    param_ = (param == 0) ? 1 : param;
+    if (policy_ == CAPTURE_ALL && param_ > CAPTURE_QUEUE_LEN) {
+      param_ = CAPTURE_QUEUE_LEN;
+    }
+  }
+
+  // New game: pending jobs are dropped and move numbering restarts
+  void reset() {
+    dropped_ += count_;
+    count_ = 0;
+    nextPly_ = 0;
+    lastDeliveredPly_ = -1;
+  }
+
+  // Queues a capture for the next move, then drops what the policy no longer wants
+  void request(uint32_t nowMs) {
+    requested_++;
+    CaptureJob job = {nextPly_++, nowMs};
+    switch (policy_) {
+      case CAPTURE_LATEST:
+        dropped_ += count_;
+        count_ = 0;
+        break;
+      case CAPTURE_EVERY_NTH:
+        // The previous newest was only kept for being the newest
+        if (count_ > 0 && jobs_[count_ - 1].ply % param_ != 0) {
+          count_--;
+          dropped_++;
+        }
+        break;
+      case CAPTURE_ALL:
+      default:
+        while (count_ >= param_) {
+          popOldest();
+          dropped_++;
+        }
+        break;
+    }
+    if (count_ == CAPTURE_QUEUE_LEN) {
+      popOldest();
+      dropped_++;
+    }
+    jobs_[count_++] = job;
+    if (count_ > maxDepth_) {
+      maxDepth_ = count_;
+    }
+  }
+
+  // Takes the oldest remaining job; false if there is none
+  bool next(CaptureJob* job, uint32_t nowMs) {
+    if (count_ == 0) {
+      return false;
+    }
+    *job = jobs_[0];
+    popOldest();
+    run_++;
+    uint32_t lag = nowMs - job->requestedMs;
+    if (lag > maxLagMs_) {
+      maxLagMs_ = lag;
+    }
+    return true;
+  }
+
+  // The client got an image for this ply
+  void markDelivered(uint16_t ply) {
+    lastDeliveredPly_ = ply;
+  }
+
+  // Moves right before ply that the client got no image for (dropped or failed captures); it has
+  // to infer them from the positions on either side
+  uint16_t skippedBefore(uint16_t ply) const {
+    int32_t skipped = (int32_t)ply - lastDeliveredPly_ - 1;
+    return (skipped > 0) ? (uint16_t)skipped : 0;
+  }
+
+  int depth() const { return count_; }
+  // Age of the oldest pending job (0 if none)
+  uint32_t lagMs(uint32_t nowMs) const { return (count_ > 0) ? nowMs - jobs_[0].requestedMs : 0; }
+  CapturePolicy policy() const { return policy_; }
+  uint16_t policyParam() const { return param_; }
+  uint32_t requested() const { return requested_; }
+  uint32_t run() const { return run_; }
+  uint32_t dropped() const { return dropped_; }
+  int maxDepth() const { return maxDepth_; }
+  uint32_t maxLagMs() const { return maxLagMs_; } // Largest press-to-capture lag of a job that ran
+
+private:
+  void popOldest() {
+    memmove(&jobs_[0], &jobs_[1], (count_ - 1) * sizeof(CaptureJob));
+    count_--;
+  }
+
+  CapturePolicy policy_ = CAPTURE_LATEST;
+  uint16_t param_ = 1;
+  CaptureJob jobs_[CAPTURE_QUEUE_LEN]; // Oldest first
+  int count_ = 0;
+  uint16_t nextPly_ = 0;
+  int32_t lastDeliveredPly_ = -1;
+  uint32_t requested_ = 0;
+  uint32_t run_ = 0;
+  uint32_t dropped_ = 0;
+  int maxDepth_ = 0;
+  uint32_t maxLagMs_ = 0;
+};
+
+// --- Parse "<LATEST|EVERY|ALL>[,<n>]" ---
+// e.g. "EVERY,2" (every second move plus the newest) or "ALL,4" (all, at most 4 queued)
+inline bool parseCapturePolicy(const char* text, CapturePolicy* policy, uint16_t* param) {
+  const char* comma = strchr(text, ',');
+  size_t nameLen = (comma != nullptr) ? (size_t)(comma - text) : strlen(text);
+  int kind = 0;
+  while (kind < CAPTURE_POLICY_COUNT &&
+         !(strlen(capturePolicyNames[kind]) == nameLen && strncmp(text, capturePolicyNames[kind], nameLen) == 0)) {
+    kind++;
+  }
+  if (kind == CAPTURE_POLICY_COUNT) {
+    return false;
+  }
+  unsigned long value = 1;
+  if (comma != nullptr) {
+    char* end;
+    value = strtoul(comma + 1, &end, 10);
+    if (end == comma + 1 || *end != '\0' || value == 0 || value > 0xFFFF) {
+      return false;
+    }
+  } else if (kind != CAPTURE_LATEST) {
+    return false; // EVERY and ALL need their number
+  }
+  *policy = (CapturePolicy)kind;
+  *param = (uint16_t)value;
+  return true;
+}
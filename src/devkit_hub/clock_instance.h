@@ -0,0 +1,95 @@
+#pragma once
+// One board driven by the hub: its clock, its capture jobs and the camera link that films it.
+//
+// The hub runs BOARD_COUNT of these (bughouse, simuls). A press steps only its own board's engine
+// and queues the result, so the work in the button interrupt is the same for one board or eight;
+// loop() then sends that board's BLE update. Capture jobs of all boards share the camera links:
+// nextCaptureBoard() picks the board whose oldest job has waited longest. No Arduino dependencies;
+// tools/multi_board_sim.cpp runs the same code on a host.
+#include "capture_scheduler.h"
+#include "time_control.h"
+
+const int MAX_BOARDS = 8;
+
+struct ClockInstance {
+  TimeControl clock;
+  CaptureScheduler captures;
+  uint8_t camera;        // Index of the camera link that films this board
+  uint16_t archiveGame;  // Games started on this board, sent with SNAP so the CAM files each game apart
+  uint32_t lastAnchorMs; // When this board's clock anchor was last sent
+};
+
+// A transition made in the button interrupt, with the board it happened on
+struct BoardTransition {
+  uint8_t board;
+  ClockTransition clock;
+};
+
+// Transitions of all boards in press order: the interrupt pushes, loop() pops, both under the
+// hub's clock lock. A full queue drops the transition (the clock itself has still switched).
+template <int N>
+class TransitionQueue {
+public:
+  bool push(const BoardTransition& transition) {
+    int next = (head_ + 1) % N;
+    if (next == tail_) {
+      return false;
+    }
+    items_[head_] = transition;
+    head_ = next;
+    return true;
+  }
+
+  bool pop(BoardTransition* transition) {
+    if (tail_ == head_) {
+      return false;
+    }
+    *transition = items_[tail_];
+    tail_ = (tail_ + 1) % N;
+    return true;
+  }
+
+private:
+  BoardTransition items_[N];
+  volatile int head_ = 0; // Next slot push() writes
+  volatile int tail_ = 0; // Next slot pop() reads
+};
+
+// --- A button event on one board: step its engine at nowMs and queue what happened ---
+// O(1) whatever the number of boards; called from the interrupt with the clock lock held.
+template <int N>
+inline ClockTransition pressBoard(ClockInstance* boards, uint8_t board, ClockEvent event, uint32_t nowMs,
+                                  TransitionQueue<N>& queue) {
+  ClockTransition transition = boards[board].clock.handle(event, nowMs);
+  if (transition.action != ACTION_NONE) {
+    queue.push({board, transition});
+  }
+  return transition;
+}
+
+// --- Board whose oldest pending capture has waited longest, or -1 if none has one ---
+inline int nextCaptureBoard(const ClockInstance* boards, int count, uint32_t nowMs) {
+  int best = -1;
+  uint32_t bestLag = 0;
+  for (int i = 0; i < count; i++) {
+    if (boards[i].captures.depth() == 0) {
+      continue;
+    }
+    uint32_t lag = boards[i].captures.lagMs(nowMs);
+    if (best < 0 || lag > bestLag) {
+      best = i;
+      bestLag = lag;
+    }
+  }
+  return best;
+}
+
+// --- True if a game is running on any board (bulk transfers and config changes wait for all) ---
+inline bool anyGameRunning(const ClockInstance* boards, int count) {
+  for (int i = 0; i < count; i++) {
+    if (boards[i].clock.isRunning()) {
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,156 @@
+#pragma once
+// The last few captured frames, kept on the hub so clients can pull them (GET) instead of having
+// every frame pushed at them.
+//
+// Frames (image and preview bytes) are copied into one arena as a ring log: each frame goes right
+// after the newest one, or back at the start of the arena if it doesn't fit before the end. Frames
+// whose bytes it overwrites are dropped, as is the oldest once FRAME_STORE_SLOTS are in use. So the
+// store holds as many recent frames as fit, however large each one is. Frames are looked up by
+// board and ply. No Arduino dependencies.
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+const int FRAME_STORE_SLOTS = 8;
+
+// What the client is told about a frame (the fields of image_start)
+struct FrameInfo {
+  uint8_t board;
+  uint16_t ply;
+  uint16_t skipped;
+  uint32_t lagMs;
+  uint32_t sharpness;
+  uint32_t settleMs;
+  bool settleTimedOut;
+  const char* frameType; // "key", "delta" or "tiles" (static strings)
+  bool isDelta;
+  uint32_t frameId;
+  uint32_t refId;
+  uint32_t archiveGame;
+  uint32_t size;        // Image bytes
+  uint32_t previewSize; // Preview bytes (0 if the CAM sent none)
+};
+
+struct StoredFrame {
+  FrameInfo info;
+  const uint8_t* image;
+  const uint8_t* preview; // Null without a preview
+};
+
+class FrameStore {
+public:
+  void attach(uint8_t* arena, size_t capacity) {
+    arena_ = arena;
+    capacity_ = (arena != nullptr) ? capacity : 0;
+    count_ = 0;
+    head_ = 0;
+  }
+
+  // Where the next store() of a frame with these sizes will write, or null if it can't fit at all.
+  // Lets the caller stop reading bytes that are about to be overwritten.
+  uint8_t* placement(uint32_t imageSize, uint32_t previewSize) const {
+    size_t bytes = (size_t)imageSize + previewSize;
+    if (bytes == 0 || bytes > capacity_) {
+      return nullptr;
+    }
+    return arena_ + ((head_ + bytes <= capacity_) ? head_ : 0);
+  }
+
+  // Copies a frame in (replacing one with the same board and ply); false if it is larger than the arena
+  bool store(const FrameInfo& info, const uint8_t* image, const uint8_t* preview) {
+    uint32_t previewSize = (preview != nullptr) ? info.previewSize : 0;
+    uint8_t* place = placement(info.size, previewSize);
+    if (place == nullptr) {
+      return false;
+    }
+    size_t bytes = (size_t)info.size + previewSize;
+    for (int i = count_ - 1; i >= 0; i--) {
+      const StoredFrame& frame = frames_[i];
+      bool sameMove = frame.info.board == info.board && frame.info.ply == info.ply;
+      if (sameMove || overlaps(frame, place, bytes)) {
+        remove(i);
+        evicted_ += sameMove ? 0 : 1;
+      }
+    }
+    if (count_ == FRAME_STORE_SLOTS) {
+      remove(0);
+      evicted_++;
+    }
+    memcpy(place, image, info.size);
+    StoredFrame& frame = frames_[count_++];
+    frame.info = info;
+    frame.info.previewSize = previewSize;
+    frame.image = place;
+    frame.preview = nullptr;
+    if (previewSize > 0) {
+      memcpy(place + info.size, preview, previewSize);
+      frame.preview = place + info.size;
+    }
+    head_ = (size_t)(place - arena_) + bytes;
+    stored_++;
+    return true;
+  }
+
+  // The frame for this board and ply, or null if it was never stored or has been dropped
+  const StoredFrame* find(uint8_t board, uint16_t ply) const {
+    for (int i = count_ - 1; i >= 0; i--) {
+      if (frames_[i].info.board == board && frames_[i].info.ply == ply) {
+        return &frames_[i];
+      }
+    }
+    return nullptr;
+  }
+
+  // Lowest and highest ply held for a board; false if none. Plies in between may be missing
+  // (dropped captures, or frames of other boards overwrote them).
+  bool plyRange(uint8_t board, uint16_t* oldest, uint16_t* newest) const {
+    bool found = false;
+    for (int i = 0; i < count_; i++) {
+      uint16_t ply = frames_[i].info.ply;
+      if (frames_[i].info.board != board) {
+        continue;
+      }
+      if (!found || ply < *oldest) {
+        *oldest = ply;
+      }
+      if (!found || ply > *newest) {
+        *newest = ply;
+      }
+      found = true;
+    }
+    return found;
+  }
+
+  // New game on a board: its move numbering restarts, so its old frames go
+  void clearBoard(uint8_t board) {
+    for (int i = count_ - 1; i >= 0; i--) {
+      if (frames_[i].info.board == board) {
+        remove(i);
+      }
+    }
+  }
+
+  int count() const { return count_; }
+  size_t capacity() const { return capacity_; }
+  uint32_t stored() const { return stored_; }
+  uint32_t evicted() const { return evicted_; } // Dropped to make room before anyone asked for them (or not)
+
+private:
+  static bool overlaps(const StoredFrame& frame, const uint8_t* start, size_t bytes) {
+    const uint8_t* frameEnd = frame.image + frame.info.size + frame.info.previewSize;
+    return frame.image < start + bytes && start < frameEnd;
+  }
+
+  void remove(int index) {
+    memmove(&frames_[index], &frames_[index + 1], (count_ - index - 1) * sizeof(StoredFrame));
+    count_--;
+  }
+
+  uint8_t* arena_ = nullptr;
+  size_t capacity_ = 0;
+  size_t head_ = 0; // End of the newest frame's bytes
+  StoredFrame frames_[FRAME_STORE_SLOTS]; // Oldest first
+  int count_ = 0;
+  uint32_t stored_ = 0;
+  uint32_t evicted_ = 0;
+};
@@ -1,15 +1,44 @@
+// BLE host stack, chosen per PlatformIO env: Bluedroid (esp32dev_hub) or NimBLE (esp32dev_hub_nimble,
+// -D USE_NIMBLE=1). Same service and characteristic either way; NimBLE needs far less RAM.
+#ifndef USE_NIMBLE
+#define USE_NIMBLE 0
+#endif
+
 #include <Arduino.h>
 #include <Wire.h>             // For I2C communication
 #include <LiquidCrystal_I2C.h> // For I2C LCD control
+#if USE_NIMBLE
+#include <NimBLEDevice.h>
+#else
 #include <BLEDevice.h>
 #include <BLEServer.h>
 #include <BLEUtils.h>
 #include <BLE2902.h>
+#endif
 #include <HardwareSerial.h> // <<< ADDED for Serial2
+#include <esp_heap_caps.h>   // Largest free heap block for diagnostics
+#include "time_control.h"    // Game state transitions and time-control policies
+#include "cam_link.h"        // CAM frame protocol receiver
+#include "ble_transport.h"   // Notification transport and image chunking
+#include "usb_link.h"        // Framing of the wired client link on the USB UART
+#include "capture_scheduler.h" // Per-move capture jobs, stale ones dropped by policy
+#include "clock_instance.h"  // One clock, capture queue and camera per board
+#include "frame_store.h"     // Recent frames kept for clients to pull
+#if !USE_NIMBLE
+#include <esp_gap_ble_api.h> // Sendable packet count for credit pacing, directed advertising
+#endif
 // #include "esp_camera.h" // <<< REMOVED Camera Header
 
 // --- Debugging Flags ---
 #define USE_LCD 1 // Set to 1 to enable LCD, 0 to disable
+#define USE_DELTA_FRAMES 0 // Set to 1 to have the CAM send inter-frame deltas instead of full JPEGs
+#define USE_PREVIEW_FRAMES 1 // Set to 1 to have the CAM send a thumbnail ahead of every frame
+#define USE_STATIC_BUFFERS 1 // Set to 1 to place image buffers and BLE callbacks in static storage (no heap use after setup)
+#define USE_BUTTON_INTERRUPTS 1 // Set to 1 to timestamp player presses in a GPIO interrupt (registered even while capturing)
+#define USE_BLE_BONDING 1 // Set to 1 to bond with the client and direct-advertise to it after a dropped link
+#define USE_FRAME_STORE 1 // Set to 1 to keep the last frames on the hub for clients to pull ("IMAGES:PULL", "GET:")
+#define USE_CAM_STANDBY 1 // Set to 1 to put the CAMs in standby between games and wake them when a clock starts
+#define USE_USB_CLIENT 1 // Set to 1 to accept a wired client on the USB serial port (framed, debug output multiplexed)
 
 // --- Pin Definitions ---
 // Define button pins
@@ -18,6 +47,16 @@ const int BTN_P1_PIN = 18;    // Use Pin 18 for P1
 const int BTN_P2_PIN = 19;    // Use Pin 19 for P2
 const int BUTTON_COUNT = 3;   // We have 3 buttons
 
+// --- Boards ---
+// One hub can run several boards (bughouse, simuls), each with its own reset/P1/P2 buttons and
+// clock. Raise BOARD_COUNT and add a row of pins per extra board.
+const int BOARD_COUNT = 1;
+const int boardButtonPins[BOARD_COUNT][BUTTON_COUNT] = {
+  {BTN_RESET_PIN, BTN_P1_PIN, BTN_P2_PIN},
+  // {25, 26, 27}, // Second board
+};
+static_assert(BOARD_COUNT <= MAX_BOARDS, "clock_instance.h supports up to MAX_BOARDS boards");
+
 // AI-Thinker ESP32-CAM Pin Map <<< REMOVED
 /* #define PWDN_GPIO_NUM     32
 ... [removed camera pins] ...
@@ -32,6 +71,17 @@ const int I2C_SCL_PIN = 22; // Standard ESP32 SCL pin
 // Serial Pins for ESP32-CAM Communication
 const int CAM_SERIAL_RX_PIN = 16; // Serial2 RX <- CAM TX (GPIO1)
 const int CAM_SERIAL_TX_PIN = 17; // Serial2 TX -> CAM RX (GPIO3)
+// Each camera link is a UART; a second CAM can go on UART1 with any two free pins
+const int CAM_COUNT = 1;
+const int camSerialPins[CAM_COUNT][2] = {
+  {CAM_SERIAL_RX_PIN, CAM_SERIAL_TX_PIN},
+  // {32, 33}, // Second CAM on UART1
+};
+// Camera that films each board. Boards can share one (a single frame showing both); those frames
+// are not archived on the CAM's card, since both boards' moves would be filed under one game.
+const uint8_t boardCameras[BOARD_COUNT] = {0};
+// Optional wake wire per camera, to the CAM's GPIO13 (-1 = wake it over the UART only)
+const int camWakePins[CAM_COUNT] = {-1};
 
 // --- Camera Configuration --- REMOVED
 // camera_config_t camera_config;
@@ -42,9 +92,12 @@ const int LCD_ADDR = 0x27;
 const int LCD_COLS = 16;        
 const int LCD_ROWS = 2;         
 #endif
-const unsigned long INITIAL_TIME_MS = 9 * 60 * 1000L; // 9 minutes in milliseconds
 const unsigned long DEBOUNCE_DELAY = 50; // Debounce time in milliseconds
-// #define BLE_CHUNK_SIZE 20 // <<< REMOVED - Not needed for state updates
+// Chunking of the preview and full image (ble_transport.h): MTU-sized notifications, sent only while the
+// stack has free TX buffers, so nothing is dropped on a slow link. tools/ble_transport_bench.cpp compares
+// this with fixed 20 byte / 5 ms pacing, which loses chunks once the connection interval is 30 ms.
+const ChunkPacing PREVIEW_PACING = {0, 0, 0, true};
+const ChunkPacing IMAGE_PACING = {0, 0, 8, true}; // At most 8 chunks per loop() pass, so presses and state updates go first
 
 
 // --- Global Variables ---
@@ -52,30 +105,185 @@ const unsigned long DEBOUNCE_DELAY = 50; // Debounce time in milliseconds
 LiquidCrystal_I2C lcd(LCD_ADDR, LCD_COLS, LCD_ROWS); 
 #endif
 HardwareSerial SerialCam(2); // Use UART2 for ESP32-CAM
+// HardwareSerial SerialCam2(1); // Second CAM
+HardwareSerial* const camLinks[CAM_COUNT] = {&SerialCam};
+HardwareSerial* activeCam = &SerialCam; // The link the capture and CAM commands below talk to
+bool camShared[CAM_COUNT];              // Filming more than one board
+
+#if USE_CAM_STANDBY
+// A CAM in standby light-sleeps and loses the bytes that wake it: commands to it are preceded by a
+// pulse on its wake pin, or by newlines and CAM_WAKE_GUARD_MS. Besides "STANDBY" between games, a
+// CAM goes to standby by itself after CAM_STANDBY_IDLE_MS without a command (sent as "IDLE:<ms>").
+const unsigned long CAM_STANDBY_IDLE_MS = 300000;
+const unsigned long CAM_WAKE_GUARD_MS = 5;
+bool camAsleep[CAM_COUNT];
+unsigned long camLastCommandMs[CAM_COUNT];
+#endif
 
-// Buffer for receiving camera image
-uint8_t* imageBuffer = nullptr;
+// Buffers for receiving camera images. The RAM NimBLE leaves free pays for a second one: a capture
+// then lands in the buffer the BLE transfer isn't reading, so the image in flight is only cancelled
+// once the next frame has actually arrived.
+#if USE_NIMBLE
+const int IMAGE_BUFFER_COUNT = 2;
+#else
+const int IMAGE_BUFFER_COUNT = 1;
+#endif
+uint8_t* imageBuffers[IMAGE_BUFFER_COUNT];
+uint8_t* imageBuffer = nullptr; // The one the CAM receiver writes to
 const size_t imageBufferSize = 30 * 1024; // 30KB buffer for QVGA JPEG
+// Buffer for the thumbnail the CAM sends ahead of the frame ("PREVIEW:<len>")
+uint8_t* previewBuffer = nullptr;
+const size_t previewBufferSize = 4 * 1024;
+#if USE_STATIC_BUFFERS
+static uint8_t imageBufferStorage[IMAGE_BUFFER_COUNT][imageBufferSize];
+static uint8_t previewBufferStorage[previewBufferSize];
+#endif
+// Header/marker lines from the CAM are read into a fixed buffer instead of a String
+const size_t CAM_LINE_MAX_LEN = 128;
+static char camLine[CAM_LINE_MAX_LEN];
+// Frame protocol state machine (cam_link.h), fed from camRxChunk
+CamReceiver camReceiver;
+static uint8_t camRxChunk[256];
+size_t lastPreviewSize = 0;
+
+// Sharpness of the last received frame, as scored by the CAM's burst capture ("SHARP:" in the frame header)
+uint32_t lastImageSharpness = 0;
+// Frames scoring below MIN_SHARPNESS are re-requested, up to MAX_CAPTURE_ATTEMPTS in total.
+// The score is scene dependent (mean squared luma gradient); 0 disables the retry.
+const uint32_t MIN_SHARPNESS = 0;
+const int MAX_CAPTURE_ATTEMPTS = 2;
+
+// Motion-settle result of the last frame ("SETTLE:<ms> SETTLE_TO:<0|1>" in the frame header)
+unsigned long lastImageSettleMs = 0;
+bool lastImageSettleTimedOut = false;
+// The CAM waits up to this long for the player's hand to leave the board before capturing
+const unsigned long CAM_SETTLE_DEADLINE_MS = 2000;
+// A frame whose bytes stop arriving for this long has lost bytes; give up instead of waiting for the timeout
+const unsigned long CAM_STALL_TIMEOUT_MS = 500;
+
+// Frame type of the last frame ("TYPE:KEY|DELTA|TILES ID:<n> [REF:<n>]" in the frame header)
+const char* lastImageFrameType = "key"; // As sent to the client: "key", "delta" or "tiles"
+bool lastImageIsDelta = false;
+unsigned long lastImageFrameId = 0;
+unsigned long lastImageRefId = 0;
+
+// Capture jobs, one queue per board (capture_scheduler.h). loop() runs one job per pass, from the
+// board that has waited longest; when moves come faster than a capture-and-send cycle the policy
+// drops stale ones. Change with "CAPTURE:<policy>[,<n>]".
+const CapturePolicy DEFAULT_CAPTURE_POLICY = CAPTURE_LATEST;
+// Job of the image being sent, for its start marker ("board", "ply", "skipped", "lag_ms")
+uint8_t lastImageBoard = 0;
+uint16_t lastImagePly = 0;
+uint16_t lastImageSkipped = 0;
+unsigned long lastImageLagMs = 0;
+
+// Full-resolution archive on the CAM's microSD card. Captures for moves are sent as
+// "SNAP:<game>,<ply>" so the CAM can file them; the frame header says which archive game it used.
+// <game> is the board's archiveGame, which counts games since boot; the CAM maps a new value to a
+// new archive game.
+unsigned long lastImageArchiveGame = 0;
+// "FETCH:<game>,<ply>" relays an archived frame block by block (the CAM's FETCH_BLOCK_SIZE)
+const size_t FETCH_BLOCK_SIZE = 8 * 1024;
+const int FETCH_MAX_ATTEMPTS = 5; // Per block, for lost bytes or the CAM still writing
+
+#if USE_FRAME_STORE
+// Recent frames (frame_store.h). Every capture is stored; with "IMAGES:PULL" the hub only announces
+// it (frame_ready, and a ply range in state updates) and sends what the client asks for with
+// "GET:<ply>[,preview|,<offset>,<len>]". Pull mode ends with the connection.
+const size_t FRAME_STORE_SIZE = 40 * 1024; // 3-5 QVGA frames with their previews
+#if USE_STATIC_BUFFERS
+static uint8_t frameStoreStorage[FRAME_STORE_SIZE];
+#endif
+FrameStore frameStore;
+bool pullImages = false;
+// GET requests waiting for the image transfer to be free
+struct FrameRequest {
+  uint8_t board;
+  uint16_t ply;
+  uint32_t offset;
+  uint32_t len;  // 0 = to the end
+  bool preview;
+};
+const int FRAME_REQUEST_QUEUE_LEN = 4;
+FrameRequest frameRequests[FRAME_REQUEST_QUEUE_LEN];
+int frameRequestCount = 0;
+#endif
 
-enum GameState { IDLE, RUNNING_P1, RUNNING_P2, GAME_OVER };
-GameState currentState = IDLE; // Start in IDLE state
+// When the last SNAP was sent, its SIZE header arrived and FRAME_END arrived (for BENCH)
+struct CamTiming {
+  unsigned long requestMs;
+  unsigned long headerMs;
+  unsigned long endMs;
+};
+CamTiming lastCamTiming = {0, 0, 0};
+
+// --- Self-benchmark ("BENCH:<cycles>[,<framesize>[,<quality>]]") ---
+const int BENCH_MAX_CYCLES = 50;
+enum BenchStage { BENCH_CAM, BENCH_UART, BENCH_BLE, BENCH_TOTAL, BENCH_STAGE_COUNT };
+const char* const benchStageNames[BENCH_STAGE_COUNT] = {"cam_ms", "uart_ms", "ble_ms", "total_ms"};
+static uint32_t benchSamples[BENCH_STAGE_COUNT][BENCH_MAX_CYCLES];
+// The CAM's configured frame size and JPEG quality, restored after a benchmark
+const char* const CAM_DEFAULT_FRAMESIZE = "QVGA";
+const int CAM_DEFAULT_QUALITY = 12;
+
+// Game state and both clocks of every board live in its time-control engine (time_control.h).
+// They are shared with the button interrupt, so every call into one is made under clockMux.
+ClockInstance boards[BOARD_COUNT];
+portMUX_TYPE clockMux = portMUX_INITIALIZER_UNLOCKED;
+// The LCD shows one board; extra boards are followed on the client
+const int LCD_BOARD = 0;
 const char* stateNames[] = {"IDLE", "RUNNING_P1", "RUNNING_P2", "GAME_OVER"}; // For easy printing
 
-unsigned long player1Time = INITIAL_TIME_MS;
-unsigned long player2Time = INITIAL_TIME_MS;
-unsigned long lastUpdateTime = 0; // For timekeeping
+// While a clock runs, the hub re-sends its anchor (see sendBleStateUpdate()) at this rate so clients
+// counting down locally can correct drift between the two crystals. Not a display refresh.
+const unsigned long CLOCK_HEARTBEAT_INTERVAL_MS = 15000;
+
+#if USE_BUTTON_INTERRUPTS
+// Transitions made in the interrupt, of all boards in press order; loop() sends their BLE updates
+// and captures
+const int CLOCK_QUEUE_LEN = 8 * BOARD_COUNT;
+TransitionQueue<CLOCK_QUEUE_LEN> clockQueue;
+// What a player button interrupt steps (its argument)
+struct PlayerButton {
+  uint8_t board;
+  uint8_t button; // Index into the board's pins
+  ClockEvent event;
+};
+PlayerButton playerButtons[BOARD_COUNT][2];
+volatile unsigned long lastPressTimes[BOARD_COUNT][BUTTON_COUNT];
+#endif
 
-// Button state variables (Restored for 3 buttons)
-int buttonStates[BUTTON_COUNT];
-int lastButtonStates[BUTTON_COUNT];
-unsigned long lastDebounceTimes[BUTTON_COUNT];
-const int buttonPins[BUTTON_COUNT] = {BTN_RESET_PIN, BTN_P1_PIN, BTN_P2_PIN};
+// Button state variables (Restored for 3 buttons), per board
+int buttonStates[BOARD_COUNT][BUTTON_COUNT];
+int lastButtonStates[BOARD_COUNT][BUTTON_COUNT];
+unsigned long lastDebounceTimes[BOARD_COUNT][BUTTON_COUNT];
 
 // Variables for long press detection (Removed single button logic)
 /* bool controlPinHeldDown = false;
 unsigned long controlPinPressStartTime = 0;
 const unsigned long LONG_PRESS_DURATION = 2000; // 2 seconds */
 
+// --- Heap / Stack Telemetry ---
+// Sampled every TELEMETRY_INTERVAL_MS, logged, and returned to the client on "DIAG".
+const unsigned long TELEMETRY_INTERVAL_MS = 10000;
+// Tasks whose stack high-water marks are reported (Arduino loop + the BLE stack's tasks)
+#if USE_NIMBLE
+const char* const monitoredTaskNames[] = {"loopTask", "btController", "nimble_host"};
+const char* const BLE_STACK_NAME = "nimble";
+#else
+const char* const monitoredTaskNames[] = {"loopTask", "btController", "BTC_TASK", "BTU_TASK"};
+const char* const BLE_STACK_NAME = "bluedroid";
+#endif
+const int MONITORED_TASK_COUNT = sizeof(monitoredTaskNames) / sizeof(monitoredTaskNames[0]);
+struct Telemetry {
+  uint32_t freeHeap;
+  uint32_t minFreeHeap;
+  uint32_t largestFreeBlock;
+  uint32_t stackHighWater[MONITORED_TASK_COUNT]; // Bytes never used; 0 if the task wasn't found
+};
+Telemetry telemetry;
+unsigned long lastTelemetryTime = 0;
+
 // --- Static variables for LCD update logic --- Moved from updateDisplay()
 static unsigned long lastDisplayUpdate = 0;
 static char timeBuffer1[9]; // HH:MM:SS format + null terminator (actually MM:SS.T)
@@ -85,184 +293,644 @@ static unsigned long lastP1Time = 0;
 static unsigned long lastP2Time = 0;
 // --- End static variables for LCD ---
 
+// Full-resolution image transfer, sent a few chunks per loop() pass after the preview
+ChunkTransfer imageTransfer = {nullptr, 0, 0, false};
+// The transfer answers a GET (frame_start/frame_end) instead of pushing a capture (image_start/image_end)
+bool imageTransferPulled = false;
+uint16_t imageTransferPly = 0;
+
+// --- Wired client on the USB UART (usb_link.h) ---
+// A PC that sends HELLO gets the client link on Serial instead of BLE until it sends BYE or goes
+// quiet for USB_CLIENT_TIMEOUT_MS: the same notifications, one per frame, and its commands. While it
+// is attached, log output goes out framed on the debug channel so it can't corrupt the client data.
+const unsigned long USB_BAUD = 921600;
+const size_t USB_TX_BUFFER_SIZE = 4096; // Three image chunks; the UART drains it while loop() runs
+const size_t DEBUG_FRAME_MAX_LEN = 256;
+#if USE_USB_CLIENT
+volatile bool usbClientActive = false;
+unsigned long usbClientLastFrameMs = 0;
+#else
+const bool usbClientActive = false;
+#endif
+
+// Log output: raw on Serial, or framed on the debug channel while a USB client is attached. Every
+// write() goes out as whole frames in one Serial.write(), so a line logged from a BLE callback
+// can't land in the middle of a client frame.
+class DebugOutput : public Print {
+public:
+    size_t write(uint8_t c) override {
+        return write(&c, 1);
+    }
+
+    size_t write(const uint8_t* data, size_t len) override {
+        if (!usbClientActive) {
+            return Serial.write(data, len);
+        }
+        uint8_t frame[DEBUG_FRAME_MAX_LEN + USB_FRAME_OVERHEAD];
+        for (size_t offset = 0; offset < len; offset += DEBUG_FRAME_MAX_LEN) {
+            size_t part = (len - offset < DEBUG_FRAME_MAX_LEN) ? len - offset : DEBUG_FRAME_MAX_LEN;
+            Serial.write(frame, encodeUsbFrame(USB_CH_DEBUG, data + offset, part, frame));
+        }
+        return len;
+    }
+};
+DebugOutput debugSerial;
+
 // --- BLE Definitions (Keep These) ---
+#if USE_NIMBLE
+NimBLEServer* pServer = NULL;
+NimBLECharacteristic* pStateCharacteristic = NULL; // NimBLE adds the CCCD itself
+uint16_t connHandle = 0;
+// Free msys buffers left to the host (ACL reassembly, ATT responses) when pacing notifications
+const int NOTIFY_MBUF_RESERVE = 4;
+#else
 BLEServer* pServer = NULL;
 BLECharacteristic* pStateCharacteristic = NULL; // Renamed for clarity
+BLE2902* pStateCccd = NULL;
+#endif
 // BLECharacteristic* pImageDataCharacteristic = NULL; // <<< REMOVED Image Characteristic
 bool deviceConnected = false;
 bool oldDeviceConnected = false;
 
+// Commands written by the client to the state characteristic. The BLE callback only copies
+// the command; it is handled from loop() so it never races the game logic.
+const size_t CLIENT_COMMAND_MAX_LEN = 160; // Fits "CALIB:" + 9 coefficients
+char pendingClientCommand[CLIENT_COMMAND_MAX_LEN];
+volatile unsigned long pendingClientCommandMs = 0; // When it arrived (the receive time of a SYNC)
+volatile bool clientCommandPending = false;
+
+// --- Fast reconnect ---
+// After a dropped link the hub sends high-duty directed advertising to the bonded client (the spec
+// caps it at 1.28 s), then falls back to normal advertising. As soon as the client is subscribed
+// again the current clock state is replayed, instead of waiting for the next move.
+const unsigned long DIRECTED_ADV_DURATION_MS = 1280;
+#if USE_NIMBLE
+ble_addr_t bondedPeerAddr; // Identity address
+#else
+esp_bd_addr_t bondedPeerAddr;
+esp_ble_addr_type_t bondedPeerAddrType = BLE_ADDR_TYPE_PUBLIC;
+#endif
+volatile bool bondedPeerKnown = false;
+bool directedAdvertising = false;
+unsigned long linkDroppedTime = 0;            // 0 = no drop since boot
+volatile unsigned long linkConnectedTime = 0;
+volatile bool stateReplayPending = false;
+
 // See the following for generating UUIDs: https://www.uuidgenerator.net/
 #define SERVICE_UUID        "4fafc201-1fb5-459e-8fcc-c5c9c331914b"
 #define STATE_CHARACTERISTIC_UUID "beb5483e-36e1-4688-b7f5-ea07361b26a8" // For game state
 // #define IMAGE_DATA_CHARACTERISTIC_UUID "..." // <<< REMOVED Image Characteristic UUID
 
+// --- Copy a command the client wrote for loop() to handle (BLE callback context) ---
+void queueClientCommand(const uint8_t* data, size_t len) {
+    if (clientCommandPending) {
+      debugSerial.println("Dropping client command, previous one not handled yet");
+      return;
+    }
+    if (len >= CLIENT_COMMAND_MAX_LEN) {
+      len = CLIENT_COMMAND_MAX_LEN - 1;
+    }
+    memcpy(pendingClientCommand, data, len);
+    pendingClientCommand[len] = '\0';
+    pendingClientCommandMs = millis();
+    clientCommandPending = true;
+}
+
+#if USE_NIMBLE
+// BLE Server Callback Class, NimBLE. Bonding callbacks live here too.
+class MyServerCallbacks: public NimBLEServerCallbacks {
+    void onConnect(NimBLEServer* pServer, ble_gap_conn_desc* desc) {
+      connHandle = desc->conn_handle;
+      deviceConnected = true;
+      linkConnectedTime = millis();
+#if USE_BLE_BONDING
+      NimBLEDevice::startSecurity(desc->conn_handle); // Encrypt; a bonded client's subscription is restored with it
+#endif
+      debugSerial.println("BLE Client Connected");
+    }
+
+    void onDisconnect(NimBLEServer* pServer, ble_gap_conn_desc* desc) {
+      deviceConnected = false;
+      debugSerial.println("BLE Client Disconnected");
+    }
+
+#if USE_BLE_BONDING
+    // Just Works bonding, as with Bluedroid
+    uint32_t onPassKeyRequest() {
+      return 0;
+    }
+
+    bool onConfirmPIN(uint32_t pin) {
+      return true;
+    }
+
+    void onAuthenticationComplete(ble_gap_conn_desc* desc) {
+      if (!desc->sec_state.encrypted) {
+        debugSerial.println("BLE pairing failed");
+        return;
+      }
+      if (desc->sec_state.bonded) {
+        bondedPeerAddr = desc->peer_id_addr;
+        bondedPeerKnown = true;
+        debugSerial.println("BLE client bonded.");
+      }
+    }
+#endif
+};
+
+// State Characteristic Callback Class (client -> hub commands, and subscriptions)
+class StateCharacteristicCallbacks: public NimBLECharacteristicCallbacks {
+    void onWrite(NimBLECharacteristic* pCharacteristic) {
+      NimBLEAttValue value = pCharacteristic->getValue();
+      queueClientCommand(value.data(), value.length());
+    }
+
+    // CCCD writes, and subscriptions restored from the bond after encryption: the client gets the
+    // current state right away
+    void onSubscribe(NimBLECharacteristic* pCharacteristic, ble_gap_conn_desc* desc, uint16_t subValue) {
+      if (subValue & 0x0001) {
+        stateReplayPending = true;
+      }
+    }
+};
+
+// Everything the hub notifies goes through this transport (state updates, markers, image chunks)
+class CharacteristicTransport : public ClientTransport {
+public:
+    using ClientTransport::notify;
+
+    bool connected() override {
+        return deviceConnected && pStateCharacteristic != nullptr;
+    }
+
+    size_t maxPayload() override {
+        uint16_t mtu = pServer->getPeerMTU(connHandle);
+        return (mtu > 23) ? mtu - 3 : 20;
+    }
+
+    // Straight to the host, so a notification it has no buffer for is refused instead of lost
+    bool notify(const uint8_t* data, size_t len) override {
+        pStateCharacteristic->setValue(data, len); // For READ
+        os_mbuf* om = ble_hs_mbuf_from_flat(data, len);
+        return om != nullptr && ble_gatts_notify_custom(connHandle, pStateCharacteristic->getHandle(), om) == 0;
+    }
+
+    // Every notification takes one or two msys buffers
+    int sendableCount() override {
+        int free = os_msys_num_free() - NOTIFY_MBUF_RESERVE;
+        return (free > 0) ? free / 2 : 0;
+    }
+
+    void wait(unsigned long ms) override {
+        delay(ms);
+    }
+};
+CharacteristicTransport bleLink;
+
+#if USE_STATIC_BUFFERS
+static MyServerCallbacks serverCallbacks;
+static StateCharacteristicCallbacks stateCharacteristicCallbacks;
+#endif
+
+#else // Bluedroid
 // BLE Server Callback Class (Keep This)
 class MyServerCallbacks: public BLEServerCallbacks {
     void onConnect(BLEServer* pServer) {
       deviceConnected = true;
-      Serial.println("BLE Client Connected");
+      linkConnectedTime = millis();
+      if (pStateCccd != nullptr && pStateCccd->getNotifications()) {
+        stateReplayPending = true; // Subscription kept from before the drop; no CCCD write will come
+      }
+      debugSerial.println("BLE Client Connected");
     };
 
     void onDisconnect(BLEServer* pServer) {
       deviceConnected = false;
-      Serial.println("BLE Client Disconnected");
+      debugSerial.println("BLE Client Disconnected");
+    }
+};
+
+// State Characteristic Callback Class (client -> hub commands)
+class StateCharacteristicCallbacks: public BLECharacteristicCallbacks {
+    void onWrite(BLECharacteristic* pCharacteristic) {
+      queueClientCommand(pCharacteristic->getData(), pCharacteristic->getLength());
+    }
+};
+// CCCD writes: the client (re)subscribed, so it gets the current state right away
+class StateCccdCallbacks: public BLEDescriptorCallbacks {
+    void onWrite(BLEDescriptor* pDescriptor) {
+      if (pDescriptor->getLength() > 0 && (pDescriptor->getValue()[0] & 0x01)) {
+        stateReplayPending = true;
+      }
+    }
+};
+
+#if USE_BLE_BONDING
+// Just Works bonding (the hub has no display or keypad). The bond lets the client keep its GATT
+// cache and subscription across drops; its identity address is the target of directed advertising.
+class BondingCallbacks: public BLESecurityCallbacks {
+    uint32_t onPassKeyRequest() {
+      return 0;
+    }
+
+    void onPassKeyNotify(uint32_t passKey) {}
+
+    bool onSecurityRequest() {
+      return true;
+    }
+
+    bool onConfirmPIN(uint32_t pin) {
+      return true;
+    }
+
+    void onAuthenticationComplete(esp_ble_auth_cmpl_t cmpl) {
+      if (!cmpl.success) {
+        debugSerial.printf("BLE pairing failed (reason 0x%x)\n", cmpl.fail_reason);
+        return;
+      }
+      memcpy(bondedPeerAddr, cmpl.bd_addr, sizeof(esp_bd_addr_t));
+      bondedPeerAddrType = cmpl.addr_type;
+      bondedPeerKnown = true;
+      debugSerial.println("BLE client bonded.");
+    }
+};
+#endif
+
+// Everything the hub notifies goes through this transport (state updates, markers, image chunks)
+class CharacteristicTransport : public ClientTransport {
+public:
+    using ClientTransport::notify;
+
+    bool connected() override {
+        return deviceConnected && pStateCharacteristic != nullptr;
+    }
+
+    size_t maxPayload() override {
+        uint16_t mtu = pServer->getPeerMTU(pServer->getConnId());
+        return (mtu > 23) ? mtu - 3 : 20;
+    }
+
+    bool notify(const uint8_t* data, size_t len) override {
+        pStateCharacteristic->setValue((uint8_t*)data, len);
+        pStateCharacteristic->notify();
+        return true; // Bluedroid doesn't report a dropped notification here; pace with sendableCount()
+    }
+
+    int sendableCount() override {
+        return esp_ble_get_cur_sendable_packets_num(pServer->getConnId());
+    }
+
+    void wait(unsigned long ms) override {
+        delay(ms);
+    }
+};
+CharacteristicTransport bleLink;
+
+#if USE_STATIC_BUFFERS
+static MyServerCallbacks serverCallbacks;
+static StateCharacteristicCallbacks stateCharacteristicCallbacks;
+static BLE2902 stateCccd;
+static StateCccdCallbacks stateCccdCallbacks;
+#if USE_BLE_BONDING
+static BondingCallbacks bondingCallbacks;
+static BLESecurity bleSecurity;
+#endif
+#endif
+#endif // USE_NIMBLE
+
+#if USE_USB_CLIENT
+// The client link on Serial: every notification becomes one client-channel frame. Serial.write()
+// only blocks once the TX buffer is full, so pacing on sendableCount() keeps the UART busy without
+// stalling loop(); markers and state updates are never refused.
+class UsbTransport : public ClientTransport {
+public:
+    using ClientTransport::notify;
+
+    bool connected() override {
+        return usbClientActive;
+    }
+
+    size_t maxPayload() override {
+        return USB_MAX_PAYLOAD;
     }
+
+    bool notify(const uint8_t* data, size_t len) override {
+        if (len > USB_MAX_PAYLOAD) {
+            return false;
+        }
+        Serial.write(frame_, encodeUsbFrame(USB_CH_CLIENT, data, len, frame_));
+        return true;
+    }
+
+    // Full-size frames that fit in the TX buffer right now
+    int sendableCount() override {
+        return Serial.availableForWrite() / (int)(USB_MAX_PAYLOAD + USB_FRAME_OVERHEAD);
+    }
+
+    void wait(unsigned long ms) override {
+        delay(ms);
+    }
+
+private:
+    uint8_t frame_[USB_MAX_PAYLOAD + USB_FRAME_OVERHEAD]; // Only loop() notifies
 };
+UsbTransport usbLink;
+UsbFrameDecoder<CLIENT_COMMAND_MAX_LEN> usbDecoder; // Frames from the PC
+#endif
+
+// Whichever link the client is on: the USB client while one is attached, else BLE
+class ActiveClientTransport : public ClientTransport {
+public:
+    using ClientTransport::notify;
+
+    bool connected() override {
+        return link().connected();
+    }
+
+    size_t maxPayload() override {
+        return link().maxPayload();
+    }
+
+    bool notify(const uint8_t* data, size_t len) override {
+        return link().notify(data, len);
+    }
 
+    int sendableCount() override {
+        return link().sendableCount();
+    }
+
+    void wait(unsigned long ms) override {
+        delay(ms);
+    }
+
+private:
+    ClientTransport& link() {
+#if USE_USB_CLIENT
+        if (usbClientActive) {
+            return usbLink;
+        }
+#endif
+        return bleLink;
+    }
+};
+ActiveClientTransport clientLink;
 
 // --- Function Prototypes ---
 void handleButtons(); // Changed back from handleControlButton
-void resetGame();
-void startGame(int playerWhoPressedButton);
-void switchPlayer(int nextPlayerWhoseClockStarts);
+void resetGame(int board);
+void dispatchClockEvent(int board, ClockEvent event);
+void handleClockTransition(int board, const ClockTransition& transition);
+#if USE_BUTTON_INTERRUPTS
+void IRAM_ATTR onPlayerPress(void* arg);
+void processQueuedTransitions();
+#endif
+void runNextCapture();
+void captureAndSendBoardImage(int board, const CaptureJob& job);
 void updateDisplay(); // LCD <<< Prototype restored
 void forceUpdateDisplay(); // LCD <<< Prototype restored
 #if USE_LCD
 void writeToLCD(); // LCD <<< Prototype restored
 #endif
 void formatTime(unsigned long time_ms, char* buffer, size_t bufferSize); // <<< Prototype restored
-void sendBleStateUpdate(int playerMoved, unsigned long p1TimeMs, unsigned long p2TimeMs);
-size_t requestAndReceiveImage(); 
-void sendImageOverBle(const uint8_t* buffer, size_t size); 
+void sendBleStateUpdate(int board, int playerMoved, const ClockTransition& clock);
+int formatClockAnchor(char* buffer, size_t bufferSize, int board, const ClockTransition& clock);
+void sendClockHeartbeat(int board, const ClockTransition& clock);
+void answerClockSync(const char* clientTime, unsigned long receivedMs);
+void replayClockState();
+void startReconnectAdvertising();
+void startUndirectedAdvertising();
+void initBle();
+size_t requestAndReceiveImage(const char* snapCommand = "SNAP");
+size_t captureBoardImage(const char* snapCommand = "SNAP");
+void selectReceiveBuffer();
+void handleClientCommand(const char* command);
+void sendToCameras(int firstBoard, int lastBoard, const char* command);
+void sendCamCommand(HardwareSerial* link, const char* command);
+#if USE_CAM_STANDBY
+void standbyIdleCamera(int board);
+#endif
+void setTimeControl(int firstBoard, int lastBoard, const char* spec);
+void runSelfBenchmark(const char* args);
+void setCapturePolicy(int firstBoard, int lastBoard, const char* spec);
+void fetchArchivedFrame(int board, const char* args);
+void sampleTelemetry();
+void logCamLine(const char* line);
+void sendDiagnostics();
+void sendPreviewOverBle(const uint8_t* buffer, size_t size);
+void beginImageTransfer(const uint8_t* buffer, size_t size);
+void pumpImageTransfer();
+void cancelImageTransfer();
+void sendImageToClient(size_t imageSize);
+FrameInfo lastImageInfo(size_t imageSize);
+int formatFrameFields(char* buffer, size_t bufferSize, const FrameInfo& info);
+#if USE_FRAME_STORE
+void storeFrame(const FrameInfo& info);
+int formatStoredPlies(char* buffer, size_t bufferSize, int board);
+void queueFrameRequest(int board, const char* args);
+void startNextFrameRequest();
+void sendFrameError(int board, unsigned long ply, const char* reason);
+#endif
+#if USE_USB_CLIENT
+void pollUsbClient();
+void handleUsbLinkMessage(const char* message);
+void setUsbClientActive(bool active);
+#endif
 // void configCamera(); // <<< REMOVED Camera Config Prototype
 // void takePhoto();    // <<< REMOVED Take Photo Prototype
 
 
 // --- Setup Function (Restored 3-button + LCD) ---
 void setup() {
+#if USE_USB_CLIENT
+  Serial.setTxBufferSize(USB_TX_BUFFER_SIZE); // Before begin()
+  Serial.begin(USB_BAUD);
+#else
   Serial.begin(115200);
+#endif
   delay(1500);
   // Use a very simple print statement
-  Serial.println("\n\nChess Clock Starting..."); 
-
-  // Initialize Serial2 for ESP32-CAM communication
-  SerialCam.begin(115200, SERIAL_8N1, CAM_SERIAL_RX_PIN, CAM_SERIAL_TX_PIN);
-  Serial.println("Serial2 for CAM Initialized (RX:16, TX:17).");
+  debugSerial.println("\n\nChess Clock Starting..."); 
+
+  // Initialize the UARTs for ESP32-CAM communication (Serial2 for the first)
+  for (int cam = 0; cam < CAM_COUNT; cam++) {
+    camLinks[cam]->begin(115200, SERIAL_8N1, camSerialPins[cam][0], camSerialPins[cam][1]);
+    debugSerial.printf("CAM %d serial initialized (RX:%d, TX:%d).\n", cam, camSerialPins[cam][0], camSerialPins[cam][1]);
+#if USE_CAM_STANDBY
+    if (camWakePins[cam] >= 0) {
+      pinMode(camWakePins[cam], OUTPUT);
+      digitalWrite(camWakePins[cam], LOW);
+    }
+    camAsleep[cam] = true; // Unknown after a hub reset; the CAM ignores the wake-up newlines
+    char idleCommand[24];
+    snprintf(idleCommand, sizeof(idleCommand), "IDLE:%lu", CAM_STANDBY_IDLE_MS);
+    sendCamCommand(camLinks[cam], idleCommand);
+#endif
+#if USE_PREVIEW_FRAMES
+    sendCamCommand(camLinks[cam], "PREVIEW:ON");
+#endif
+#if USE_DELTA_FRAMES
+    sendCamCommand(camLinks[cam], "DELTA:ON");
+#endif
+  }
+#if USE_PREVIEW_FRAMES
+  debugSerial.println("Requested preview thumbnails from CAM.");
+#endif
+#if USE_DELTA_FRAMES
+  debugSerial.println("Requested delta frames from CAM.");
+#endif
 
 #if USE_LCD
   // --- Initialize I2C and LCD ---
   Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN);
   lcd.init();
   lcd.backlight();
-  Serial.println("LCD Initialized.");
+  debugSerial.println("LCD Initialized.");
 #endif
 
-  // Setup Buttons (Restored for 3 buttons)
-  for (int i = 0; i < BUTTON_COUNT; i++) {
-    pinMode(buttonPins[i], INPUT_PULLUP); // Use internal pull-ups
-    buttonStates[i] = HIGH;               // Initial state is not pressed
-    lastButtonStates[i] = HIGH;
-    lastDebounceTimes[i] = 0;
+  // Setup Buttons (Restored for 3 buttons), for every board
+  for (int board = 0; board < BOARD_COUNT; board++) {
+    for (int i = 0; i < BUTTON_COUNT; i++) {
+      pinMode(boardButtonPins[board][i], INPUT_PULLUP); // Use internal pull-ups
+      buttonStates[board][i] = HIGH;                    // Initial state is not pressed
+      lastButtonStates[board][i] = HIGH;
+      lastDebounceTimes[board][i] = 0;
+    }
+    debugSerial.printf("Board %d buttons: Reset(%d), P1(%d), P2(%d) enabled.\n", board, boardButtonPins[board][0],
+                  boardButtonPins[board][1], boardButtonPins[board][2]);
+#if USE_BUTTON_INTERRUPTS
+    playerButtons[board][0] = {(uint8_t)board, 1, EVENT_P1_PRESS};
+    playerButtons[board][1] = {(uint8_t)board, 2, EVENT_P2_PRESS};
+    for (int i = 0; i < 2; i++) {
+      attachInterruptArg(digitalPinToInterrupt(boardButtonPins[board][i + 1]), onPlayerPress, &playerButtons[board][i],
+                         FALLING);
+    }
+#endif
   }
-  Serial.println("Button Init: Reset(4), P1(18), P2(19) enabled.");
+#if USE_BUTTON_INTERRUPTS
+  debugSerial.println("Player buttons on interrupts.");
+#endif
 
 
   // --- Initialize Camera --- REMOVED
   /* configCamera();
-  Serial.println("Attempting to initialize camera...");
+  debugSerial.println("Attempting to initialize camera...");
   esp_err_t err = esp_camera_init(&camera_config);
   if (err != ESP_OK) {
-    Serial.printf("Camera init failed with error 0x%x\n", err);
-    Serial.println("Restarting...");
+    debugSerial.printf("Camera init failed with error 0x%x\n", err);
+    debugSerial.println("Restarting...");
     delay(1000);
     ESP.restart(); // Restart if camera fails
   }
-  Serial.println("Camera init SUCCESS"); */
+  debugSerial.println("Camera init SUCCESS"); */
   // --- End Camera Init --- REMOVED
 
-  // Allocate image buffer
-  imageBuffer = (uint8_t*) malloc(imageBufferSize);
+  // Allocate image buffers
+  for (int i = 0; i < IMAGE_BUFFER_COUNT; i++) {
+#if USE_STATIC_BUFFERS
+    imageBuffers[i] = imageBufferStorage[i];
+#else
+    imageBuffers[i] = (uint8_t*) malloc(imageBufferSize);
+#endif
+  }
+  imageBuffer = imageBuffers[0];
   if (imageBuffer == nullptr) {
-    Serial.println("!!!!!!!!!!!!!! Failed to allocate image buffer! Reduce size? !!!!!!!!!!!!!!");
+    debugSerial.println("!!!!!!!!!!!!!! Failed to allocate image buffer! Reduce size? !!!!!!!!!!!!!!");
     // Handle error - maybe disable camera functionality?
   } else {
-    Serial.printf("Image buffer allocated (%zu bytes).\n", imageBufferSize);
+    debugSerial.printf("Image buffer allocated (%d x %zu bytes).\n", IMAGE_BUFFER_COUNT, imageBufferSize);
+  }
+#if USE_STATIC_BUFFERS
+  previewBuffer = previewBufferStorage;
+#else
+  previewBuffer = (uint8_t*) malloc(previewBufferSize);
+#endif
+  if (previewBuffer == nullptr) {
+    debugSerial.println("Failed to allocate preview buffer, previews disabled.");
+  }
+  camReceiver.attach(imageBuffer, imageBuffer ? imageBufferSize : 0, previewBuffer, previewBuffer ? previewBufferSize : 0);
+  camReceiver.onLine = logCamLine;
+#if USE_FRAME_STORE
+#if USE_STATIC_BUFFERS
+  frameStore.attach(frameStoreStorage, FRAME_STORE_SIZE);
+#else
+  frameStore.attach((uint8_t*) malloc(FRAME_STORE_SIZE), FRAME_STORE_SIZE);
+#endif
+  if (frameStore.capacity() == 0) {
+    debugSerial.println("Failed to allocate frame store, GET disabled.");
+  }
+#endif
+  for (int board = 0; board < BOARD_COUNT; board++) {
+    boards[board].clock.configure(DEFAULT_TIME_CONTROL);
+    boards[board].captures.configure(DEFAULT_CAPTURE_POLICY, 1);
+    boards[board].camera = boardCameras[board];
+    if (boards[board].camera >= CAM_COUNT) {
+      debugSerial.printf("Board %d has no camera link %u, using CAM 0.\n", board, boards[board].camera);
+      boards[board].camera = 0;
+    }
+    for (int other = 0; other < board; other++) {
+      if (boards[other].camera == boards[board].camera) {
+        camShared[boards[board].camera] = true;
+      }
+    }
   }
 
-  // --- Initialize BLE (Keep State Characteristic Only) ---
-  Serial.println("Starting BLE setup...");
-  BLEDevice::init("ChessClock"); 
-  Serial.println("BLEDevice::init() done.");
-  pServer = BLEDevice::createServer();
-  Serial.println("BLEDevice::createServer() done.");
-  pServer->setCallbacks(new MyServerCallbacks());
-  Serial.println("pServer->setCallbacks() done.");
-  BLEService *pService = pServer->createService(SERVICE_UUID);
-  Serial.println("pServer->createService() done.");
-
-  // Create State Characteristic
-  pStateCharacteristic = pService->createCharacteristic(
-                      STATE_CHARACTERISTIC_UUID,
-                      BLECharacteristic::PROPERTY_READ   |
-                      BLECharacteristic::PROPERTY_NOTIFY |
-                      BLECharacteristic::PROPERTY_WRITE // Keep write for potential commands?
-                    );
-  pStateCharacteristic->addDescriptor(new BLE2902());
-  Serial.println("pStateCharacteristic created.");
-
-  pStateCharacteristic->setValue("BLE Ready");
-  Serial.println("pStateCharacteristic->setValue() done.");
-  pService->start();
-  Serial.println("pService->start() done.");
-
-  // Start advertising
-  BLEAdvertising *pAdvertising = BLEDevice::getAdvertising();
-  pAdvertising->addServiceUUID(SERVICE_UUID);
-  pAdvertising->setScanResponse(true);
-  pAdvertising->setMinPreferred(0x06);
-  pAdvertising->setMinPreferred(0x12);
-  BLEDevice::startAdvertising();
-  Serial.println("BLE Advertising supposedly started. Check nRF Connect.");
-  // --- End BLE Init ---
+  initBle();
 
   // Initialize Game State
-  lastUpdateTime = millis();
-  resetGame(); // Start in reset state initially
+  for (int board = 0; board < BOARD_COUNT; board++) {
+    resetGame(board); // Start in reset state initially
+  }
 #if USE_LCD
   forceUpdateDisplay(); // Update LCD on startup if enabled
 #endif
 
-  Serial.println("Setup Complete. Entering loop...");
+  sampleTelemetry();
+  debugSerial.printf("Heap after setup: %lu free, %lu largest block\n",
+                (unsigned long)telemetry.freeHeap, (unsigned long)telemetry.largestFreeBlock);
+  debugSerial.println("Setup Complete. Entering loop...");
 }
 
 // --- Main Loop (Restored) ---
 void loop() {
    handleButtons(); // Call the original button handler
 
-   // Game Timer Logic
-   unsigned long currentTime = millis();
-   unsigned long elapsedTime = 0;
-
-   if (currentState == RUNNING_P1 || currentState == RUNNING_P2) {
-       // Handle potential millis() overflow
-       if (currentTime < lastUpdateTime) {
-           elapsedTime = (0xFFFFFFFF - lastUpdateTime) + currentTime + 1;
-       } else {
-           elapsedTime = currentTime - lastUpdateTime;
-       }
+#if USE_USB_CLIENT
+   pollUsbClient(); // Commands from a wired client join the BLE ones below
+#endif
+   if (clientCommandPending) {
+       handleClientCommand(pendingClientCommand);
+       clientCommandPending = false;
+   }
+
+   pumpImageTransfer(); // Continue the full-resolution image, if one is in flight
+#if USE_FRAME_STORE
+   startNextFrameRequest(); // Once the link is free
+#endif
+
+   if (millis() - lastTelemetryTime >= TELEMETRY_INTERVAL_MS) {
+       sampleTelemetry();
+       debugSerial.printf("Telemetry: heap %lu free (min %lu), largest block %lu, loop stack HWM %lu\n",
+                     (unsigned long)telemetry.freeHeap, (unsigned long)telemetry.minFreeHeap,
+                     (unsigned long)telemetry.largestFreeBlock, (unsigned long)telemetry.stackHighWater[0]);
+   }
+
+#if USE_BUTTON_INTERRUPTS
+   processQueuedTransitions(); // Presses registered by the interrupt (possibly during a capture)
+#endif
 
-       if (currentState == RUNNING_P1) {
-           if (player1Time <= elapsedTime) {
-               player1Time = 0;
-               currentState = GAME_OVER;
-               Serial.println("P1 Timeout");
-               sendBleStateUpdate(1, player1Time, player2Time); // Send BLE on timeout
-           } else {
-               player1Time -= elapsedTime;
-           }
-       } else if (currentState == RUNNING_P2) {
-           if (player2Time <= elapsedTime) {
-               player2Time = 0;
-               currentState = GAME_OVER;
-               Serial.println("P2 Timeout");
-               sendBleStateUpdate(2, player1Time, player2Time); // Send BLE on timeout
-           } else {
-               player2Time -= elapsedTime;
-           }
+   // Game Timer Logic
+   for (int board = 0; board < BOARD_COUNT; board++) {
+       portENTER_CRITICAL(&clockMux);
+       ClockTransition tickResult = boards[board].clock.tick(millis());
+       portEXIT_CRITICAL(&clockMux);
+       if (tickResult.action != ACTION_NONE) {
+           handleClockTransition(board, tickResult); // Flag fell
+       } else if (tickResult.running != 0 && millis() - boards[board].lastAnchorMs >= CLOCK_HEARTBEAT_INTERVAL_MS) {
+           sendClockHeartbeat(board, tickResult);
        }
    }
-   lastUpdateTime = currentTime;
+
+   runNextCapture(); // After the presses above, so stale jobs are already dropped
 
 #if USE_LCD
    updateDisplay(); // Update LCD in loop if enabled
@@ -270,19 +938,38 @@ void loop() {
 
   // Handle BLE Disconnection/Reconnection
   if (!deviceConnected && oldDeviceConnected) {
-      delay(500); 
+      linkDroppedTime = millis();
+#if USE_FRAME_STORE
+      if (!usbClientActive) {
+          pullImages = false; // A reconnecting client asks again; another app may expect pushed images
+          frameRequestCount = 0;
+      }
+#endif
       // Ensure pServer is valid before trying to use it
       if (pServer != nullptr) {
-          pServer->startAdvertising(); 
-          Serial.println("Restarting BLE advertising");
+          startReconnectAdvertising(); // Right away; every ms here is a ms the client waits
       } else {
-          Serial.println("Warning: pServer is null, cannot restart advertising.");
+          debugSerial.println("Warning: pServer is null, cannot restart advertising.");
       }
       oldDeviceConnected = deviceConnected;
   }
+  if (directedAdvertising && (deviceConnected || millis() - linkDroppedTime >= DIRECTED_ADV_DURATION_MS)) {
+      directedAdvertising = false;
+      if (!deviceConnected) {
+          startUndirectedAdvertising();
+          debugSerial.println("Bonded client didn't reconnect, advertising to everyone.");
+      }
+  }
   if (deviceConnected && !oldDeviceConnected) {
       oldDeviceConnected = deviceConnected;
-      Serial.println("Device connected callback received.");
+      debugSerial.println("Device connected callback received.");
+      if (linkDroppedTime != 0) {
+          debugSerial.printf("Reconnected %lu ms after the drop.\n", (unsigned long)(linkConnectedTime - linkDroppedTime));
+      }
+  }
+  if (stateReplayPending && clientLink.connected()) {
+      stateReplayPending = false;
+      replayClockState();
   }
      
   delay(1); 
@@ -294,102 +981,178 @@ void loop() {
 void handleButtons() {
     unsigned long currentTime = millis();
 
-    for (int i = 0; i < BUTTON_COUNT; i++) {
-        int reading = digitalRead(buttonPins[i]);
+    for (int board = 0; board < BOARD_COUNT; board++) {
+        for (int i = 0; i < BUTTON_COUNT; i++) {
+#if USE_BUTTON_INTERRUPTS
+            if (i != 0) {
+                continue; // Player buttons are handled by onPlayerPress()
+            }
+#endif
+            int reading = digitalRead(boardButtonPins[board][i]);
 
-        if (reading != lastButtonStates[i]) {
-            lastDebounceTimes[i] = currentTime; // Reset the debouncing timer
-        }
+            if (reading != lastButtonStates[board][i]) {
+                lastDebounceTimes[board][i] = currentTime; // Reset the debouncing timer
+            }
 
-        if ((currentTime - lastDebounceTimes[i]) > DEBOUNCE_DELAY) {
-            // If the button state has changed, after the debounce period
-            if (reading != buttonStates[i]) {
-                buttonStates[i] = reading;
+            if ((currentTime - lastDebounceTimes[board][i]) > DEBOUNCE_DELAY) {
+                // If the button state has changed, after the debounce period
+                if (reading != buttonStates[board][i]) {
+                    buttonStates[board][i] = reading;
 
-                // Only trigger on button PRESS (transition from HIGH to LOW)
-                if (buttonStates[i] == LOW) {
-                    Serial.printf("Button %d Pressed (Pin %d)\n", i, buttonPins[i]);
+                    // Only trigger on button PRESS (transition from HIGH to LOW)
+                    if (buttonStates[board][i] == LOW) {
+                        debugSerial.printf("Board %d button %d Pressed (Pin %d)\n", board, i, boardButtonPins[board][i]);
 
-                    if (i == 0) { // Reset Button (Pin 4)
-                        resetGame();
-                    } else if (i == 1) { // Player 1 Button (Pin 18)
-                        if (currentState == IDLE) {
-                            startGame(1); // Player 1 starts
-                        } else if (currentState == RUNNING_P1) {
-                            switchPlayer(2); // Switch to Player 2
+                        if (i == 0) { // Reset Button
+                            resetGame(board);
+                        } else {
+                            // Player buttons; the transition table decides whether the press does anything
+                            dispatchClockEvent(board, (i == 1) ? EVENT_P1_PRESS : EVENT_P2_PRESS);
                         }
-                        // Ignore if P2's clock is running or game over
-                    } else if (i == 2) { // Player 2 Button (Pin 19)
-                         if (currentState == IDLE) {
-                            startGame(2); // Player 2 starts
-                        } else if (currentState == RUNNING_P2) {
-                            switchPlayer(1); // Switch to Player 1
-                        }
-                        // Ignore if P1's clock is running or game over
-                    }
 #if USE_LCD
-                    forceUpdateDisplay(); // Update LCD on button press if enabled
+                        forceUpdateDisplay(); // Update LCD on button press if enabled
 #endif
+                    }
                 }
             }
+            lastButtonStates[board][i] = reading; // Update the last reading
+        }
+    }
+}
+
+void resetGame(int board) {
+    dispatchClockEvent(board, EVENT_RESET);
+}
+
+// --- Run a button event through the board's time-control engine, then act on the transition ---
+void dispatchClockEvent(int board, ClockEvent event) {
+    portENTER_CRITICAL(&clockMux);
+    ClockTransition transition = boards[board].clock.handle(event, millis());
+    portEXIT_CRITICAL(&clockMux);
+    handleClockTransition(board, transition);
+}
+
+#if USE_BUTTON_INTERRUPTS
+// --- Player button interrupt: debounce, step the board's engine at the press time, queue the result ---
+// Touches only the pressed board, so a press costs the same however many boards the hub runs.
+void IRAM_ATTR onPlayerPress(void* arg) {
+    const PlayerButton* button = (const PlayerButton*)arg;
+    unsigned long now = millis();
+    if (now - lastPressTimes[button->board][button->button] < DEBOUNCE_DELAY ||
+        digitalRead(boardButtonPins[button->board][button->button]) != LOW) {
+        return; // Contact bounce
+    }
+    lastPressTimes[button->board][button->button] = now;
+    portENTER_CRITICAL_ISR(&clockMux);
+    pressBoard(boards, button->board, button->event, now, clockQueue);
+    portEXIT_CRITICAL_ISR(&clockMux);
+}
+
+// --- Act on the transitions queued by the interrupt, oldest first ---
+void processQueuedTransitions() {
+    while (true) {
+        BoardTransition transition;
+        portENTER_CRITICAL(&clockMux);
+        bool found = clockQueue.pop(&transition);
+        portEXIT_CRITICAL(&clockMux);
+        if (!found) {
+            break;
         }
-        lastButtonStates[i] = reading; // Update the last reading
-    }
-}
-
-void resetGame() {
-    currentState = IDLE;
-    player1Time = INITIAL_TIME_MS;
-    player2Time = INITIAL_TIME_MS;
-    Serial.println("Game Reset to IDLE");
-    // forceUpdateDisplay(); // Already called in handleButtons
-    sendBleStateUpdate(0, player1Time, player2Time); // Send BLE update (player 0 = reset)
-}
-
-void startGame(int playerWhoPressedButton) {
-    if (currentState == IDLE) {
-        // If P1 pressed, start P2's clock, and vice-versa
-        currentState = (playerWhoPressedButton == 1) ? RUNNING_P2 : RUNNING_P1;
-        lastUpdateTime = millis(); // Reset timer start point
-        int runningPlayer = (playerWhoPressedButton == 1) ? 2 : 1;
-        Serial.printf("Game Started - Running P%d\n", runningPlayer);
-        // Send state update according to Spec for startGame:
-        // "player_moved indicates the player whose clock *isn't* running."
-        int playerNotRunning = (playerWhoPressedButton == 1) ? 1 : 2;
-        sendBleStateUpdate(playerNotRunning, player1Time, player2Time);
-
-        // Request image after starting game
-        size_t receivedBytes = requestAndReceiveImage(); // <<< Re-enable CAM comms
-        if (receivedBytes > 0) {                       // <<< Re-enable CAM comms
-           Serial.printf("Successfully received %zu image bytes after game start.\n", receivedBytes);
-           sendImageOverBle(imageBuffer, receivedBytes); // <<< Re-enable CAM comms
-        } else {                                       // <<< Re-enable CAM comms
-           Serial.println("Failed to receive image after game start.");
-        }                                              // <<< Re-enable CAM comms
-    }
-}
-
-void switchPlayer(int nextPlayerWhoseClockStarts) {
-    if ((currentState == RUNNING_P1 && nextPlayerWhoseClockStarts == 2) ||
-        (currentState == RUNNING_P2 && nextPlayerWhoseClockStarts == 1)) {
-        
-        int playerWhoseTurnEnded = (nextPlayerWhoseClockStarts == 1) ? 2 : 1; // Calculate who just finished
-        
-        currentState = (nextPlayerWhoseClockStarts == 1) ? RUNNING_P1 : RUNNING_P2;
-        lastUpdateTime = millis(); // Reset timer start point for the new player
-        Serial.printf("Switched Player - Running P%d (Player %d finished)\n", nextPlayerWhoseClockStarts, playerWhoseTurnEnded);
-        
-        // Send BLE update indicating whose turn ENDED, per spec
-        sendBleStateUpdate(playerWhoseTurnEnded, player1Time, player2Time); 
-
-        // Request image after switching player
-        size_t receivedBytes = requestAndReceiveImage(); // <<< Re-enable CAM comms
-        if (receivedBytes > 0) {                       // <<< Re-enable CAM comms
-           Serial.printf("Successfully received %zu image bytes after player switch.\n", receivedBytes);
-           sendImageOverBle(imageBuffer, receivedBytes); // <<< Re-enable CAM comms
-        } else {                                       // <<< Re-enable CAM comms
-           Serial.println("Failed to receive image after player switch.");
-        }                                              // <<< Re-enable CAM comms
+        handleClockTransition(transition.board, transition.clock);
+#if USE_LCD
+        forceUpdateDisplay();
+#endif
+    }
+}
+#endif
+
+// --- Side effects of a clock transition: logging, BLE state update, board capture ---
+void handleClockTransition(int board, const ClockTransition& transition) {
+    CaptureScheduler& captures = boards[board].captures;
+    switch (transition.action) {
+        case ACTION_RESET:
+            debugSerial.printf("Board %d: Game Reset to IDLE\n", board);
+#if USE_DELTA_FRAMES
+            sendCamCommand(camLinks[boards[board].camera], "KEYFRAME"); // A new game starts a new delta chain
+#endif
+            sendBleStateUpdate(board, 0, transition); // Send BLE update (player 0 = reset)
+            captures.reset();
+#if USE_CAM_STANDBY
+            standbyIdleCamera(board);
+#endif
+            break;
+        case ACTION_START:
+#if USE_CAM_STANDBY
+            sendCamCommand(camLinks[boards[board].camera], "WAKE"); // Sensor powers up while the update goes out
+#endif
+            // "player_moved indicates the player whose clock *isn't* running."
+            debugSerial.printf("Board %d: Game Started - Running P%d\n", board, (transition.player == 1) ? 2 : 1);
+            sendBleStateUpdate(board, transition.player, transition);
+            captures.reset();
+            captures.request(transition.atMs); // Starting position
+            boards[board].archiveGame++;
+#if USE_FRAME_STORE
+            frameStore.clearBoard(board); // Plies restart
+#endif
+
+            break;
+        case ACTION_SWITCH:
+            // Send BLE update indicating whose turn ENDED, per spec
+            debugSerial.printf("Board %d: Switched Player - Running P%d (Player %d finished)\n", board,
+                          (transition.player == 1) ? 2 : 1, transition.player);
+            sendBleStateUpdate(board, transition.player, transition);
+            captures.request(transition.atMs);
+            break;
+        case ACTION_FLAG:
+            debugSerial.printf("Board %d: P%d Timeout\n", board, transition.player);
+            sendBleStateUpdate(board, transition.player, transition); // Send BLE on timeout
+#if USE_CAM_STANDBY
+            standbyIdleCamera(board);
+#endif
+            break;
+        case ACTION_NONE:
+            break; // Ignored press (other player's clock running, or game over)
+    }
+}
+
+// --- Run the capture job that has waited longest on any board, if any (blocks for the capture) ---
+void runNextCapture() {
+    int board = nextCaptureBoard(boards, BOARD_COUNT, millis());
+    CaptureJob job;
+    if (board < 0 || !boards[board].captures.next(&job, millis())) {
+        return;
+    }
+    captureAndSendBoardImage(board, job);
+}
+
+void captureAndSendBoardImage(int board, const CaptureJob& job) {
+    CaptureScheduler& captures = boards[board].captures;
+    lastImageBoard = board;
+    lastImagePly = job.ply;
+    lastImageSkipped = captures.skippedBefore(job.ply);
+    lastImageLagMs = millis() - job.requestedMs;
+    debugSerial.printf("Capturing board %d ply %u (%lu ms after the press, %u moves without image before it, %d jobs queued)\n",
+                  board, job.ply, lastImageLagMs, lastImageSkipped, captures.depth());
+    activeCam = camLinks[boards[board].camera];
+    char snapCommand[24] = "SNAP"; // A shared camera's frames aren't archived
+    if (!camShared[boards[board].camera]) {
+        snprintf(snapCommand, sizeof(snapCommand), "SNAP:%u,%u", boards[board].archiveGame, job.ply);
+    }
+    size_t receivedBytes = captureBoardImage(snapCommand);
+    activeCam = camLinks[0];
+    if (receivedBytes > 0) {
+       debugSerial.printf("Successfully received %zu image bytes for board %d ply %u.\n", receivedBytes, board, job.ply);
+#if USE_FRAME_STORE
+       storeFrame(lastImageInfo(receivedBytes));
+       if (!pullImages) {
+           sendImageToClient(receivedBytes);
+       }
+#else
+       sendImageToClient(receivedBytes);
+#endif
+       captures.markDelivered(job.ply);
+    } else {
+       debugSerial.printf("Failed to receive image for board %d ply %u.\n", board, job.ply);
     }
 }
 
@@ -403,6 +1166,9 @@ void updateDisplay() {
     // static unsigned long lastP2Time = 0; // Moved to file scope
 
     unsigned long currentTime = millis();
+    GameState currentState = boards[LCD_BOARD].clock.state();
+    unsigned long player1Time = boards[LCD_BOARD].clock.remainingMs(1);
+    unsigned long player2Time = boards[LCD_BOARD].clock.remainingMs(2);
 
     // Only update roughly every 100ms unless state changes or time drastically changes
     bool stateChanged = (currentState != lastDisplayedState);
@@ -470,38 +1236,277 @@ void formatTime(unsigned long time_ms, char* buffer, size_t bufferSize) {
 
 
 // --- sendBleStateUpdate (Adjusted Characteristic) ---
-void sendBleStateUpdate(int playerMoved, unsigned long p1TimeMs, unsigned long p2TimeMs) {
-    if (deviceConnected && pStateCharacteristic != nullptr) {
+void sendBleStateUpdate(int board, int playerMoved, const ClockTransition& clock) {
+    unsigned long p1TimeMs = clock.p1Ms;
+    unsigned long p2TimeMs = clock.p2Ms;
+    if (clientLink.connected()) {
         // Convert times to seconds for the spec
         unsigned long p1TimeSec = p1TimeMs / 1000;
         unsigned long p2TimeSec = p2TimeMs / 1000;
 
-        // Format according to BLE_SPECs.md
-        char bleBuffer[100]; // Increased buffer size for JSON
-        snprintf(bleBuffer, sizeof(bleBuffer), 
-                 "{\"player_moved\":%d,\"p1_time_sec\":%lu,\"p2_time_sec\":%lu}",
+        // Format according to BLE_SPECs.md, followed by the clock anchor
+        char bleBuffer[216];
+        int len = snprintf(bleBuffer, sizeof(bleBuffer),
+                 "{\"player_moved\":%d,\"p1_time_sec\":%lu,\"p2_time_sec\":%lu,",
                  playerMoved, p1TimeSec, p2TimeSec);
+#if USE_FRAME_STORE
+        len += formatStoredPlies(bleBuffer + len, sizeof(bleBuffer) - len, board);
+#endif
+        formatClockAnchor(bleBuffer + len, sizeof(bleBuffer) - len, board, clock);
 
-        Serial.printf("Sending BLE Update (JSON): %s\n", bleBuffer);
-        pStateCharacteristic->setValue(bleBuffer);
-        pStateCharacteristic->notify();
+        debugSerial.printf("Sending BLE Update (JSON): %s\n", bleBuffer);
+        waitForCredit(clientLink, IMAGE_PACING); // Image chunks may still fill the stack's buffers
+        clientLink.notify(bleBuffer);
+        boards[board].lastAnchorMs = millis();
 
     } else {
         if (!deviceConnected) {
-             Serial.println("Cannot send BLE update, no device connected.");
+             debugSerial.println("Cannot send BLE update, no device connected.");
         } else {
-             Serial.println("Cannot send BLE update, characteristic invalid.");
+             debugSerial.println("Cannot send BLE update, characteristic invalid.");
         }
     }
     // Print message even if BLE is off, for debugging button presses - Keep this for logging
-    Serial.printf("Log: State Update Intent: playerMoved=%d, p1=%lu ms, p2=%lu ms\n", playerMoved, p1TimeMs, p2TimeMs);
+    debugSerial.printf("Log: State Update Intent: board=%d, playerMoved=%d, p1=%lu ms, p2=%lu ms\n", board, playerMoved,
+                  p1TimeMs, p2TimeMs);
 }
 
-// --- takePhoto Function REMOVED ---
-/* void takePhoto() {
-    ...
-} */
-
+// --- Clock anchor: ["board":n,]"running":<0|1|2>,"p1_ms":n,"p2_ms":n,"t":<hub ms>,"delay_ms":n} ---
+// The running player's clock reads p<running>_ms at hub time t and counts down once delay_ms has
+// passed, so a client that knows its offset to the hub's millis() (SYNC) can display it without updates.
+// With several boards every message carrying an anchor says which board it is for.
+int formatClockAnchor(char* buffer, size_t bufferSize, int board, const ClockTransition& clock) {
+    int len = 0;
+    if (BOARD_COUNT > 1) {
+        len = snprintf(buffer, bufferSize, "\"board\":%d,", board);
+    }
+    return len + snprintf(buffer + len, bufferSize - len,
+                          "\"running\":%d,\"p1_ms\":%lu,\"p2_ms\":%lu,\"t\":%lu,\"delay_ms\":%lu}", clock.running,
+                          (unsigned long)clock.p1Ms, (unsigned long)clock.p2Ms, (unsigned long)clock.atMs,
+                          (unsigned long)clock.delayMs);
+}
+
+// --- Re-send the anchor of a running clock: {"type":"clock",<anchor>} ---
+void sendClockHeartbeat(int board, const ClockTransition& clock) {
+    boards[board].lastAnchorMs = millis(); // Also when not sent, so a busy link isn't polled every pass
+    if (!clientLink.connected() || imageTransfer.active) {
+        return; // The image ends soon; the next heartbeat is only drift correction anyway
+    }
+    char bleBuffer[144];
+    int len = snprintf(bleBuffer, sizeof(bleBuffer), "{\"type\":\"clock\",");
+    formatClockAnchor(bleBuffer + len, sizeof(bleBuffer) - len, board, clock);
+    clientLink.notify(bleBuffer);
+}
+
+// --- Current state of every board for a client that just (re)subscribed ---
+// {"type":"state","state":"RUNNING_P1",<anchor>} per board. Not a player_moved update, so clients
+// don't log a move for it.
+void replayClockState() {
+    for (int board = 0; board < BOARD_COUNT; board++) {
+        portENTER_CRITICAL(&clockMux);
+        ClockTransition clock = boards[board].clock.tick(millis());
+        GameState state = boards[board].clock.state();
+        portEXIT_CRITICAL(&clockMux);
+        if (clock.action != ACTION_NONE) {
+            handleClockTransition(board, clock); // Flag fell just now; that update carries the state
+            continue;
+        }
+        char bleBuffer[200];
+        int len = snprintf(bleBuffer, sizeof(bleBuffer), "{\"type\":\"state\",\"state\":\"%s\",", stateNames[state]);
+#if USE_FRAME_STORE
+        len += formatStoredPlies(bleBuffer + len, sizeof(bleBuffer) - len, board);
+#endif
+        formatClockAnchor(bleBuffer + len, sizeof(bleBuffer) - len, board, clock);
+        waitForCredit(clientLink, IMAGE_PACING);
+        clientLink.notify(bleBuffer);
+        boards[board].lastAnchorMs = millis();
+        debugSerial.printf("Replayed state %lu ms after connect: %s\n", (unsigned long)(millis() - linkConnectedTime), bleBuffer);
+    }
+}
+
+// --- Initialize BLE (Keep State Characteristic Only) ---
+void initBle() {
+  debugSerial.printf("Starting BLE setup (%s)...\n", BLE_STACK_NAME);
+#if USE_NIMBLE
+  NimBLEDevice::init("ChessClock");
+#if USE_BLE_BONDING
+  NimBLEDevice::setSecurityAuth(true, false, true); // Bond, no MITM (Just Works), LE secure connections
+  NimBLEDevice::setSecurityIOCap(BLE_HS_IO_NO_INPUT_OUTPUT);
+  NimBLEDevice::setSecurityInitKey(BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID); // ID key: the client's identity address
+  NimBLEDevice::setSecurityRespKey(BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID);
+  debugSerial.println("BLE bonding enabled.");
+#endif
+  pServer = NimBLEDevice::createServer();
+#if USE_STATIC_BUFFERS
+  pServer->setCallbacks(&serverCallbacks);
+#else
+  pServer->setCallbacks(new MyServerCallbacks());
+#endif
+  pServer->advertiseOnDisconnect(false); // loop() restarts it, directed first
+  NimBLEService* pService = pServer->createService(SERVICE_UUID);
+  pStateCharacteristic = pService->createCharacteristic(
+                      STATE_CHARACTERISTIC_UUID,
+                      NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::NOTIFY | NIMBLE_PROPERTY::WRITE);
+#if USE_STATIC_BUFFERS
+  pStateCharacteristic->setCallbacks(&stateCharacteristicCallbacks);
+#else
+  pStateCharacteristic->setCallbacks(new StateCharacteristicCallbacks());
+#endif
+  pStateCharacteristic->setValue("BLE Ready");
+  pService->start();
+
+  NimBLEAdvertising* pAdvertising = NimBLEDevice::getAdvertising();
+  pAdvertising->addServiceUUID(SERVICE_UUID);
+  pAdvertising->setScanResponse(true);
+  pAdvertising->setMinPreferred(0x06);
+  pAdvertising->setMaxPreferred(0x12);
+  pAdvertising->start();
+  debugSerial.println("BLE advertising started.");
+#else
+  BLEDevice::init("ChessClock"); 
+  debugSerial.println("BLEDevice::init() done.");
+#if USE_BLE_BONDING
+#if USE_STATIC_BUFFERS
+  BLESecurity* pSecurity = &bleSecurity;
+  BLEDevice::setSecurityCallbacks(&bondingCallbacks);
+#else
+  BLESecurity* pSecurity = new BLESecurity();
+  BLEDevice::setSecurityCallbacks(new BondingCallbacks());
+#endif
+  BLEDevice::setEncryptionLevel(ESP_BLE_SEC_ENCRYPT);
+  pSecurity->setAuthenticationMode(ESP_LE_AUTH_REQ_SC_BOND);
+  pSecurity->setCapability(ESP_IO_CAP_NONE);
+  pSecurity->setInitEncryptionKey(ESP_BLE_ENC_KEY_MASK | ESP_BLE_ID_KEY_MASK); // ID key: the client's identity address
+  pSecurity->setRespEncryptionKey(ESP_BLE_ENC_KEY_MASK | ESP_BLE_ID_KEY_MASK);
+  debugSerial.println("BLE bonding enabled.");
+#endif
+  pServer = BLEDevice::createServer();
+  debugSerial.println("BLEDevice::createServer() done.");
+#if USE_STATIC_BUFFERS
+  pServer->setCallbacks(&serverCallbacks);
+#else
+  pServer->setCallbacks(new MyServerCallbacks());
+#endif
+  debugSerial.println("pServer->setCallbacks() done.");
+  BLEService *pService = pServer->createService(SERVICE_UUID);
+  debugSerial.println("pServer->createService() done.");
+
+  // Create State Characteristic
+  pStateCharacteristic = pService->createCharacteristic(
+                      STATE_CHARACTERISTIC_UUID,
+                      BLECharacteristic::PROPERTY_READ   |
+                      BLECharacteristic::PROPERTY_NOTIFY |
+                      BLECharacteristic::PROPERTY_WRITE // Keep write for potential commands?
+                    );
+#if USE_STATIC_BUFFERS
+  pStateCccd = &stateCccd;
+  pStateCccd->setCallbacks(&stateCccdCallbacks);
+  pStateCharacteristic->setCallbacks(&stateCharacteristicCallbacks);
+#else
+  pStateCccd = new BLE2902();
+  pStateCccd->setCallbacks(new StateCccdCallbacks());
+  pStateCharacteristic->setCallbacks(new StateCharacteristicCallbacks());
+#endif
+  pStateCharacteristic->addDescriptor(pStateCccd);
+  debugSerial.println("pStateCharacteristic created.");
+
+  pStateCharacteristic->setValue("BLE Ready");
+  debugSerial.println("pStateCharacteristic->setValue() done.");
+  pService->start();
+  debugSerial.println("pService->start() done.");
+
+  // Start advertising
+  BLEAdvertising *pAdvertising = BLEDevice::getAdvertising();
+  pAdvertising->addServiceUUID(SERVICE_UUID);
+  pAdvertising->setScanResponse(true);
+  pAdvertising->setMinPreferred(0x06);
+  pAdvertising->setMinPreferred(0x12);
+  BLEDevice::startAdvertising();
+  debugSerial.println("BLE Advertising supposedly started. Check nRF Connect.");
+#endif
+}
+
+// --- After a drop: directed advertising to the bonded client first, then to everyone ---
+// Clients that only use a private address may not answer the directed burst; they find the hub once
+// normal advertising resumes (loop() switches after DIRECTED_ADV_DURATION_MS).
+void startReconnectAdvertising() {
+#if USE_BLE_BONDING && USE_NIMBLE
+    if (bondedPeerKnown) {
+        // NimBLEAdvertising runs directed advertising at low duty cycle; it still ends after the same time
+        NimBLEAdvertising* pAdvertising = NimBLEDevice::getAdvertising();
+        NimBLEAddress peer(bondedPeerAddr);
+        pAdvertising->setAdvertisementType(BLE_GAP_CONN_MODE_DIR);
+        if (pAdvertising->start(DIRECTED_ADV_DURATION_MS, nullptr, &peer)) {
+            directedAdvertising = true;
+            debugSerial.println("Directed advertising to the bonded client");
+            return;
+        }
+        pAdvertising->setAdvertisementType(BLE_GAP_CONN_MODE_UND);
+        debugSerial.println("Directed advertising failed to start.");
+    }
+#elif USE_BLE_BONDING
+    if (bondedPeerKnown) {
+        esp_ble_adv_params_t params = {};
+        params.adv_int_min = 0x20; // Unused for high duty cycle; that runs at the controller's fastest rate
+        params.adv_int_max = 0x20;
+        params.adv_type = ADV_TYPE_DIRECT_IND_HIGH;
+        params.own_addr_type = BLE_ADDR_TYPE_PUBLIC;
+        memcpy(params.peer_addr, bondedPeerAddr, sizeof(esp_bd_addr_t));
+        params.peer_addr_type = bondedPeerAddrType;
+        params.channel_map = ADV_CHNL_ALL;
+        params.adv_filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY;
+        if (esp_ble_gap_start_advertising(&params) == ESP_OK) {
+            directedAdvertising = true;
+            debugSerial.println("Directed advertising to the bonded client");
+            return;
+        }
+        debugSerial.println("Directed advertising failed to start.");
+    }
+#endif
+#if USE_NIMBLE
+    NimBLEDevice::startAdvertising();
+#else
+    pServer->startAdvertising();
+#endif
+    debugSerial.println("Restarting BLE advertising");
+}
+
+// --- End directed advertising and advertise to everyone ---
+void startUndirectedAdvertising() {
+#if USE_NIMBLE
+    NimBLEAdvertising* pAdvertising = NimBLEDevice::getAdvertising();
+    pAdvertising->stop();
+    pAdvertising->setAdvertisementType(BLE_GAP_CONN_MODE_UND);
+    pAdvertising->start();
+#else
+    esp_ble_gap_stop_advertising();
+    pServer->startAdvertising();
+#endif
+}
+
+// --- SYNC:<client_ms>: NTP-style clock offset exchange ---
+// Replies {"type":"sync","c":<client_ms>,"rx":<hub ms at receive>,"tx":<hub ms at send>}. With the
+// client's own receive time c2: offset = ((rx - c) + (tx - c2)) / 2, round trip = (c2 - c) - (tx - rx).
+void answerClockSync(const char* clientTime, unsigned long receivedMs) {
+    size_t digits = strspn(clientTime, "0123456789");
+    if (digits == 0 || digits > 20 || clientTime[digits] != '\0') {
+        debugSerial.printf("Invalid SYNC time: %s\n", clientTime);
+        return;
+    }
+    if (!clientLink.connected()) {
+        return;
+    }
+    char bleBuffer[96];
+    snprintf(bleBuffer, sizeof(bleBuffer), "{\"type\":\"sync\",\"c\":%s,\"rx\":%lu,\"tx\":%lu}", clientTime, receivedMs,
+             millis());
+    clientLink.notify(bleBuffer);
+}
+
+// --- takePhoto Function REMOVED ---
+/* void takePhoto() {
+    ...
+} */
+
 // --- configCamera Function REMOVED ---
 /* void configCamera() {
     ...
@@ -513,131 +1518,934 @@ void writeToLCD() {
 }
 #endif
 
+// --- Read one line from the CAM into camLine, without the trailing whitespace ---
+const char* readCamLine() {
+  size_t len = activeCam->readBytesUntil('\n', camLine, CAM_LINE_MAX_LEN - 1);
+  while (len > 0 && isspace((unsigned char)camLine[len - 1])) {
+    len--;
+  }
+  camLine[len] = '\0';
+  return camLine;
+}
+
+void logCamLine(const char* line) {
+  debugSerial.printf("CAM Response: %s\n", line); // Debug
+}
+
 // --- Request image from CAM and receive it over Serial2 ---
-size_t requestAndReceiveImage() {
+size_t requestAndReceiveImage(const char* snapCommand) {
   if (imageBuffer == nullptr) {
-    Serial.println("ERROR: Image buffer not allocated!");
+    debugSerial.println("ERROR: Image buffer not allocated!");
     return 0;
   }
 
-  Serial.println("Requesting image from CAM...");
-  SerialCam.println("SNAP"); // Send command
+  debugSerial.println("Requesting image from CAM...");
+  lastPreviewSize = 0;
+  while (activeCam->available() > 0) {
+    activeCam->read(); // Drop stale bytes, e.g. the rest of a frame that failed
+  }
+  camReceiver.begin();
+  sendCamCommand(activeCam, snapCommand); // Send command
+  lastCamTiming = {millis(), 0, 0};
 
   unsigned long startTime = millis();
-  const unsigned long timeoutDuration = 5000; // 5 second timeout for entire process
-  size_t bytesRead = 0;
-  size_t expectedSize = 0;
-  bool sizeReceived = false;
-
-  // State machine for receiving data
-  enum RecvState { WAIT_FOR_SIZE, READ_IMAGE, WAIT_FOR_END };
-  RecvState recvState = WAIT_FOR_SIZE;
-
-  while (millis() - startTime < timeoutDuration) {
-    // --- Step 1: Wait for and parse SIZE line ---
-    if (recvState == WAIT_FOR_SIZE) {
-      if (SerialCam.available() > 0) {
-        String line = SerialCam.readStringUntil('\n');
-        line.trim();
-        Serial.printf("CAM Response: %s\n", line.c_str()); // Debug
-        if (line.startsWith("SIZE:")) {
-          expectedSize = line.substring(5).toInt();
-          if (expectedSize > 0 && expectedSize <= imageBufferSize) {
-            Serial.printf("Expecting %zu bytes...\n", expectedSize);
-            sizeReceived = true;
-            recvState = READ_IMAGE; // Move to next state
-            bytesRead = 0; // Reset bytes counter for image data
-          } else if (expectedSize > imageBufferSize) {
-            Serial.printf("ERROR: Advertised size (%zu) > buffer size (%zu)!\n", expectedSize, imageBufferSize);
-            // Optional: Could try to read/discard data to clear CAM buffer?
-            return 0; // Error
-          } else {
-            Serial.printf("ERROR: Invalid size received (%s)!\n", line.c_str());
-            return 0; // Error
-          }
-        } else if (line.startsWith("ERROR:")) {
-           Serial.printf("CAM reported error: %s\n", line.c_str());
-           return 0; // Error reported by CAM
+  unsigned long lastByteTime = startTime;
+  const unsigned long timeoutDuration = CAM_SETTLE_DEADLINE_MS + 5000; // Settle wait + 5 seconds for capture and transfer
+  CamRecvStatus status = CAM_RECV_BUSY;
+
+  while (status == CAM_RECV_BUSY && millis() - startTime < timeoutDuration) {
+    int available = activeCam->available();
+    if (available > 0) {
+      size_t n = activeCam->readBytes(camRxChunk, min((size_t)available, sizeof(camRxChunk)));
+      status = camReceiver.feed(camRxChunk, n);
+      if (lastCamTiming.headerMs == 0 && camReceiver.header().size > 0) {
+        lastCamTiming.headerMs = millis();
+      }
+      lastByteTime = millis();
+    } else if (camReceiver.midFrame() && millis() - lastByteTime >= CAM_STALL_TIMEOUT_MS) {
+      break;
+    } else {
+      delay(1); // Small delay to prevent busy-waiting
+    }
+  }
+
+  const CamFrameHeader& header = camReceiver.header();
+  if (status == CAM_RECV_ERROR) {
+    debugSerial.printf("ERROR: Frame failed (%s), header size %zu, buffer %zu\n",
+                  camReceiver.error(), header.size, imageBufferSize);
+    return 0;
+  }
+  if (status == CAM_RECV_BUSY) {
+    debugSerial.println(camReceiver.midFrame() ? "ERROR: CAM frame stalled, bytes lost!" : "ERROR: Timeout waiting for CAM response!");
+    debugSerial.printf(" (State: %d, BytesRead: %zu / %zu)\n", camReceiver.state(), camReceiver.bytesRead(), header.size);
+    return 0; // Timeout error
+  }
+
+  lastImageSharpness = header.sharpness;
+  lastImageSettleMs = header.settleMs;
+  lastImageSettleTimedOut = header.settleTimedOut;
+  lastImageFrameType = header.frameType;
+  lastImageIsDelta = header.isDelta;
+  lastImageFrameId = header.frameId;
+  lastImageRefId = header.refId;
+  lastImageArchiveGame = header.archiveGame;
+  lastPreviewSize = camReceiver.previewSize();
+  debugSerial.printf("FRAME_END received. %zu image bytes, %zu preview bytes.\n", header.size, lastPreviewSize);
+  lastCamTiming.endMs = millis();
+  return header.size; // Success!
+}
+
+// --- Point the CAM receiver at an image buffer the BLE transfer isn't reading ---
+void selectReceiveBuffer() {
+  for (int i = 0; i < IMAGE_BUFFER_COUNT; i++) {
+    if (imageBuffers[i] != nullptr && !(imageTransfer.active && imageTransfer.data == imageBuffers[i])) {
+      if (imageBuffers[i] != imageBuffer) {
+        imageBuffer = imageBuffers[i];
+        camReceiver.attach(imageBuffer, imageBufferSize, previewBuffer, previewBuffer ? previewBufferSize : 0);
+      }
+      return;
+    }
+  }
+}
+
+// --- Capture with retry on blurry frames ---
+// Re-requests the image while the CAM's sharpness score is below MIN_SHARPNESS.
+size_t captureBoardImage(const char* snapCommand) {
+  if (imageTransfer.active && IMAGE_BUFFER_COUNT == 1) {
+    cancelImageTransfer(); // imageBuffer is about to be overwritten; the newest position wins
+  }
+  selectReceiveBuffer();
+  size_t receivedBytes = 0;
+  for (int attempt = 1; attempt <= MAX_CAPTURE_ATTEMPTS; attempt++) {
+    receivedBytes = requestAndReceiveImage(snapCommand);
+    if (receivedBytes == 0 || lastImageSharpness >= MIN_SHARPNESS) {
+      break;
+    }
+    debugSerial.printf("Frame too blurry (sharpness %lu < %lu), attempt %d/%d\n",
+                  (unsigned long)lastImageSharpness, (unsigned long)MIN_SHARPNESS, attempt, MAX_CAPTURE_ATTEMPTS);
+  }
+  return receivedBytes;
+}
+
+// --- Send one notification ---
+void notifyClient(const uint8_t* data, size_t len) {
+    clientLink.notify(data, len);
+}
+
+void notifyClient(const char* message) {
+    clientLink.notify(message);
+}
+
+// --- Send a JSON message that may not fit one notification (DIAG, BENCH, image_start, frame_ready) ---
+// One notification if it fits MTU - 3; otherwise {"type":"report_start","size":<n>}, raw chunks,
+// {"type":"report_end"}, like the preview. Raw chunks would land in an image the client is still
+// assembling, so a running image transfer is finished first.
+void notifyClientReport(const char* report) {
+    size_t size = strlen(report);
+    if (size <= clientLink.maxPayload()) {
+        notifyClient(report);
+        return;
+    }
+    while (imageTransfer.active) {
+        pumpImageTransfer(); // Drops the transfer if the client disconnects
+        delay(1);
+    }
+    if (!clientLink.connected()) {
+        return;
+    }
+    char startMarker[48];
+    snprintf(startMarker, sizeof(startMarker), "{\"type\":\"report_start\",\"size\":%zu}", size);
+    waitForCredit(clientLink, PREVIEW_PACING);
+    notifyClient(startMarker);
+    sendChunked(clientLink, (const uint8_t*)report, size, PREVIEW_PACING);
+    waitForCredit(clientLink, PREVIEW_PACING);
+    notifyClient("{\"type\":\"report_end\"}");
+    debugSerial.printf("Sent report in chunks (%zu bytes, %zu per notification).\n", size, clientLink.maxPayload());
+}
+
+// --- Send the preview thumbnail over BLE (blocking, it's small) ---
+void sendPreviewOverBle(const uint8_t* buffer, size_t size) {
+    if (!clientLink.connected() || buffer == nullptr || size == 0) {
+        return;
+    }
+
+    // {"type":"preview_start","size":<total_bytes>}, raw chunks, {"type":"preview_end"}
+    char startMarker[64];
+    snprintf(startMarker, sizeof(startMarker), "{\"type\":\"preview_start\",\"size\":%zu}", size);
+    notifyClient(startMarker);
+    delay(20); // Small delay after sending marker
+
+    sendChunked(clientLink, buffer, size, PREVIEW_PACING);
+
+    waitForCredit(clientLink, PREVIEW_PACING);
+    notifyClient("{\"type\":\"preview_end\"}");
+    debugSerial.printf("Sent BLE preview (%zu bytes).\n", size);
+}
+
+// --- Start sending the full image over BLE; the chunks follow from pumpImageTransfer() ---
+void beginImageTransfer(const uint8_t* buffer, size_t size) {
+    if (!clientLink.connected() || buffer == nullptr || size == 0) {
+        debugSerial.println("ERROR: Cannot send image over BLE (disconnected, bad buffer, or zero size).");
+        return;
+    }
+
+    debugSerial.printf("Starting BLE image transfer (%zu bytes)...\n", size);
+
+    // Start Marker: {"type":"image_start","size":<total_bytes>,<frame fields>}
+    char startMarker[256];
+    int markerLen = snprintf(startMarker, sizeof(startMarker), "{\"type\":\"image_start\",\"size\":%zu,", size);
+    formatFrameFields(startMarker + markerLen, sizeof(startMarker) - markerLen, lastImageInfo(size));
+    waitForCredit(clientLink, IMAGE_PACING); // The preview may still fill the stack's buffers
+    notifyClientReport(startMarker); // Up to about 220 bytes with ref, game and board: chunked above MTU - 3
+    debugSerial.printf("Sent BLE Image Start: %s\n", startMarker);
+    delay(20); // Small delay after sending marker
+
+    imageTransfer = {buffer, size, 0, true};
+    imageTransferPulled = false;
+}
+
+// --- The frame just received, as described to the client ---
+FrameInfo lastImageInfo(size_t imageSize) {
+    FrameInfo info;
+    info.board = lastImageBoard;
+    info.ply = lastImagePly;
+    info.skipped = lastImageSkipped;
+    info.lagMs = lastImageLagMs;
+    info.sharpness = lastImageSharpness;
+    info.settleMs = lastImageSettleMs;
+    info.settleTimedOut = lastImageSettleTimedOut;
+    info.frameType = lastImageFrameType;
+    info.isDelta = lastImageIsDelta;
+    info.frameId = lastImageFrameId;
+    info.refId = lastImageRefId;
+    info.archiveGame = lastImageArchiveGame;
+    info.size = imageSize;
+    info.previewSize = lastPreviewSize;
+    return info;
+}
+
+// --- Frame fields of image_start and frame_start, closing the object ---
+// "sharpness":<score>,"settle_ms":<ms>,"settle_timeout":<0|1>,"frame":"key"|"delta"|"tiles","id":<n>,"ply":<n>,
+// "skipped":<n>,"lag_ms":<ms>[,"ref":<n>][,"game":<n>][,"board":<n>]}
+int formatFrameFields(char* buffer, size_t bufferSize, const FrameInfo& info) {
+    int len = snprintf(buffer, bufferSize,
+             "\"sharpness\":%lu,\"settle_ms\":%lu,\"settle_timeout\":%d,\"frame\":\"%s\",\"id\":%lu,\"ply\":%u,"
+             "\"skipped\":%u,\"lag_ms\":%lu",
+             (unsigned long)info.sharpness, (unsigned long)info.settleMs, info.settleTimedOut ? 1 : 0, info.frameType,
+             (unsigned long)info.frameId, info.ply, info.skipped, (unsigned long)info.lagMs);
+    if (info.isDelta) {
+      len += snprintf(buffer + len, bufferSize - len, ",\"ref\":%lu", (unsigned long)info.refId);
+    }
+    if (info.archiveGame != 0) {
+      len += snprintf(buffer + len, bufferSize - len, ",\"game\":%lu", (unsigned long)info.archiveGame);
+    }
+    if (BOARD_COUNT > 1) {
+      len += snprintf(buffer + len, bufferSize - len, ",\"board\":%u", info.board);
+    }
+    return len + snprintf(buffer + len, bufferSize - len, "}");
+}
+
+// --- Send the next few chunks of the full image, then the end marker ---
+void pumpImageTransfer() {
+    if (!imageTransfer.active) {
+        return;
+    }
+    if (!clientLink.connected()) {
+        debugSerial.println("Client gone, dropping image transfer.");
+        imageTransfer.active = false;
+        return;
+    }
+
+    if (pumpChunks(clientLink, imageTransfer, IMAGE_PACING)) {
+        // End Marker: {"type":"image_end"} (or frame_end for a GET)
+        waitForCredit(clientLink, IMAGE_PACING);
+        notifyClient(imageTransferPulled ? "{\"type\":\"frame_end\"}" : "{\"type\":\"image_end\"}");
+        debugSerial.println("BLE image transfer complete.");
+        imageTransfer.active = false;
+    }
+}
+
+// --- Abort the full image transfer (client had enough with the preview, or a newer capture) ---
+void cancelImageTransfer() {
+    if (!imageTransfer.active) {
+        return;
+    }
+    imageTransfer.active = false;
+    if (imageTransferPulled) {
+        // The client can ask again; the delta chain is the client's business in pull mode
+        char message[64];
+        snprintf(message, sizeof(message), "{\"type\":\"frame_cancelled\",\"ply\":%u}", imageTransferPly);
+        if (clientLink.connected()) {
+            notifyClient(message);
+        }
+        debugSerial.printf("GET of ply %u cancelled after %zu / %zu bytes.\n", imageTransferPly, imageTransfer.sent,
+                      imageTransfer.size);
+        return;
+    }
+    if (clientLink.connected()) {
+        notifyClient("{\"type\":\"image_cancelled\"}");
+    }
+#if USE_DELTA_FRAMES
+    sendCamCommand(camLinks[boards[lastImageBoard].camera], "KEYFRAME"); // The client never got this frame, so the delta chain restarts
+#endif
+    debugSerial.printf("BLE image transfer cancelled after %zu / %zu bytes.\n", imageTransfer.sent, imageTransfer.size);
+}
+
+// --- Preview first, then the full image at lower priority ---
+void sendImageToClient(size_t imageSize) {
+    if (imageTransfer.active) {
+        cancelImageTransfer(); // Still sending the previous frame from the other buffer; the newest position wins
+    }
+    if (lastPreviewSize > 0) {
+        sendPreviewOverBle(previewBuffer, lastPreviewSize);
+    }
+    beginImageTransfer(imageBuffer, imageSize);
+}
+
+#if USE_FRAME_STORE
+// --- Keep the frame just received for GET; in pull mode announce it instead of sending it ---
+// {"type":"frame_ready","size":<image bytes>,"preview":<preview bytes>,<frame fields as in image_start>}
+void storeFrame(const FrameInfo& info) {
+    const uint8_t* preview = (info.previewSize > 0) ? previewBuffer : nullptr;
+    size_t bytes = info.size + (preview ? info.previewSize : 0);
+    const uint8_t* place = frameStore.placement(info.size, preview ? info.previewSize : 0);
+    if (place == nullptr) {
+        debugSerial.printf("Frame of %zu bytes not stored (store holds %zu).\n", bytes, frameStore.capacity());
+        return;
+    }
+    if (imageTransfer.active && imageTransferPulled && imageTransfer.data < place + bytes &&
+        place < imageTransfer.data + imageTransfer.size) {
+        cancelImageTransfer(); // The frame being fetched is about to be overwritten
+    }
+    frameStore.store(info, imageBuffer, preview);
+    if (!pullImages || !clientLink.connected()) {
+        return;
+    }
+    char message[256];
+    int len = snprintf(message, sizeof(message), "{\"type\":\"frame_ready\",\"size\":%lu,\"preview\":%lu,",
+                       (unsigned long)info.size, (unsigned long)(preview ? info.previewSize : 0));
+    formatFrameFields(message + len, sizeof(message) - len, info);
+    waitForCredit(clientLink, IMAGE_PACING);
+    // Up to about 230 bytes: chunked above MTU - 3, after any GET still being answered
+    notifyClientReport(message);
+    debugSerial.printf("Frame stored and announced: %s\n", message);
+}
+
+// --- "frames":[<oldest>,<newest>], of the plies stored for a board (pull mode only, else nothing) ---
+int formatStoredPlies(char* buffer, size_t bufferSize, int board) {
+    uint16_t oldest, newest;
+    if (!pullImages || !frameStore.plyRange(board, &oldest, &newest)) {
+        return 0;
+    }
+    return snprintf(buffer, bufferSize, "\"frames\":[%u,%u],", oldest, newest);
+}
+
+// --- Queue a GET ("GET:<ply>", "GET:<ply>,preview" or "GET:<ply>,<offset>,<len>") ---
+void queueFrameRequest(int board, const char* args) {
+    char* end;
+    FrameRequest request = {(uint8_t)board, 0, 0, 0, false};
+    unsigned long ply = strtoul(args, &end, 10);
+    if (end == args || ply > 0xFFFF) {
+        debugSerial.printf("Invalid GET: %s\n", args);
+        return;
+    }
+    request.ply = (uint16_t)ply;
+    if (strcmp(end, ",preview") == 0) {
+        request.preview = true;
+    } else if (*end == ',') {
+        request.offset = strtoul(end + 1, &end, 10);
+        request.len = (*end == ',') ? strtoul(end + 1, &end, 10) : 0;
+    }
+    if (*end != '\0' && !request.preview) {
+        debugSerial.printf("Invalid GET: %s\n", args);
+        return;
+    }
+    if (frameStore.capacity() == 0 || frameRequestCount == FRAME_REQUEST_QUEUE_LEN) {
+        sendFrameError(board, ply, frameStore.capacity() == 0 ? "no_store" : "busy");
+        return;
+    }
+    frameRequests[frameRequestCount++] = request;
+}
+
+// --- Start sending the oldest queued GET, once no image is being sent ---
+// {"type":"frame_start","ply":<n>,"part":"image"|"preview","offset":<o>,"size":<bytes sent>,"total":<n>[,"board":<n>]},
+// raw chunks, {"type":"frame_end"}. The frame's other fields were in its frame_ready.
+void startNextFrameRequest() {
+    if (frameRequestCount == 0 || imageTransfer.active || !clientLink.connected()) {
+        return;
+    }
+    FrameRequest request = frameRequests[0];
+    frameRequestCount--;
+    memmove(&frameRequests[0], &frameRequests[1], frameRequestCount * sizeof(FrameRequest));
+
+    const StoredFrame* frame = frameStore.find(request.board, request.ply);
+    const uint8_t* data = nullptr;
+    uint32_t total = 0;
+    if (frame != nullptr) {
+        data = request.preview ? frame->preview : frame->image;
+        total = request.preview ? frame->info.previewSize : frame->info.size;
+    }
+    if (data == nullptr) {
+        sendFrameError(request.board, request.ply, "not_found"); // Dropped to make room, never captured, or no preview
+        return;
+    }
+    if (request.offset >= total) {
+        sendFrameError(request.board, request.ply, "bad_range");
+        return;
+    }
+    uint32_t len = total - request.offset;
+    if (request.len > 0 && request.len < len) {
+        len = request.len;
+    }
+    char startMarker[144];
+    int markerLen = snprintf(startMarker, sizeof(startMarker),
+             "{\"type\":\"frame_start\",\"ply\":%u,\"part\":\"%s\",\"offset\":%lu,\"size\":%lu,\"total\":%lu",
+             request.ply, request.preview ? "preview" : "image", (unsigned long)request.offset, (unsigned long)len,
+             (unsigned long)total);
+    if (BOARD_COUNT > 1) {
+        markerLen += snprintf(startMarker + markerLen, sizeof(startMarker) - markerLen, ",\"board\":%u", request.board);
+    }
+    snprintf(startMarker + markerLen, sizeof(startMarker) - markerLen, "}");
+    waitForCredit(clientLink, IMAGE_PACING);
+    notifyClient(startMarker);
+    debugSerial.printf("GET: %s\n", startMarker);
+    imageTransfer = {data + request.offset, len, 0, true};
+    imageTransferPulled = true;
+    imageTransferPly = request.ply;
+}
+
+// --- {"type":"frame_error","ply":<n>,"reason":"not_found"|"bad_range"|"busy"|"no_store"[,"board":<n>]} ---
+void sendFrameError(int board, unsigned long ply, const char* reason) {
+    char message[96];
+    int len = snprintf(message, sizeof(message), "{\"type\":\"frame_error\",\"ply\":%lu,\"reason\":\"%s\"", ply, reason);
+    if (BOARD_COUNT > 1) {
+        len += snprintf(message + len, sizeof(message) - len, ",\"board\":%d", board);
+    }
+    snprintf(message + len, sizeof(message) - len, "}");
+    notifyClient(message);
+    debugSerial.printf("GET of board %d ply %lu failed: %s\n", board, ply, reason);
+}
+#endif
+
+// --- Handle a command written by the client to the state characteristic ---
+// "BOARD:<n>:<command>" addresses one board. Without it, board commands apply to every board,
+// except CALIB, FETCH and GET, which can only mean one camera or board and go to board 0's.
+void handleClientCommand(const char* command) {
+    debugSerial.printf("Client command: '%s'\n", command);
+    int firstBoard = 0;
+    int lastBoard = BOARD_COUNT - 1;
+    if (strncmp(command, "BOARD:", 6) == 0) {
+        char* end;
+        unsigned long board = strtoul(command + 6, &end, 10);
+        if (end == command + 6 || *end != ':' || board >= (unsigned long)BOARD_COUNT) {
+            debugSerial.printf("Invalid board in command: %s\n", command);
+            return;
+        }
+        firstBoard = lastBoard = (int)board;
+        command = end + 1;
+    }
+    if (strncmp(command, "SYNC:", 5) == 0) {
+        answerClockSync(command + 5, pendingClientCommandMs);
+    } else if (strcmp(command, "KEYFRAME") == 0) {
+        // Client lost the delta chain (or just connected); next capture is a full JPEG
+        sendToCameras(firstBoard, lastBoard, "KEYFRAME");
+    } else if (strncmp(command, "CALIB:", 6) == 0) {
+        // Board calibration lives on the CAM; pass it through
+        sendToCameras(firstBoard, firstBoard, command);
+    } else if (strcmp(command, "TILES:ON") == 0 || strcmp(command, "TILES:OFF") == 0) {
+        sendToCameras(firstBoard, lastBoard, command);
+    } else if (strcmp(command, "DIAG") == 0) {
+        sendDiagnostics();
+    } else if (strncmp(command, "BENCH:", 6) == 0) {
+        runSelfBenchmark(command + 6);
+    } else if (strncmp(command, "FETCH:", 6) == 0) {
+        fetchArchivedFrame(firstBoard, command + 6);
+    } else if (strncmp(command, "CAPTURE:", 8) == 0) {
+        setCapturePolicy(firstBoard, lastBoard, command + 8);
+    } else if (strncmp(command, "TIME_CONTROL:", 13) == 0) {
+        setTimeControl(firstBoard, lastBoard, command + 13);
+#if USE_FRAME_STORE
+    } else if (strcmp(command, "IMAGES:PULL") == 0 || strcmp(command, "IMAGES:PUSH") == 0) {
+        // Pull: captures are only announced (frame_ready) and sent on GET
+        pullImages = (strcmp(command + 7, "PULL") == 0);
+        debugSerial.printf("Images: %s\n", pullImages ? "pulled on GET" : "pushed");
+    } else if (strncmp(command, "GET:", 4) == 0) {
+        queueFrameRequest(firstBoard, command + 4);
+#endif
+    } else if (strcmp(command, "CANCEL_IMAGE") == 0) {
+        // The preview was enough (or the GET); free the link for state updates
+        cancelImageTransfer();
+    } else {
+        debugSerial.printf("Unknown client command: %s\n", command);
+    }
+}
+
+#if USE_USB_CLIENT
+// --- Read the frames a wired client sent (up to the next command; the rest waits for it to be handled) ---
+void pollUsbClient() {
+    while (!clientCommandPending && Serial.available() > 0) {
+        if (!usbDecoder.feed((uint8_t)Serial.read())) {
+            continue;
+        }
+        usbClientLastFrameMs = millis();
+        const char* payload = (const char*)usbDecoder.payload();
+        if (usbDecoder.channel() == USB_CH_LINK) {
+            handleUsbLinkMessage(payload);
+        } else if (usbDecoder.channel() == USB_CH_CLIENT && usbClientActive) {
+            queueClientCommand(usbDecoder.payload(), usbDecoder.length());
+        }
+    }
+    // Only once the bytes that queued up during a capture or a FETCH are read
+    if (usbClientActive && Serial.available() == 0 && millis() - usbClientLastFrameMs >= USB_CLIENT_TIMEOUT_MS) {
+        setUsbClientActive(false);
+        debugSerial.println("USB client timed out.");
+    }
+}
+
+// --- HELLO (attach, or start over), PING (keepalive) or BYE (detach) on the link channel ---
+void handleUsbLinkMessage(const char* message) {
+    if (strcmp(message, "HELLO") == 0) {
+        setUsbClientActive(true);
+        char ready[24];
+        int len = snprintf(ready, sizeof(ready), "READY:%u", (unsigned)USB_MAX_PAYLOAD);
+        uint8_t frame[sizeof(ready) + USB_FRAME_OVERHEAD];
+        Serial.write(frame, encodeUsbFrame(USB_CH_LINK, (const uint8_t*)ready, len, frame));
+        debugSerial.printf("USB client attached at %lu baud.\n", USB_BAUD);
+    } else if (strcmp(message, "BYE") == 0) {
+        debugSerial.println("USB client detached.");
+        setUsbClientActive(false);
+    }
+}
+
+// --- Move the client link between BLE and USB: what was in flight is dropped, the new side gets the state ---
+void setUsbClientActive(bool active) {
+    cancelImageTransfer(); // Tells the side that was being sent to
+#if USE_FRAME_STORE
+    pullImages = false; // The new client asks for pull mode itself
+    frameRequestCount = 0;
+#endif
+    usbClientActive = active;
+    stateReplayPending = active || deviceConnected; // Sent once clientLink is connected
+}
+#endif
+
+// --- Pass a command to the cameras of boards firstBoard..lastBoard, once per camera ---
+void sendToCameras(int firstBoard, int lastBoard, const char* command) {
+    for (int cam = 0; cam < CAM_COUNT; cam++) {
+        for (int board = firstBoard; board <= lastBoard; board++) {
+            if (boards[board].camera == cam) {
+                sendCamCommand(camLinks[cam], command);
+                break;
+            }
+        }
+    }
+}
+
+// --- Send one command line to a CAM, waking it first if it may be in standby ---
+void sendCamCommand(HardwareSerial* link, const char* command) {
+#if USE_CAM_STANDBY
+    int cam = 0;
+    while (cam < CAM_COUNT - 1 && camLinks[cam] != link) {
+        cam++;
+    }
+    if (millis() - camLastCommandMs[cam] >= CAM_STANDBY_IDLE_MS - 1000) {
+        camAsleep[cam] = true; // Idle long enough to have gone to standby by itself
+    }
+    if (camAsleep[cam]) {
+        if (camWakePins[cam] >= 0) {
+            digitalWrite(camWakePins[cam], HIGH);
+            delay(1);
+            digitalWrite(camWakePins[cam], LOW);
         } else {
-            Serial.printf("WARN: Unexpected CAM response: %s\n", line.c_str());
-            // Keep waiting for SIZE: line
+            link->print("\n\n\n"); // Lost in waking the CAM's UART
         }
-      } 
-    } 
-    // --- Step 2: Read image bytes ---
-    else if (recvState == READ_IMAGE) {
-      if (SerialCam.available() > 0) {
-        size_t bytesToRead = SerialCam.available();
-        if (bytesRead + bytesToRead > expectedSize) {
-          bytesToRead = expectedSize - bytesRead; // Don't read past expected size
+        delay(CAM_WAKE_GUARD_MS);
+    }
+    if (strncmp(command, "SNAP", 4) == 0 || strncmp(command, "CAMCFG:", 7) == 0 || strcmp(command, "WAKE") == 0) {
+        camAsleep[cam] = false; // Sensor powers up and the CAM stays awake
+    } else if (strcmp(command, "STANDBY") == 0) {
+        camAsleep[cam] = true;
+    }
+    camLastCommandMs[cam] = millis();
+#endif
+    link->println(command);
+}
+
+#if USE_CAM_STANDBY
+// --- Put a board's camera in standby unless it films a board with a game running ---
+void standbyIdleCamera(int board) {
+    uint8_t cam = boards[board].camera;
+    for (int other = 0; other < BOARD_COUNT; other++) {
+        if (boards[other].camera == cam && boards[other].clock.isRunning()) {
+            return;
         }
-        size_t actuallyRead = SerialCam.readBytes(imageBuffer + bytesRead, bytesToRead);
-        bytesRead += actuallyRead;
+    }
+    sendCamCommand(camLinks[cam], "STANDBY");
+}
+#endif
 
-        if (bytesRead == expectedSize) {
-          Serial.printf("Read %zu image bytes.\n", bytesRead);
-          recvState = WAIT_FOR_END; // Move to next state
+// --- Switch time control ("TIME_CONTROL:<kind>,<base_ms>,..."); only between games ---
+// Refused for all the addressed boards if a game runs on any of them.
+void setTimeControl(int firstBoard, int lastBoard, const char* spec) {
+    TimeControlConfig config;
+    if (!parseTimeControl(spec, &config)) {
+        debugSerial.printf("Invalid time control: %s\n", spec);
+        return;
+    }
+    portENTER_CRITICAL(&clockMux);
+    bool applied = !anyGameRunning(boards + firstBoard, lastBoard - firstBoard + 1);
+    for (int board = firstBoard; board <= lastBoard && applied; board++) {
+        boards[board].clock.configure(config);
+    }
+    portEXIT_CRITICAL(&clockMux);
+    if (!applied) {
+        debugSerial.println("Time control not changed, a game is running.");
+        return;
+    }
+    debugSerial.printf("Time control: %s, %lu ms base, %lu ms increment/delay\n", timeControlKindNames[config.kind],
+                  (unsigned long)config.baseMs, (unsigned long)config.incrementMs);
+    for (int board = firstBoard; board <= lastBoard; board++) {
+        portENTER_CRITICAL(&clockMux);
+        ClockTransition clock = boards[board].clock.tick(millis()); // Not running: just the new starting times
+        portEXIT_CRITICAL(&clockMux);
+        sendBleStateUpdate(board, 0, clock); // Like a reset
+    }
+#if USE_LCD
+    forceUpdateDisplay();
+#endif
+}
+
+// --- Change the capture policy ("CAPTURE:<LATEST|EVERY|ALL>[,<n>]"); applies to the next request ---
+void setCapturePolicy(int firstBoard, int lastBoard, const char* spec) {
+    CapturePolicy policy;
+    uint16_t param;
+    if (!parseCapturePolicy(spec, &policy, &param)) {
+        debugSerial.printf("Invalid capture policy: %s\n", spec);
+        return;
+    }
+    for (int board = firstBoard; board <= lastBoard; board++) {
+        boards[board].captures.configure(policy, param);
+    }
+    debugSerial.printf("Capture policy: %s,%u\n", capturePolicyNames[policy], boards[firstBoard].captures.policyParam());
+}
+
+// --- Request one block of an archived frame from the CAM into imageBuffer ---
+// Returns the block length, or -1 with *error set ("not_found", "no_archive", "busy", "cam_timeout", "bad_block").
+long receiveArchiveBlock(unsigned long game, unsigned long ply, size_t offset, size_t* total, const char** error) {
+    while (activeCam->available() > 0) {
+        activeCam->read(); // Drop stale debug output
+    }
+    char request[48];
+    snprintf(request, sizeof(request), "FETCH:%lu,%lu,%u", game, ply, (unsigned)offset);
+    sendCamCommand(activeCam, request);
+    unsigned long startTime = millis();
+    while (millis() - startTime < 2000) {
+        if (activeCam->available() == 0) {
+            delay(1);
+            continue;
         }
-      }
-    } 
-    // --- Step 3: Wait for FRAME_END marker ---
-    else if (recvState == WAIT_FOR_END) {
-       if (SerialCam.available() > 0) {
-          String line = SerialCam.readStringUntil('\n');
-          line.trim();
-          Serial.printf("CAM End Response: %s\n", line.c_str()); // Debug
-          if (line == "FRAME_END") {
-            Serial.println("FRAME_END received. Image transfer complete.");
-            return bytesRead; // Success!
-          } else {
-             Serial.printf("WARN: Unexpected data after image: %s\n", line.c_str());
-             // Keep waiting for FRAME_END
-          }
-       }
+        const char* line = readCamLine();
+        if (strncmp(line, "ERROR:", 6) == 0) {
+            *error = (strcmp(line + 6, "NotFound") == 0) ? "not_found" : (strcmp(line + 6, "Busy") == 0) ? "busy" : "no_archive";
+            return -1;
+        }
+        if (strncmp(line, "FILE:", 5) != 0) {
+            continue; // CAM debug output
+        }
+        char* end;
+        *total = strtoul(line + 5, &end, 10);
+        unsigned long blockOffset = (*end == ',') ? strtoul(end + 1, &end, 10) : 0;
+        size_t len = (*end == ',') ? strtoul(end + 1, nullptr, 10) : 0;
+        if (blockOffset != offset || len > FETCH_BLOCK_SIZE || len > imageBufferSize ||
+            activeCam->readBytes(imageBuffer, len) != len || strcmp(readCamLine(), "FILE_END") != 0) {
+            *error = "bad_block";
+            return -1;
+        }
+        return (long)len;
     }
+    *error = "cam_timeout";
+    return -1;
+}
 
-    delay(1); // Small delay to prevent busy-waiting
-  } // End while loop (timeout check)
+// --- Relay an archived full-resolution frame from the CAM's SD card ("FETCH:<game>,<ply>") ---
+// Between games only: loop() is blocked for the whole transfer, which runs at UART speed (about
+// 10 KB/s). Each block is relayed before the next is requested, so a slow BLE link never overruns
+// the UART. {"type":"archive_start","game":g,"ply":p,"size":n}, raw chunks, {"type":"archive_end"},
+// or {"type":"archive_error","game":g,"ply":p,"reason":"..."} (also after a partial transfer).
+void fetchArchivedFrame(int board, const char* args) {
+    char* end;
+    unsigned long game = strtoul(args, &end, 10);
+    unsigned long ply = (*end == ',') ? strtoul(end + 1, &end, 10) : 0;
+    char message[112];
+    if (*end != '\0' || game == 0 || imageBuffer == nullptr) {
+        debugSerial.printf("Invalid FETCH: %s\n", args);
+        return;
+    }
+    if (anyGameRunning(boards, BOARD_COUNT)) {
+        snprintf(message, sizeof(message), "{\"type\":\"archive_error\",\"game\":%lu,\"ply\":%lu,\"reason\":\"game_running\"}",
+                 game, ply);
+        notifyClient(message);
+        return;
+    }
+    cancelImageTransfer(); // imageBuffer holds the blocks
+    activeCam = camLinks[boards[board].camera];
+
+    size_t total = 0;
+    size_t offset = 0;
+    const char* error = nullptr;
+    unsigned long startTime = millis();
+    do {
+        long len = -1;
+        for (int attempt = 1; attempt <= FETCH_MAX_ATTEMPTS && len < 0; attempt++) {
+            len = receiveArchiveBlock(game, ply, offset, &total, &error);
+            if (len < 0 && strcmp(error, "busy") == 0) {
+                delay(200); // The CAM is still writing the last move to the card
+            } else if (len < 0 && strcmp(error, "bad_block") != 0 && strcmp(error, "cam_timeout") != 0) {
+                break; // Not found or no archive; retrying won't help
+            }
+        }
+        if (len <= 0) {
+            if (len == 0) {
+                error = "bad_block";
+            }
+            break;
+        }
+        if (offset == 0) {
+            snprintf(message, sizeof(message), "{\"type\":\"archive_start\",\"game\":%lu,\"ply\":%lu,\"size\":%u}",
+                     game, ply, (unsigned)total);
+            notifyClient(message);
+        }
+        sendChunked(clientLink, imageBuffer, (size_t)len, IMAGE_PACING);
+        offset += len;
+        error = nullptr;
+    } while (offset < total && clientLink.connected());
+
+    waitForCredit(clientLink, IMAGE_PACING);
+    if (error == nullptr && offset >= total) {
+        notifyClient("{\"type\":\"archive_end\"}");
+        debugSerial.printf("Archived frame %lu/%lu relayed: %u bytes in %lu ms\n", game, ply, (unsigned)total,
+                      millis() - startTime);
+    } else {
+        snprintf(message, sizeof(message), "{\"type\":\"archive_error\",\"game\":%lu,\"ply\":%lu,\"reason\":\"%s\"}",
+                 game, ply, error ? error : "disconnected");
+        notifyClient(message);
+        debugSerial.printf("FETCH %lu/%lu failed after %u bytes: %s\n", game, ply, (unsigned)offset, error ? error : "disconnected");
+    }
+    activeCam = camLinks[0];
+}
 
-  // If we reach here, it's a timeout
-  Serial.println("ERROR: Timeout waiting for CAM response!");
-  Serial.printf(" (State: %d, SizeOK: %d, BytesRead: %zu / %zu)\n", recvState, sizeReceived, bytesRead, expectedSize);
-  return 0; // Timeout error
-} 
+// --- Sort the first count samples and return the value at fraction p (0 = min, 1 = max) ---
+uint32_t benchPercentile(uint32_t* samples, int count, float p) {
+    for (int i = 1; i < count; i++) { // Insertion sort, count <= BENCH_MAX_CYCLES
+        uint32_t v = samples[i];
+        int j = i - 1;
+        while (j >= 0 && samples[j] > v) {
+            samples[j + 1] = samples[j];
+            j--;
+        }
+        samples[j + 1] = v;
+    }
+    return samples[(int)(p * (count - 1) + 0.5f)];
+}
 
-// --- Send Image Data over BLE --- 
-void sendImageOverBle(const uint8_t* buffer, size_t size) {
-    if (!deviceConnected || pStateCharacteristic == nullptr || buffer == nullptr || size == 0) {
-        Serial.println("ERROR: Cannot send image over BLE (disconnected, bad buffer, or zero size).");
+// --- Self-benchmark: back-to-back SNAP, UART receive and BLE send cycles, then a report ---
+// Field measurements without a serial cable. Images go out framed as bench_start/bench_end so the
+// app doesn't treat them as positions. Report:
+// {"type":"bench","cycles":n,"ok":n,"failed":n,"retries":n,"frame":"QVGA","quality":12,"bytes_avg":n,
+//  "cam_ms":[min,avg,p99],"uart_ms":[..],"ble_ms":[..],"total_ms":[..],"uart_Bps":n,"ble_Bps":n,"ble":"nimble"}
+void runSelfBenchmark(const char* args) {
+    if (anyGameRunning(boards, BOARD_COUNT)) {
+        debugSerial.println("BENCH refused, a game is running.");
         return;
     }
+    int cycles = atoi(args);
+    if (cycles < 1 || cycles > BENCH_MAX_CYCLES) {
+        debugSerial.printf("BENCH cycles must be 1-%d: %s\n", BENCH_MAX_CYCLES, args);
+        return;
+    }
+    // Optional frame size and JPEG quality, applied on the CAM for the run
+    char frameSize[8];
+    strncpy(frameSize, CAM_DEFAULT_FRAMESIZE, sizeof(frameSize));
+    int quality = CAM_DEFAULT_QUALITY;
+    const char* comma = strchr(args, ',');
+    if (comma != nullptr) {
+        size_t len = strcspn(comma + 1, ",");
+        if (len == 0 || len >= sizeof(frameSize)) {
+            debugSerial.printf("Invalid BENCH frame size: %s\n", args);
+            return;
+        }
+        memcpy(frameSize, comma + 1, len);
+        frameSize[len] = '\0';
+        const char* qualityArg = strchr(comma + 1, ',');
+        if (qualityArg != nullptr) {
+            quality = atoi(qualityArg + 1);
+        }
+    }
+    char camConfig[32];
+    snprintf(camConfig, sizeof(camConfig), "CAMCFG:%s,%d", frameSize, quality);
+    sendCamCommand(activeCam, camConfig);
+    cancelImageTransfer();
+    debugSerial.printf("Self-benchmark: %d cycles, %s\n", cycles, camConfig);
+
+    int ok = 0, failed = 0, retries = 0;
+    uint32_t uartBytes = 0, uartMs = 0, bleBytes = 0, bleMs = 0;
+    for (int cycle = 0; cycle < cycles; cycle++) {
+        unsigned long start = millis();
+        size_t size = requestAndReceiveImage();
+        if (size == 0) {
+            retries++;
+            size = requestAndReceiveImage();
+        }
+        if (size == 0) {
+            failed++;
+            continue;
+        }
+        unsigned long bleStart = millis();
+        char marker[48];
+        snprintf(marker, sizeof(marker), "{\"type\":\"bench_start\",\"size\":%zu}", size);
+        waitForCredit(clientLink, IMAGE_PACING);
+        notifyClient(marker);
+        sendChunked(clientLink, imageBuffer, size, IMAGE_PACING);
+        waitForCredit(clientLink, IMAGE_PACING);
+        notifyClient("{\"type\":\"bench_end\"}");
+        unsigned long end = millis();
+
+        benchSamples[BENCH_CAM][ok] = lastCamTiming.headerMs - lastCamTiming.requestMs;
+        benchSamples[BENCH_UART][ok] = lastCamTiming.endMs - lastCamTiming.headerMs;
+        benchSamples[BENCH_BLE][ok] = end - bleStart;
+        benchSamples[BENCH_TOTAL][ok] = end - start;
+        uartBytes += size;
+        uartMs += benchSamples[BENCH_UART][ok];
+        bleBytes += size;
+        bleMs += benchSamples[BENCH_BLE][ok];
+        ok++;
+    }
 
-    Serial.printf("Starting BLE image transfer (%zu bytes)...\n", size);
+    snprintf(camConfig, sizeof(camConfig), "CAMCFG:%s,%d", CAM_DEFAULT_FRAMESIZE, CAM_DEFAULT_QUALITY);
+    sendCamCommand(activeCam, camConfig);
+
+    char report[400];
+    int len = snprintf(report, sizeof(report),
+             "{\"type\":\"bench\",\"cycles\":%d,\"ok\":%d,\"failed\":%d,\"retries\":%d,\"frame\":\"%s\",\"quality\":%d,"
+             "\"bytes_avg\":%lu", cycles, ok, failed, retries, frameSize, quality,
+             ok > 0 ? (unsigned long)(uartBytes / ok) : 0UL);
+    for (int stage = 0; stage < BENCH_STAGE_COUNT && ok > 0; stage++) {
+        uint32_t sum = 0;
+        for (int i = 0; i < ok; i++) {
+            sum += benchSamples[stage][i];
+        }
+        uint32_t p99 = benchPercentile(benchSamples[stage], ok, 0.99f); // Sorts; min is then at [0]
+        if (len < (int)sizeof(report)) {
+            len += snprintf(report + len, sizeof(report) - len, ",\"%s\":[%lu,%lu,%lu]", benchStageNames[stage],
+                            (unsigned long)benchSamples[stage][0], (unsigned long)(sum / ok), (unsigned long)p99);
+        }
+    }
+    if (len < (int)sizeof(report)) {
+        snprintf(report + len, sizeof(report) - len, ",\"uart_Bps\":%lu,\"ble_Bps\":%lu,\"ble\":\"%s\",\"link\":\"%s\"}",
+                 uartMs > 0 ? (unsigned long)(uartBytes * 1000ULL / uartMs) : 0UL,
+                 bleMs > 0 ? (unsigned long)(bleBytes * 1000ULL / bleMs) : 0UL, BLE_STACK_NAME,
+                 usbClientActive ? "usb" : "ble");
+    }
+    debugSerial.printf("Self-benchmark: %s\n", report);
+    if (clientLink.connected()) {
+        notifyClientReport(report); // 300+ bytes: more than MTU - 3 on most phones
+    }
+}
 
-    // 1. Send Start Marker: {"type":"image_start","size":<total_bytes>}
-    char startMarker[64];
-    snprintf(startMarker, sizeof(startMarker), "{\"type\":\"image_start\",\"size\":%zu}", size);
-    pStateCharacteristic->setValue(startMarker);
-    pStateCharacteristic->notify();
-    Serial.printf("Sent BLE Image Start: %s\n", startMarker);
-    delay(20); // Small delay after sending marker
+// --- Sample heap and task stack usage ---
+void sampleTelemetry() {
+    telemetry.freeHeap = ESP.getFreeHeap();
+    telemetry.minFreeHeap = ESP.getMinFreeHeap();
+    telemetry.largestFreeBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    for (int i = 0; i < MONITORED_TASK_COUNT; i++) {
+        TaskHandle_t task = xTaskGetHandle(monitoredTaskNames[i]);
+        telemetry.stackHighWater[i] = (task != nullptr) ? uxTaskGetStackHighWaterMark(task) : 0;
+    }
+    lastTelemetryTime = millis();
+}
 
-    // 2. Send Image Data Chunks
-    const size_t chunkSize = 20; // As per spec example
-    size_t bytesSent = 0;
-    while (bytesSent < size) {
-        size_t currentChunkSize = min(chunkSize, size - bytesSent);
-        pStateCharacteristic->setValue((uint8_t*)buffer + bytesSent, currentChunkSize);
-        pStateCharacteristic->notify();
-        bytesSent += currentChunkSize;
-        // Serial.printf("Sent %zu / %zu bytes\n", bytesSent, size); // Optional: Very verbose debug
-        delay(5); // Small delay between chunks to allow receiver processing time
-    }
-
-    // 3. Send End Marker: {"type":"image_end"}
-    char endMarker[] = "{\"type\":\"image_end\"}";
-    pStateCharacteristic->setValue(endMarker);
-    pStateCharacteristic->notify();
-    Serial.printf("Sent BLE Image End: %s\n", endMarker);
-    Serial.println("BLE image transfer complete.");
-} 
\ No newline at end of file
+// --- Ask the CAM for its own telemetry ("DIAG:<free>,<min_free>,<largest>,<stack_hwm>,<free_psram>") ---
+// Returns the comma-separated values, or nullptr if the CAM didn't answer in time.
+const char* queryCamDiagnostics() {
+    while (activeCam->available() > 0) {
+        activeCam->read(); // Drop stale debug output
+    }
+    sendCamCommand(activeCam, "DIAG");
+    unsigned long startTime = millis();
+    while (millis() - startTime < 300) {
+        if (activeCam->available() > 0) {
+            const char* line = readCamLine();
+            if (strncmp(line, "DIAG:", 5) == 0) {
+                return line + 5;
+            }
+        }
+        delay(1);
+    }
+    return nullptr;
+}
+
+// --- Report the latest telemetry to the client ---
+// {"type":"diag","free_heap":<b>,"min_free_heap":<b>,"largest_block":<b>,"stack_hwm":{"<task>":<b>,...},
+//  "cam":[<free>,<min_free>,<largest>,<stack_hwm>,<free_psram>,<archived>,<archive_skipped>,<standbys>,<wake_ms>,<max_wake_ms>],"captures":{...},"boards":<n>,
+//  "ble":"<bluedroid|nimble>","image_buffers":<n>[,"store":[<frames>,<stored>,<evicted>]],"link":"<ble|usb>"
+//  [,"usb_errors":<bad frames>]}
+void sendDiagnostics() {
+    sampleTelemetry();
+    char diag[560];
+    int len = snprintf(diag, sizeof(diag),
+             "{\"type\":\"diag\",\"free_heap\":%lu,\"min_free_heap\":%lu,\"largest_block\":%lu,\"stack_hwm\":{",
+             (unsigned long)telemetry.freeHeap, (unsigned long)telemetry.minFreeHeap,
+             (unsigned long)telemetry.largestFreeBlock);
+    for (int i = 0; i < MONITORED_TASK_COUNT && len < (int)sizeof(diag); i++) {
+        len += snprintf(diag + len, sizeof(diag) - len, "%s\"%s\":%lu", (i > 0) ? "," : "",
+                        monitoredTaskNames[i], (unsigned long)telemetry.stackHighWater[i]);
+    }
+    const char* camDiag = queryCamDiagnostics();
+    if (len < (int)sizeof(diag)) {
+        len += snprintf(diag + len, sizeof(diag) - len, "},\"cam\":%s%s%s", camDiag ? "[" : "",
+                        camDiag ? camDiag : "null", camDiag ? "]" : "");
+    }
+    // Capture counters summed over the boards, depth and lag of the worst one; policy of board 0
+    const CaptureScheduler& first = boards[0].captures;
+    int depth = 0, maxDepth = 0;
+    unsigned long lagMs = 0, maxLagMs = 0, requested = 0, run = 0, dropped = 0;
+    for (int board = 0; board < BOARD_COUNT; board++) {
+        const CaptureScheduler& captures = boards[board].captures;
+        depth += captures.depth();
+        maxDepth = max(maxDepth, captures.maxDepth());
+        lagMs = max(lagMs, (unsigned long)captures.lagMs(millis()));
+        maxLagMs = max(maxLagMs, (unsigned long)captures.maxLagMs());
+        requested += captures.requested();
+        run += captures.run();
+        dropped += captures.dropped();
+    }
+    if (len < (int)sizeof(diag)) {
+        len += snprintf(diag + len, sizeof(diag) - len,
+                 ",\"captures\":{\"policy\":\"%s\",\"param\":%u,\"depth\":%d,\"lag_ms\":%lu,\"max_depth\":%d,"
+                 "\"max_lag_ms\":%lu,\"requested\":%lu,\"run\":%lu,\"dropped\":%lu},\"boards\":%d,\"ble\":\"%s\","
+                 "\"image_buffers\":%d",
+                 capturePolicyNames[first.policy()], first.policyParam(), depth, lagMs, maxDepth, maxLagMs, requested,
+                 run, dropped, BOARD_COUNT, BLE_STACK_NAME, IMAGE_BUFFER_COUNT);
+    }
+#if USE_FRAME_STORE
+    if (len < (int)sizeof(diag)) {
+        len += snprintf(diag + len, sizeof(diag) - len, ",\"store\":[%d,%lu,%lu]", frameStore.count(),
+                        (unsigned long)frameStore.stored(), (unsigned long)frameStore.evicted());
+    }
+#endif
+    if (len < (int)sizeof(diag)) {
+        len += snprintf(diag + len, sizeof(diag) - len, ",\"link\":\"%s\"", usbClientActive ? "usb" : "ble");
+    }
+#if USE_USB_CLIENT
+    if (len < (int)sizeof(diag)) {
+        len += snprintf(diag + len, sizeof(diag) - len, ",\"usb_errors\":%lu", (unsigned long)usbDecoder.errors());
+    }
+#endif
+    if (len < (int)sizeof(diag)) {
+        snprintf(diag + len, sizeof(diag) - len, "}");
+    }
+    debugSerial.printf("Diagnostics: %s\n", diag);
+    if (clientLink.connected()) {
+        notifyClientReport(diag); // About 450 bytes: chunked unless the MTU is large
+    }
+}
@@ -0,0 +1,312 @@
+#pragma once
+// Time-control engine for the chess clock.
+//
+// Game flow is a constexpr transition table over GameState; how time is charged and credited is
+// a policy (sudden death, Fischer, Bronstein, US delay, multi-period). Each policy's hooks are
+// instantiated into a constexpr table, and configure() picks the row once, so the steps don't
+// switch on the kind. Tested on a host by tools/time_control_test.cpp. Every step is O(1), takes
+// the current time as an argument and touches no heap, logging or hardware, so it can run from
+// the button interrupt and compiles on a host (no Arduino headers).
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum GameState : uint8_t { IDLE, RUNNING_P1, RUNNING_P2, GAME_OVER, GAME_STATE_COUNT };
+enum ClockEvent : uint8_t { EVENT_RESET, EVENT_P1_PRESS, EVENT_P2_PRESS, EVENT_FLAG, CLOCK_EVENT_COUNT };
+enum ClockAction : uint8_t { ACTION_NONE, ACTION_RESET, ACTION_START, ACTION_SWITCH, ACTION_FLAG };
+
+struct Transition {
+  GameState next;
+  ClockAction action;
+};
+
+// A player presses their button to end their own turn; pressing while idle starts the opponent's clock
+constexpr Transition transitionTable[GAME_STATE_COUNT][CLOCK_EVENT_COUNT] = {
+  //                EVENT_RESET             EVENT_P1_PRESS               EVENT_P2_PRESS               EVENT_FLAG
+  /* IDLE */       {{IDLE, ACTION_RESET},  {RUNNING_P2, ACTION_START},  {RUNNING_P1, ACTION_START},  {IDLE, ACTION_NONE}},
+  /* RUNNING_P1 */ {{IDLE, ACTION_RESET},  {RUNNING_P2, ACTION_SWITCH}, {RUNNING_P1, ACTION_NONE},   {GAME_OVER, ACTION_FLAG}},
+  /* RUNNING_P2 */ {{IDLE, ACTION_RESET},  {RUNNING_P2, ACTION_NONE},   {RUNNING_P1, ACTION_SWITCH}, {GAME_OVER, ACTION_FLAG}},
+  /* GAME_OVER */  {{IDLE, ACTION_RESET},  {GAME_OVER, ACTION_NONE},    {GAME_OVER, ACTION_NONE},    {GAME_OVER, ACTION_NONE}},
+};
+
+constexpr Transition nextTransition(GameState state, ClockEvent event) {
+  return transitionTable[state][event];
+}
+static_assert(nextTransition(IDLE, EVENT_P1_PRESS).next == RUNNING_P2, "P1 pressing at the start hands the move to P2");
+static_assert(nextTransition(RUNNING_P2, EVENT_P1_PRESS).action == ACTION_NONE, "Only the player on move can end the turn");
+static_assert(nextTransition(GAME_OVER, EVENT_FLAG).action == ACTION_NONE, "A finished game stays finished");
+
+// --- Configuration ---
+enum TimeControlKind : uint8_t {
+  TC_SUDDEN_DEATH, // Base time only
+  TC_FISCHER,      // incrementMs added after every move
+  TC_BRONSTEIN,    // Time used on a move is given back, up to incrementMs
+  TC_US_DELAY,     // The first incrementMs of every move is not charged
+  TC_PERIODS,      // Base time plus a bonus after a number of moves (and an optional Fischer increment)
+  TIME_CONTROL_KIND_COUNT
+};
+const char* const timeControlKindNames[TIME_CONTROL_KIND_COUNT] = {"SUDDEN", "FISCHER", "BRONSTEIN", "DELAY", "PERIODS"};
+
+const int MAX_EXTRA_PERIODS = 2;
+struct TimePeriod {
+  uint16_t afterMoves; // Moves a player must have completed for the bonus (0 = unused)
+  uint32_t bonusMs;
+};
+
+struct TimeControlConfig {
+  TimeControlKind kind;
+  uint32_t baseMs;
+  uint32_t incrementMs; // Increment or delay, depending on kind
+  TimePeriod periods[MAX_EXTRA_PERIODS];
+};
+
+constexpr TimeControlConfig DEFAULT_TIME_CONTROL = {TC_SUDDEN_DEATH, 9 * 60 * 1000UL, 0, {{0, 0}, {0, 0}}}; // 9 minutes
+
+// --- Policies ---
+// charge(): how much of `elapsedMs` comes off the clock, given `turnUsedMs` already spent on this move.
+// credit(): time given back when a player completes their `moves`-th move, having spent `turnUsedMs` on it.
+// uncharged(): how much more of the current move goes by before the clock starts counting down.
+struct SuddenDeath {
+  static uint32_t charge(uint32_t /*turnUsedMs*/, uint32_t elapsedMs, const TimeControlConfig& /*config*/) {
+    return elapsedMs;
+  }
+  static uint32_t uncharged(uint32_t /*turnUsedMs*/, const TimeControlConfig& /*config*/) {
+    return 0;
+  }
+  static uint32_t credit(uint32_t /*turnUsedMs*/, uint16_t /*moves*/, const TimeControlConfig& /*config*/) {
+    return 0;
+  }
+};
+
+struct FischerIncrement : SuddenDeath {
+  static uint32_t credit(uint32_t /*turnUsedMs*/, uint16_t /*moves*/, const TimeControlConfig& config) {
+    return config.incrementMs;
+  }
+};
+
+struct BronsteinDelay : SuddenDeath {
+  static uint32_t credit(uint32_t turnUsedMs, uint16_t /*moves*/, const TimeControlConfig& config) {
+    return (turnUsedMs < config.incrementMs) ? turnUsedMs : config.incrementMs;
+  }
+};
+
+struct UsDelay : SuddenDeath {
+  static uint32_t charge(uint32_t turnUsedMs, uint32_t elapsedMs, const TimeControlConfig& config) {
+    if (turnUsedMs >= config.incrementMs) {
+      return elapsedMs;
+    }
+    uint32_t delayLeft = config.incrementMs - turnUsedMs;
+    return (elapsedMs > delayLeft) ? elapsedMs - delayLeft : 0;
+  }
+  static uint32_t uncharged(uint32_t turnUsedMs, const TimeControlConfig& config) {
+    return (turnUsedMs < config.incrementMs) ? config.incrementMs - turnUsedMs : 0;
+  }
+};
+
+template <class Increment>
+struct MultiPeriod : Increment {
+  static uint32_t credit(uint32_t turnUsedMs, uint16_t moves, const TimeControlConfig& config) {
+    uint32_t bonus = Increment::credit(turnUsedMs, moves, config);
+    for (int i = 0; i < MAX_EXTRA_PERIODS; i++) {
+      if (config.periods[i].afterMoves != 0 && config.periods[i].afterMoves == moves) {
+        bonus += config.periods[i].bonusMs;
+      }
+    }
+    return bonus;
+  }
+};
+
+// Each policy's hooks, instantiated at compile time. The engine picks its row when it is
+// configured, so a step calls the policy directly instead of switching on the kind.
+struct TimeControlPolicy {
+  uint32_t (*charge)(uint32_t turnUsedMs, uint32_t elapsedMs, const TimeControlConfig& config);
+  uint32_t (*uncharged)(uint32_t turnUsedMs, const TimeControlConfig& config);
+  uint32_t (*credit)(uint32_t turnUsedMs, uint16_t moves, const TimeControlConfig& config);
+};
+
+template <class Policy>
+constexpr TimeControlPolicy makeTimeControlPolicy() {
+  return {&Policy::charge, &Policy::uncharged, &Policy::credit};
+}
+
+// Indexed by TimeControlKind
+constexpr TimeControlPolicy timeControlPolicies[TIME_CONTROL_KIND_COUNT] = {
+  makeTimeControlPolicy<SuddenDeath>(),
+  makeTimeControlPolicy<FischerIncrement>(),
+  makeTimeControlPolicy<BronsteinDelay>(),
+  makeTimeControlPolicy<UsDelay>(),
+  makeTimeControlPolicy<MultiPeriod<FischerIncrement>>(),
+};
+
+// --- Engine ---
+// What a step did, with the clock values right after it (for the BLE update and logging). The
+// values plus running/atMs/delayMs are an anchor a client can count down from on its own:
+// remaining(t) = pMs - max(0, t - atMs - delayMs) for the running player.
+struct ClockTransition {
+  ClockAction action;
+  uint8_t player;   // START: the player who pressed; SWITCH: whose turn ended; FLAG: who ran out
+  uint8_t running;  // Player whose clock runs after the step (0 = none)
+  uint32_t p1Ms;
+  uint32_t p2Ms;
+  uint32_t atMs;    // Time the values are valid at
+  uint32_t delayMs; // Part of the running player's move still not charged at atMs (US delay)
+};
+
+class TimeControl {
+public:
+  explicit TimeControl(const TimeControlConfig& config = DEFAULT_TIME_CONTROL)
+      : config_(config), policy_(&policyFor(config)) {
+    resetClocks();
+  }
+
+  // Replaces the time control and resets the game. Refused (false) while a game is running.
+  bool configure(const TimeControlConfig& config) {
+    if (isRunning()) {
+      return false;
+    }
+    config_ = config;
+    policy_ = &policyFor(config);
+    state_ = IDLE;
+    resetClocks();
+    return true;
+  }
+
+  // Brings the running clock up to nowMs; returns ACTION_FLAG if it ran out.
+  ClockTransition tick(uint32_t nowMs) {
+    if (!isRunning()) {
+      return transitionResult(ACTION_NONE, 0, nowMs);
+    }
+    uint8_t running = runningPlayer();
+    uint32_t elapsedMs = nowMs - lastTickMs_; // Unsigned: correct across millis() wrap
+    lastTickMs_ = nowMs;
+    uint32_t chargedMs = charge(turnUsedMs_, elapsedMs);
+    turnUsedMs_ += elapsedMs;
+    if (remainingMs_[running - 1] <= chargedMs) {
+      remainingMs_[running - 1] = 0;
+      state_ = nextTransition(state_, EVENT_FLAG).next;
+      return transitionResult(ACTION_FLAG, running, nowMs);
+    }
+    remainingMs_[running - 1] -= chargedMs;
+    return transitionResult(ACTION_NONE, 0, nowMs);
+  }
+
+  // Applies a button event at nowMs. The running clock is charged up to nowMs first, so a press
+  // after the flag fell reports the flag instead.
+  ClockTransition handle(ClockEvent event, uint32_t nowMs) {
+    ClockTransition flagged = tick(nowMs);
+    if (flagged.action == ACTION_FLAG && event != EVENT_RESET) {
+      return flagged;
+    }
+    Transition t = nextTransition(state_, event);
+    uint8_t player = (event == EVENT_P1_PRESS) ? 1 : (event == EVENT_P2_PRESS) ? 2 : 0;
+    switch (t.action) {
+      case ACTION_RESET:
+        resetClocks();
+        break;
+      case ACTION_START:
+        turnUsedMs_ = 0;
+        lastTickMs_ = nowMs;
+        break;
+      case ACTION_SWITCH:
+        movesMade_[player - 1]++;
+        remainingMs_[player - 1] += credit(turnUsedMs_, movesMade_[player - 1]);
+        turnUsedMs_ = 0;
+        lastTickMs_ = nowMs;
+        break;
+      case ACTION_FLAG:
+      case ACTION_NONE:
+        break;
+    }
+    state_ = t.next;
+    return transitionResult(t.action, player, nowMs);
+  }
+
+  GameState state() const { return state_; }
+  bool isRunning() const { return state_ == RUNNING_P1 || state_ == RUNNING_P2; }
+  uint32_t remainingMs(int player) const { return remainingMs_[player - 1]; }
+  uint16_t movesMade(int player) const { return movesMade_[player - 1]; }
+  const TimeControlConfig& config() const { return config_; }
+
+private:
+  uint8_t runningPlayer() const { return (state_ == RUNNING_P1) ? 1 : 2; }
+
+  void resetClocks() {
+    remainingMs_[0] = remainingMs_[1] = config_.baseMs;
+    movesMade_[0] = movesMade_[1] = 0;
+    turnUsedMs_ = 0;
+  }
+
+  ClockTransition transitionResult(ClockAction action, uint8_t player, uint32_t nowMs) const {
+    uint8_t running = isRunning() ? runningPlayer() : 0;
+    return {action, player, running, remainingMs_[0], remainingMs_[1], nowMs, running ? uncharged(turnUsedMs_) : 0};
+  }
+
+  static const TimeControlPolicy& policyFor(const TimeControlConfig& config) {
+    return timeControlPolicies[config.kind < TIME_CONTROL_KIND_COUNT ? config.kind : TC_SUDDEN_DEATH];
+  }
+
+  uint32_t charge(uint32_t turnUsedMs, uint32_t elapsedMs) const { return policy_->charge(turnUsedMs, elapsedMs, config_); }
+  uint32_t uncharged(uint32_t turnUsedMs) const { return policy_->uncharged(turnUsedMs, config_); }
+  uint32_t credit(uint32_t turnUsedMs, uint16_t moves) const { return policy_->credit(turnUsedMs, moves, config_); }
+
+  TimeControlConfig config_;
+  const TimeControlPolicy* policy_;
+  GameState state_ = IDLE;
+  uint32_t remainingMs_[2];
+  uint16_t movesMade_[2];
+  uint32_t turnUsedMs_;  // Time spent on the current move so far (for delays)
+  uint32_t lastTickMs_ = 0;
+};
+
+// --- Parse "<kind>,<base_ms>[,<increment_ms>[,<moves>,<bonus_ms>[,<moves>,<bonus_ms>]]]" ---
+// e.g. "FISCHER,180000,2000" (3+2) or "PERIODS,5400000,30000,40,1800000" (90 min/40 moves + 30 min, 30 s/move).
+// Moves are counted per player; a period bonus is added when that player completes that many moves.
+inline bool parseTimeControl(const char* text, TimeControlConfig* out) {
+  TimeControlConfig config = {TC_SUDDEN_DEATH, 0, 0, {{0, 0}, {0, 0}}};
+  const char* comma = strchr(text, ',');
+  if (comma == nullptr) {
+    return false;
+  }
+  size_t kindLen = comma - text;
+  int kind = 0;
+  while (kind < TIME_CONTROL_KIND_COUNT &&
+         !(strlen(timeControlKindNames[kind]) == kindLen && strncmp(text, timeControlKindNames[kind], kindLen) == 0)) {
+    kind++;
+  }
+  if (kind == TIME_CONTROL_KIND_COUNT) {
+    return false;
+  }
+  config.kind = (TimeControlKind)kind;
+
+  uint32_t values[2 + 2 * MAX_EXTRA_PERIODS] = {0};
+  int count = 0;
+  const char* p = comma + 1;
+  while (true) {
+    if (count == (int)(sizeof(values) / sizeof(values[0]))) {
+      return false; // More values than the format has
+    }
+    char* end;
+    values[count++] = strtoul(p, &end, 10);
+    if (end == p) {
+      return false;
+    }
+    if (*end != ',') {
+      if (*end != '\0') {
+        return false;
+      }
+      break;
+    }
+    p = end + 1;
+  }
+  config.baseMs = values[0];
+  config.incrementMs = values[1];
+  for (int i = 0; i < MAX_EXTRA_PERIODS; i++) {
+    config.periods[i].afterMoves = (uint16_t)values[2 + 2 * i];
+    config.periods[i].bonusMs = values[3 + 2 * i];
+  }
+  if (config.baseMs == 0 || (config.kind == TC_PERIODS && config.periods[0].afterMoves == 0)) {
+    return false;
+  }
+  *out = config;
+  return true;
+}
@@ -0,0 +1,106 @@
+#pragma once
+// Framing of the wired client link on the hub's USB UART (Serial), an alternative to BLE.
+//
+//   0xC5 | channel u8 | len u16 LE | payload | crc u16 LE
+//
+// The CRC is CRC-16/CCITT-FALSE over channel, len and payload. Channels:
+//   USB_CH_CLIENT  hub -> PC: exactly what would be one BLE notification (state JSON, image markers,
+//                  raw chunks); PC -> hub: one command, as written to the characteristic
+//   USB_CH_DEBUG   hub -> PC: log text, cut anywhere (the client joins it into lines)
+//   USB_CH_LINK    PC -> hub: "HELLO", "PING" (at least every USB_CLIENT_TIMEOUT_MS), "BYE";
+//                  hub -> PC: "READY:<max_payload>" after HELLO
+// A payload may contain 0xC5; after a bad frame the decoder looks for the next 0xC5 after it (the
+// CRC catches a false start). No Arduino dependencies; tools/usb_link_bench.cpp and tools/usb_client.py
+// speak the same format.
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+const uint8_t USB_FRAME_SYNC = 0xC5;
+const size_t USB_FRAME_HEADER = 4;
+const size_t USB_FRAME_OVERHEAD = USB_FRAME_HEADER + 2;
+const size_t USB_MAX_PAYLOAD = 1024; // Image chunk size on the wired link
+const unsigned long USB_CLIENT_TIMEOUT_MS = 5000;
+
+enum UsbChannel : uint8_t { USB_CH_CLIENT = 0, USB_CH_DEBUG = 1, USB_CH_LINK = 2 };
+
+inline uint16_t crc16Ccitt(uint16_t crc, const uint8_t* data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+// --- Writes a whole frame to out (len + USB_FRAME_OVERHEAD bytes); returns its size ---
+inline size_t encodeUsbFrame(uint8_t channel, const uint8_t* payload, size_t len, uint8_t* out) {
+  out[0] = USB_FRAME_SYNC;
+  out[1] = channel;
+  out[2] = (uint8_t)(len & 0xFF);
+  out[3] = (uint8_t)(len >> 8);
+  memcpy(out + USB_FRAME_HEADER, payload, len);
+  uint16_t crc = crc16Ccitt(0xFFFF, out + 1, len + USB_FRAME_HEADER - 1);
+  out[USB_FRAME_HEADER + len] = (uint8_t)(crc & 0xFF);
+  out[USB_FRAME_HEADER + len + 1] = (uint8_t)(crc >> 8);
+  return len + USB_FRAME_OVERHEAD;
+}
+
+// Byte-fed frame decoder; frames with more than N payload bytes are dropped as errors
+template <size_t N>
+class UsbFrameDecoder {
+public:
+  // Returns true when a frame is complete (see channel(), payload(), length())
+  bool feed(uint8_t byte) {
+    if (pos_ == 0) {
+      if (byte == USB_FRAME_SYNC) {
+        pos_ = 1;
+      }
+      return false;
+    }
+    if (pos_ < USB_FRAME_HEADER) {
+      header_[pos_++] = byte;
+      if (pos_ == USB_FRAME_HEADER) {
+        len_ = header_[2] | ((size_t)header_[3] << 8);
+        if (len_ > N) {
+          errors_++;
+          pos_ = 0;
+        }
+      }
+      return false;
+    }
+    size_t index = pos_ - USB_FRAME_HEADER;
+    pos_++;
+    if (index < len_) {
+      payload_[index] = byte;
+      return false;
+    }
+    if (index == len_) {
+      crc_ = byte;
+      return false;
+    }
+    crc_ |= (uint16_t)byte << 8;
+    pos_ = 0;
+    uint16_t crc = crc16Ccitt(0xFFFF, header_ + 1, USB_FRAME_HEADER - 1);
+    if (crc16Ccitt(crc, payload_, len_) != crc_) {
+      errors_++;
+      return false;
+    }
+    payload_[len_] = '\0'; // Commands are text
+    return true;
+  }
+
+  uint8_t channel() const { return header_[1]; }
+  const uint8_t* payload() const { return payload_; }
+  size_t length() const { return len_; }
+  uint32_t errors() const { return errors_; }
+
+private:
+  uint8_t header_[USB_FRAME_HEADER] = {};
+  uint8_t payload_[N + 1];
+  size_t pos_ = 0; // Bytes of the current frame so far (0 = looking for the sync byte)
+  size_t len_ = 0;
+  uint16_t crc_ = 0;
+  uint32_t errors_ = 0;
+};
@@ -0,0 +1,105 @@
+#pragma once
+// In-process stand-in for the hub's BLE link (see src/devkit_hub/ble_transport.h), on a virtual clock.
+//
+// Models what limits notification throughput on a real connection: the ATT MTU, the connection
+// interval, how many packets the controller sends per connection event, link-layer loss (a lost
+// packet is retransmitted in the next slot, delaying everything behind it), the stack's TX buffer
+// count (a notification that finds it full is dropped, like Bluedroid does when congested; one longer than
+// the MTU is truncated) and the host CPU time of one notify() call.
+#include <deque>
+#include <random>
+
+#include "ble_transport.h"
+
+struct LinkModel {
+  const char* name;
+  size_t attMtu;
+  double connIntervalMs;
+  int packetsPerEvent;
+  double lossRate;     // Per packet, per attempt
+  size_t txBuffers;    // Notifications the stack can hold
+  double notifyCostMs; // Host time spent in one notify()
+};
+
+class LoopbackTransport : public ClientTransport {
+public:
+  explicit LoopbackTransport(const LinkModel& model, unsigned seed = 1) : model_(model), rng_(seed) {}
+
+  using ClientTransport::notify;
+
+  bool connected() override { return true; }
+  size_t maxPayload() override { return model_.attMtu - 3; }
+
+  bool notify(const uint8_t* /*data*/, size_t len) override {
+    advance(model_.notifyCostMs);
+    if (queue_.size() >= model_.txBuffers) {
+      dropped_++;
+      return false;
+    }
+    if (len > maxPayload()) {
+      truncated_++; // The stack cuts the value to the MTU
+      len = maxPayload();
+    }
+    queue_.push_back(len);
+    queued_ += len;
+    return true;
+  }
+
+  int sendableCount() override { return (int)(model_.txBuffers - queue_.size()); }
+
+  void wait(unsigned long ms) override { advance((double)ms); }
+
+  // Runs the link until everything queued is delivered
+  void drain() {
+    while (!queue_.empty()) {
+      advance(model_.connIntervalMs);
+    }
+  }
+
+  double nowMs() const { return nowMs_; }
+  double lastDeliveryMs() const { return lastDeliveryMs_; }
+  size_t deliveredBytes() const { return delivered_; }
+  size_t deliveredPackets() const { return packets_; }
+  size_t droppedNotifications() const { return dropped_; }
+  size_t truncatedNotifications() const { return truncated_; }
+  size_t retransmissions() const { return retransmissions_; }
+
+private:
+  // Moves the virtual clock forward, running the connection events that fall in between
+  void advance(double ms) {
+    double target = nowMs_ + ms;
+    while (nextEventMs_ <= target) {
+      nowMs_ = nextEventMs_;
+      connectionEvent();
+      nextEventMs_ += model_.connIntervalMs;
+    }
+    nowMs_ = target;
+  }
+
+  void connectionEvent() {
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    for (int slot = 0; slot < model_.packetsPerEvent && !queue_.empty(); slot++) {
+      if (chance(rng_) < model_.lossRate) {
+        retransmissions_++; // Not acknowledged; the same packet goes again in the next slot
+        continue;
+      }
+      delivered_ += queue_.front();
+      packets_++;
+      queue_.pop_front();
+      lastDeliveryMs_ = nowMs_;
+    }
+  }
+
+  LinkModel model_;
+  std::mt19937 rng_;
+  std::deque<size_t> queue_;
+  double nowMs_ = 0;
+  double nextEventMs_ = 0;
+  double lastDeliveryMs_ = 0;
+  size_t queued_ = 0;
+  size_t delivered_ = 0;
+  size_t packets_ = 0;
+  size_t dropped_ = 0;
+  size_t truncated_ = 0;
+  size_t retransmissions_ = 0;
+};
@@ -0,0 +1,95 @@
+// Chunking/pacing benchmark for the hub's BLE image path, on the loopback link model (ble_loopback.h).
+//
+//   g++ -std=c++17 -O2 -Isrc/devkit_hub -Itools tools/ble_transport_bench.cpp -o ble_transport_bench
+//   ./ble_transport_bench [--loss 0.02] [--tx-buffers 10]
+//
+// Each frame is sent the way the hub does it: start marker, 20 ms pause, then pumpChunks() once per
+// loop() pass (1 ms apart) and the end marker. Reports delivery time (first marker to last packet
+// delivered), goodput, notifications the stack refused and markers it truncated to the MTU. On the
+// hub a refused notification is a lost chunk, since BLECharacteristic::notify() can't report
+// congestion, so only strategies with 0 refused are safe.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "ble_loopback.h"
+
+struct Strategy {
+  const char* name;
+  ChunkPacing pacing;
+};
+
+struct Result {
+  double deliveryMs;
+  double goodput;
+  size_t refused;
+  size_t truncated;
+  size_t retransmissions;
+};
+
+static Result sendFrame(const LinkModel& link, const ChunkPacing& pacing, size_t frameSize) {
+  static uint8_t frame[32 * 1024];
+  LoopbackTransport transport(link);
+  transport.notify("{\"type\":\"image_start\",\"size\":12345,\"sharpness\":200,\"settle_ms\":400,\"settle_timeout\":0,"
+                   "\"frame\":\"key\",\"id\":1}");
+  transport.wait(20);
+  ChunkTransfer transfer = {frame, frameSize, 0, true};
+  while (!pumpChunks(transport, transfer, pacing)) {
+    transport.wait(1); // delay(1) at the end of loop()
+  }
+  waitForCredit(transport, pacing);
+  transport.notify("{\"type\":\"image_end\"}");
+  transport.drain();
+  Result result;
+  result.deliveryMs = transport.lastDeliveryMs();
+  result.goodput = frameSize / (result.deliveryMs / 1000.0);
+  result.refused = transport.droppedNotifications();
+  result.truncated = transport.truncatedNotifications();
+  result.retransmissions = transport.retransmissions();
+  return result;
+}
+
+int main(int argc, char** argv) {
+  double loss = 0.0;
+  size_t txBuffers = 10;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--loss") == 0 && i + 1 < argc) loss = atof(argv[++i]);
+    else if (strcmp(argv[i], "--tx-buffers") == 0 && i + 1 < argc) txBuffers = atoi(argv[++i]);
+    else {
+      fprintf(stderr, "usage: %s [--loss <rate>] [--tx-buffers <n>]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  // Typical connections the app gets: default MTU with a relaxed interval, iOS (MTU 185, 15 ms),
+  // and Android after an MTU request with a fast interval
+  const LinkModel links[] = {
+    {"MTU 23, 30 ms, 4 pkt/event", 23, 30.0, 4, loss, txBuffers, 0.3},
+    {"MTU 185, 15 ms, 4 pkt/event", 185, 15.0, 4, loss, txBuffers, 0.3},
+    {"MTU 247, 7.5 ms, 6 pkt/event", 247, 7.5, 6, loss, txBuffers, 0.3},
+  };
+  const Strategy strategies[] = {
+    {"20 B, 5 ms delay, 4/pass (hub default)", {20, 5, 4, false}},
+    {"20 B, no delay, burst", {20, 0, 0, false}},
+    {"20 B, credit-paced, 8/pass", {20, 0, 8, true}},
+    {"MTU, 5 ms delay, 4/pass", {0, 5, 4, false}},
+    {"MTU, 1 ms delay, 4/pass", {0, 1, 4, false}},
+    {"MTU, credit-paced, 8/pass", {0, 0, 8, true}},
+  };
+  // Preview thumbnail, typical and large QVGA JPEGs, packed tile grid
+  const size_t frameSizes[] = {1100, 8000, 12000, 6600};
+
+  for (const LinkModel& link : links) {
+    printf("\n== %s, loss %.3f, %zu TX buffers ==\n", link.name, link.lossRate, link.txBuffers);
+    printf("%-40s %8s %10s %10s %8s %6s %8s\n", "strategy", "bytes", "time ms", "goodput", "refused", "trunc", "retrans");
+    for (const Strategy& strategy : strategies) {
+      for (size_t frameSize : frameSizes) {
+        Result r = sendFrame(link, strategy.pacing, frameSize);
+        printf("%-40s %8zu %10.0f %8.0f/s %8zu %6zu %8zu\n", strategy.name, frameSize, r.deliveryMs, r.goodput,
+               r.refused, r.truncated, r.retransmissions);
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,211 @@
+"""
+Accuracy and speed check of the coarse-to-fine board corner search (vision/board_detector.py).
+
+Runs find_board_corners() three ways: the full-resolution contour search (levels=0, the default),
+the pyramid search with corners just scaled up (refine=False), and the pyramid search with sub-pixel
+refinement (levels=None). Two inputs:
+
+  * Synthetic boards with known corners, warped into frames of --sizes with random perspective,
+    blur and noise: per mode the boards found (every corner within SAME_BOARD_PX of the truth),
+    the wrong quadrilaterals returned, and the mean/max corner error of the boards found.
+  * The debug image corpus (*_00_original.png in vision/debug_images): boards found per mode, and
+    for frames where the pyramid and full-resolution searches find the same board, how far the
+    corners are apart. There is no ground truth for these frames, so every frame where the two
+    searches disagree (different boards, or only one finds one) is listed by name; --overlays
+    writes those frames with both results drawn (full resolution red, pyramid green) for review.
+
+Also reports the median detection time per frame of each mode:
+
+    python tools/board_corner_check.py --synthetic 200 --sizes 320x240 640x480 --overlays /tmp/corners
+
+Exits with status 1 if the searches return different boards on a corpus frame, or the refined
+pyramid search returns more wrong synthetic boards than the full-resolution one.
+"""
+import argparse
+import contextlib
+import glob
+import os
+import shutil
+import sys
+import tempfile
+import time
+
+import cv2
+import numpy as np
+
+project_root = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
+sys.path.insert(0, project_root)
+
+from vision import board_detector
+from vision.board_detector import find_board_corners, order_points
+
+DEFAULT_CORPUS = os.path.join(project_root, 'vision', 'debug_images')
+MODES = {'full_res': {'levels': 0}, 'pyramid': {'levels': None, 'refine': False},
+         'pyramid_refined': {'levels': None}}
+SAME_BOARD_PX = 12.0  # Corners further apart than this belong to a different contour, not the same board
+
+
+def synthetic_frame(rng: np.random.Generator, size: tuple[int, int]) -> tuple[np.ndarray, np.ndarray]:
+    """A board with a dark frame on a light table under random perspective; returns (image, true corners)."""
+    w, h = size
+    side = 800
+    board = np.full((side, side), 95, np.uint8)  # Frame of the board
+    margin, square = side // 16, (side - 2 * (side // 16)) // 8
+    for row in range(8):
+        for col in range(8):
+            y, x = margin + row * square, margin + col * square
+            board[y:y + square, x:x + square] = 225 if (row + col) % 2 == 0 else 125
+
+    # Random convex quadrilateral covering 45-85% of the frame width
+    cx, cy = w * rng.uniform(0.4, 0.6), h * rng.uniform(0.4, 0.6)
+    half = min(w, h) * rng.uniform(0.3, 0.45)
+    angle = rng.uniform(-0.25, 0.25)
+    base = np.array([[-1, -1], [1, -1], [1, 1], [-1, 1]], np.float64) * half
+    base += rng.uniform(-0.15, 0.15, base.shape) * half  # Perspective-like distortion
+    rotation = np.array([[np.cos(angle), -np.sin(angle)], [np.sin(angle), np.cos(angle)]])
+    corners = (base @ rotation.T + [cx, cy]).astype(np.float32)
+
+    src = np.array([[0, 0], [side, 0], [side, side], [0, side]], np.float32)
+    M = cv2.getPerspectiveTransform(src, corners)
+    # Warp at 4x and downsample for anti-aliased edges
+    M4 = np.diag([4.0, 4.0, 1.0]) @ M
+    big = cv2.warpPerspective(board, M4, (4 * w, 4 * h), flags=cv2.INTER_LINEAR, borderValue=200)
+    mask = cv2.warpPerspective(np.full_like(board, 255), M4, (4 * w, 4 * h), flags=cv2.INTER_LINEAR)
+    table = np.full_like(big, 200)
+    big = np.where(mask > 127, big, table)
+    image = cv2.resize(big, (w, h), interpolation=cv2.INTER_AREA).astype(np.float32)
+    image = cv2.GaussianBlur(image, (0, 0), rng.uniform(0.5, 1.2))
+    image += rng.normal(0, rng.uniform(2, 6), image.shape)
+    image = np.clip(image, 0, 255).astype(np.uint8)
+    # Pixel centers: corner (x, y) of the continuous image is at (x - 0.5, y - 0.5) in pixel coordinates
+    return cv2.cvtColor(image, cv2.COLOR_GRAY2BGR), order_points(corners) - 0.5
+
+
+def detect(image: np.ndarray, options: dict) -> tuple[np.ndarray | None, float]:
+    with open(os.devnull, 'w') as devnull, contextlib.redirect_stdout(devnull):  # The detector logs every attempt
+        start = time.perf_counter()
+        corners = find_board_corners(image, **options)
+        elapsed = time.perf_counter() - start
+    return (None if corners is None else order_points(corners)), elapsed
+
+
+def check_synthetic(count: int, sizes: list[tuple[int, int]], seed: int) -> bool:
+    """Returns False if the refined pyramid search returned more wrong boards than the full-resolution one."""
+    rng = np.random.default_rng(seed)
+    ok = True
+    for size in sizes:
+        errors = {mode: [] for mode in MODES}
+        times = {mode: [] for mode in MODES}
+        found = {mode: 0 for mode in MODES}
+        wrong = {mode: 0 for mode in MODES}
+        for _ in range(count):
+            image, truth = synthetic_frame(rng, size)
+            for mode, options in MODES.items():
+                corners, elapsed = detect(image, options)
+                times[mode].append(elapsed)
+                if corners is not None:
+                    error = np.linalg.norm(corners - truth, axis=1)
+                    if error.max() > SAME_BOARD_PX:
+                        wrong[mode] += 1
+                    else:
+                        found[mode] += 1
+                        errors[mode].extend(error)
+        print(f"Synthetic {size[0]}x{size[1]}, {count} frames (pyramid levels: "
+              f"{board_detector.pyramid_levels((size[1], size[0]))})")
+        print_table(found, count, times, errors, 'error px', wrong)
+        ok = ok and wrong['pyramid_refined'] <= wrong['full_res']
+    return ok
+
+
+def check_corpus(corpus_dir: str, overlay_dir: str | None) -> bool:
+    """Returns False if the pyramid and full-resolution searches return different boards on any frame."""
+    paths = sorted(glob.glob(os.path.join(corpus_dir, '*_00_original.png')))
+    if not paths:
+        print(f"No *_00_original.png images in {corpus_dir}")
+        return True
+    results = {mode: [] for mode in MODES}
+    times = {mode: [] for mode in MODES}
+    images = []
+    for path in paths:
+        image = cv2.imread(path, cv2.IMREAD_COLOR)
+        images.append(image)
+        for mode, options in MODES.items():
+            corners, elapsed = detect(image, options)
+            results[mode].append(corners)
+            times[mode].append(elapsed)
+    found = {mode: sum(c is not None for c in results[mode]) for mode in MODES}
+    distances = {mode: [] for mode in MODES}
+    disputed = {'different board': [], 'full resolution only': [], 'pyramid only': []}
+    for i, (reference, pyramid) in enumerate(zip(results['full_res'], results['pyramid_refined'])):
+        if reference is None and pyramid is None:
+            continue
+        if pyramid is None:
+            disputed['full resolution only'].append(i)
+            continue
+        if reference is None:
+            disputed['pyramid only'].append(i)
+            continue
+        if np.linalg.norm(pyramid - reference, axis=1).max() > SAME_BOARD_PX:
+            disputed['different board'].append(i)
+            continue
+        for mode in MODES:
+            if results[mode][i] is not None:
+                distances[mode].extend(np.linalg.norm(results[mode][i] - reference, axis=1))
+    same = len(distances['full_res']) // 4
+    print(f"Corpus, {len(paths)} frames; {same} where pyramid and full resolution found the same board")
+    print_table(found, len(paths), times, distances, 'px from full-res')
+    for reason, frames in disputed.items():
+        if frames:
+            names = ', '.join(os.path.basename(paths[i]).replace('_00_original.png', '') for i in frames)
+            print(f"  {reason} ({len(frames)}): {names}")
+    if overlay_dir:
+        os.makedirs(overlay_dir, exist_ok=True)
+        for i in sorted(sum(disputed.values(), [])):
+            overlay = images[i].copy()
+            for mode, color in (('full_res', (0, 0, 255)), ('pyramid_refined', (0, 255, 0))):
+                if results[mode][i] is not None:
+                    cv2.polylines(overlay, [np.rint(results[mode][i]).astype(np.int32)], True, color, 1)
+            cv2.imwrite(os.path.join(overlay_dir, os.path.basename(paths[i])), overlay)
+        print(f"  Overlays of the disputed frames in {overlay_dir} (full resolution red, pyramid green)")
+    return not disputed['different board']
+
+
+def print_table(found: dict, total: int, times: dict, errors: dict, error_label: str, wrong: dict | None = None):
+    print(f"  {'mode':<18}{'found':>8}{'wrong':>7}{'median ms':>11}{'mean ' + error_label:>22}{'max':>8}")
+    for mode in MODES:
+        e = errors[mode]
+        mean = f"{np.mean(e):.2f}" if e else '-'
+        worst = f"{np.max(e):.2f}" if e else '-'
+        wrong_count = str(wrong[mode]) if wrong else '-'
+        print(f"  {mode:<18}{found[mode]:>4}/{total:<3}{wrong_count:>7}{1000 * np.median(times[mode]):>11.3f}"
+              f"{mean:>22}{worst:>8}")
+
+
+def parse_size(text: str) -> tuple[int, int]:
+    w, h = text.lower().split('x')
+    return int(w), int(h)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Check corner accuracy and speed of the coarse-to-fine board search.")
+    parser.add_argument('--corpus', default=DEFAULT_CORPUS, help="Directory with *_00_original.png images")
+    parser.add_argument('--synthetic', type=int, default=100, help="Synthetic frames per size (0: skip)")
+    parser.add_argument('--sizes', type=parse_size, nargs='+', default=[(320, 240), (640, 480)],
+                        help="Synthetic frame sizes, WxH")
+    parser.add_argument('--seed', type=int, default=0, help="Random seed for the synthetic frames")
+    parser.add_argument('--overlays', default=None, help="Write the disputed corpus frames with both results here")
+    args = parser.parse_args()
+
+    debug_dir = tempfile.mkdtemp(prefix='board_corner_check_')
+    board_detector.DEBUG_IMAGE_DIR = debug_dir  # Failure images of the detector, not the corpus
+    try:
+        ok = check_synthetic(args.synthetic, args.sizes, args.seed) if args.synthetic else True
+        ok = check_corpus(args.corpus, args.overlays) and ok
+    finally:
+        shutil.rmtree(debug_dir, ignore_errors=True)
+    if not ok:
+        print("The pyramid search returns different boards than the full-resolution search", file=sys.stderr)
+        sys.exit(1)
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,152 @@
+"""
+Checks the CAM's calibrated tile mode (vision/board_tiles.py) against /analyze on the debug corpus.
+
+Every *_00_original.png in vision/debug_images is treated as a QVGA CAM frame: JPEG-encoded as the
+CAM sends it and decoded again. Each frame then takes two paths to the classifier input:
+
+  * /analyze: find_and_warp_board() at 400 px, split_board_into_squares(), resize_square().
+  * Tile mode: the homography /calibrate returns for the frame, the CAM's warp to 8*tile_px (the
+    same bilinear inverse mapping), pack_tiles() / unpack_tiles() with the CAM's JPEG quality,
+    resize_square().
+
+Reports the payload size against the whole JPEG frame, and the mean absolute difference of the
+model inputs (0-255) per square. With a model (--weights needs TensorFlow, --tflite a TFLite
+interpreter) it also reports how often the tile mode gives the same class as /analyze:
+
+    python tools/board_tiles_check.py --weights models/model_weights.h5
+
+Exits with status 1 if the agreement is below --min-agreement.
+"""
+import argparse
+import contextlib
+import glob
+import os
+import shutil
+import sys
+import tempfile
+
+import cv2
+import numpy as np
+
+project_root = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
+sys.path.insert(0, project_root)
+
+from vision import board_detector, piece_recognizer
+from vision.board_detector import find_and_warp_board, find_board_corners, split_board_into_squares
+from vision.board_tiles import DEFAULT_TILE_PX, compute_tile_homography, pack_tiles, unpack_tiles
+from vision.piece_recognizer import CLASS_MAP, resize_square
+
+DEFAULT_CORPUS = os.path.join(project_root, 'vision', 'debug_images')
+FRAME_SIZE = (320, 240)  # QVGA, as the CAM sends it
+BOARD_SIZE = 400         # find_and_warp_board() output
+
+
+def cam_tiles(frame: np.ndarray, corners: np.ndarray, tile_px: int, quality: int) -> bytes:
+    """The tile grid the CAM sends for this frame once calibrated on these corners."""
+    H = compute_tile_homography(corners, tile_px)
+    side = 8 * tile_px
+    # H maps board pixels to frame pixels, as the CAM samples them
+    board = cv2.warpPerspective(frame, H, (side, side), flags=cv2.INTER_LINEAR | cv2.WARP_INVERSE_MAP)
+    return pack_tiles(board, tile_px, quality)
+
+
+def corpus_inputs(corpus_dir: str, frame_quality: int, tile_px: int, tile_quality: int):
+    """
+    Model inputs of both paths for every corpus frame with a board.
+
+    Returns:
+        (analyze squares, tile squares, frame JPEG sizes, tile payload sizes, frames, frames with a board);
+        the squares are uint8 arrays of shape (N,) + MODEL_INPUT_SHAPE in the same order.
+    """
+    paths = sorted(glob.glob(os.path.join(corpus_dir, '*_00_original.png')))
+    if not paths:
+        raise SystemExit(f"No *_00_original.png images in {corpus_dir}")
+    analyze, tiles, frame_bytes, tile_bytes = [], [], [], []
+    boards = 0
+    with open(os.devnull, 'w') as devnull, contextlib.redirect_stdout(devnull):  # The detector logs every attempt
+        for path in paths:
+            image = cv2.imread(path, cv2.IMREAD_COLOR)
+            if image is None:
+                continue
+            _, jpeg = cv2.imencode('.jpg', cv2.resize(image, FRAME_SIZE, interpolation=cv2.INTER_AREA),
+                                   [cv2.IMWRITE_JPEG_QUALITY, frame_quality])
+            frame = cv2.imdecode(jpeg, cv2.IMREAD_COLOR)
+            corners = find_board_corners(frame)
+            warped = find_and_warp_board(frame, BOARD_SIZE)
+            if corners is None or warped is None:
+                continue  # Neither /analyze nor /calibrate has a board to work with
+            boards += 1
+            payload = cam_tiles(frame, corners, tile_px, tile_quality)
+            analyze.extend(resize_square(sq) for sq in split_board_into_squares(warped))
+            tiles.extend(resize_square(sq) for sq in unpack_tiles(payload))
+            frame_bytes.append(len(jpeg))
+            tile_bytes.append(len(payload))
+    if not boards:
+        raise SystemExit(f"No board found in any frame of {corpus_dir}")
+    return np.stack(analyze), np.stack(tiles), frame_bytes, tile_bytes, len(paths), boards
+
+
+def load_model(weights: str | None, tflite: str | None) -> bool:
+    """Loads the classifier classify_batch() runs; False if there is none."""
+    with contextlib.redirect_stdout(sys.stderr):
+        if tflite:
+            piece_recognizer.load_tflite_model(tflite)
+            return piece_recognizer.tflite_interpreter is not None
+        if weights:
+            piece_recognizer.load_model_weights(weights)
+            return piece_recognizer.piece_classifier_model is not None
+    return False
+
+
+def classes(batch: np.ndarray) -> np.ndarray:
+    """Class index per square, in boards of 64 like the server's calls."""
+    names = {symbol: index for index, symbol in CLASS_MAP.items()}
+    results = []
+    for i in range(0, len(batch), 64):
+        results.extend(names.get(symbol, -1) for symbol, _ in piece_recognizer.classify_batch(batch[i:i + 64]))
+    return np.array(results)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare the CAM's tile mode with /analyze on the debug corpus.")
+    parser.add_argument('--corpus', default=DEFAULT_CORPUS, help="Directory with *_00_original.png images")
+    parser.add_argument('--tile-px', type=int, default=DEFAULT_TILE_PX, help="Tile size (TILE_PX on the CAM)")
+    parser.add_argument('--tile-quality', type=int, default=60, help="JPEG quality of the tile grid (TILE_JPEG_QUALITY)")
+    parser.add_argument('--frame-quality', type=int, default=60, help="JPEG quality of the CAM frames (0-100)")
+    parser.add_argument('--weights', default=None, help="Keras weights of the float model (needs TensorFlow)")
+    parser.add_argument('--tflite', default=None, help="Quantized model from tools/export_tflite.py")
+    parser.add_argument('--min-agreement', type=float, default=0.95, help="Required top-1 agreement with /analyze")
+    args = parser.parse_args()
+
+    debug_dir = tempfile.mkdtemp(prefix='board_tiles_check_')
+    board_detector.DEBUG_IMAGE_DIR = debug_dir  # Failure images of the detector, not the corpus
+    try:
+        analyze, tiles, frame_bytes, tile_bytes, frames, boards = corpus_inputs(
+            args.corpus, args.frame_quality, args.tile_px, args.tile_quality)
+    finally:
+        shutil.rmtree(debug_dir, ignore_errors=True)
+
+    print(f"Corpus: {frames} frames, {boards} with a board; tiles of {args.tile_px} px, JPEG quality {args.tile_quality}")
+    print(f"  payload: frame JPEG median {int(np.median(frame_bytes))} B, tile grid median {int(np.median(tile_bytes))} B")
+    diff = np.abs(analyze.astype(np.float32) - tiles.astype(np.float32)).mean(axis=(1, 2, 3))
+    print(f"  model input vs /analyze: mean abs difference {diff.mean():.2f} per square "
+          f"(p95 {np.percentile(diff, 95):.2f}, max {diff.max():.2f})")
+
+    if not load_model(args.weights, args.tflite):
+        print("No model loaded (--weights or --tflite): class agreement not checked")
+        return
+    analyze_classes = classes(analyze)
+    tile_classes = classes(tiles)
+    agreement = float(np.mean(analyze_classes == tile_classes))
+    print(f"Top-1 agreement with /analyze: {100 * agreement:.2f}% of {len(analyze)} squares")
+    for index, symbol in CLASS_MAP.items():
+        mask = analyze_classes == index
+        if mask.any():
+            print(f"  {symbol or 'empty':<6}{int(mask.sum()):>6} squares, {100 * np.mean(tile_classes[mask] == index):6.2f}% agree")
+    if agreement < args.min_agreement:
+        print(f"Agreement below {100 * args.min_agreement:.1f}%", file=sys.stderr)
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,193 @@
+"""
+ESP32-CAM emulator on a pseudo-terminal.
+
+Speaks the CAM side of the Serial2 protocol (see src/cam_camera/main.cpp and src/devkit_hub/cam_link.h)
+and answers SNAP with JPEGs made from the debug image corpus, so the hub's receive path can be run
+and benchmarked without a camera:
+
+    python tools/cam_emulator.py --baud 115200 --latency-ms 300 --jitter-ms 100 --drop-rate 1e-5
+    # prints the pty path, e.g. /dev/pts/7; then in another shell:
+    ./cam_link_bench /dev/pts/7 --frames 50
+
+Link faults: --drop-rate drops single bytes, --corrupt-rate advertises a wrong SIZE for a frame
+(so the receiver loses alignment) and --error-rate answers ERROR:CaptureFail.
+"""
+import argparse
+import glob
+import os
+import random
+import sys
+import time
+import tty
+
+import cv2
+import numpy as np
+
+project_root = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
+DEFAULT_CORPUS = os.path.join(project_root, 'vision', 'debug_images')
+
+FRAME_SIZE = (320, 240)    # QVGA, as configured on the CAM
+PREVIEW_SIZE = (80, 60)    # Thumbnail size, see sendPreview()
+WRITE_CHUNK = 64           # Bytes per write when pacing to the baud rate
+
+
+def load_corpus(corpus_dir: str, quality: int) -> list[tuple[bytes, bytes, int]]:
+    """
+    Encodes the corpus originals (*_00_original.png) as CAM-sized JPEGs.
+
+    Returns:
+        A list of (frame_jpeg, preview_jpeg, sharpness) tuples.
+    """
+    paths = sorted(glob.glob(os.path.join(corpus_dir, '*_00_original.png')))
+    if not paths:
+        raise SystemExit(f"No *_00_original.png images in {corpus_dir}")
+    frames = []
+    for path in paths:
+        image = cv2.imread(path, cv2.IMREAD_COLOR)
+        if image is None:
+            print(f"Skipping unreadable image {path}", file=sys.stderr)
+            continue
+        frame = cv2.resize(image, FRAME_SIZE, interpolation=cv2.INTER_AREA)
+        preview = cv2.resize(image, PREVIEW_SIZE, interpolation=cv2.INTER_AREA)
+        _, frame_jpeg = cv2.imencode('.jpg', frame, [cv2.IMWRITE_JPEG_QUALITY, quality])
+        _, preview_jpeg = cv2.imencode('.jpg', preview, [cv2.IMWRITE_JPEG_QUALITY, 40])
+        frames.append((frame_jpeg.tobytes(), preview_jpeg.tobytes(), sharpness_score(frame)))
+    return frames
+
+
+def sharpness_score(frame: np.ndarray) -> int:
+    """Mean squared luma gradient at 1/4 scale, like scoreSharpness() on the CAM."""
+    luma = cv2.cvtColor(frame[::4, ::4], cv2.COLOR_BGR2GRAY).astype(np.int32)
+    gx = np.diff(luma, axis=1)[:-1, :]
+    gy = np.diff(luma, axis=0)[:, :-1]
+    return int(np.mean(gx * gx + gy * gy))
+
+
+class CamEmulator:
+    def __init__(self, fd: int, frames: list[tuple[bytes, bytes, int]], args: argparse.Namespace):
+        self.fd = fd
+        self.frames = frames
+        self.args = args
+        self.rng = random.Random(args.seed)
+        self.preview_enabled = False
+        self.frame_seq = 0
+        self.next_frame = 0
+        self.stats = {'snaps': 0, 'dropped_bytes': 0, 'corrupted': 0, 'errors': 0}
+
+    def write(self, data: bytes, faults: bool = True):
+        """Writes paced to the baud rate (10 bits per byte), dropping bytes at --drop-rate."""
+        byte_time = 10.0 / self.args.baud
+        for offset in range(0, len(data), WRITE_CHUNK):
+            chunk = data[offset:offset + WRITE_CHUNK]
+            if faults and self.args.drop_rate > 0:
+                kept = bytearray()
+                for b in chunk:
+                    if self.rng.random() < self.args.drop_rate:
+                        self.stats['dropped_bytes'] += 1
+                    else:
+                        kept.append(b)
+                chunk = bytes(kept)
+            os.write(self.fd, chunk)
+            time.sleep(len(chunk) * byte_time)
+
+    def line(self, text: str, faults: bool = True):
+        self.write(text.encode() + b'\r\n', faults)  # Serial.println() ends lines with \r\n
+
+    def chatter(self, text: str):
+        """The CAM logs to the same UART; the hub has to skip these lines."""
+        if self.args.chatter:
+            self.line(text, faults=False)
+
+    def snap(self):
+        self.stats['snaps'] += 1
+        self.chatter("SNAP command received, taking photo...")
+        delay_ms = max(0.0, self.args.latency_ms + self.rng.uniform(-self.args.jitter_ms, self.args.jitter_ms))
+        time.sleep(delay_ms / 1000.0)
+        if self.rng.random() < self.args.error_rate:
+            self.stats['errors'] += 1
+            self.line("ERROR:CaptureFail")
+            return
+
+        frame, preview, sharpness = self.frames[self.next_frame]
+        self.next_frame = (self.next_frame + 1) % len(self.frames)
+        if self.preview_enabled:
+            self.line(f"PREVIEW:{len(preview)}")
+            self.write(preview)
+        self.frame_seq = (self.frame_seq + 1) & 0xFFFF
+        advertised = len(frame)
+        if self.rng.random() < self.args.corrupt_rate:
+            self.stats['corrupted'] += 1
+            advertised = max(1, advertised + self.rng.choice([-1, 1]) * self.rng.randint(1, 64))
+        self.line(f"SIZE:{advertised} SHARP:{sharpness} SETTLE:{int(delay_ms)} SETTLE_TO:0 TYPE:KEY ID:{self.frame_seq}")
+        self.write(frame)
+        self.line("FRAME_END")
+        self.chatter(f"Photo sent (KEY, {len(frame)} of {len(frame)} bytes).")
+
+    def handle(self, command: str):
+        self.chatter(f"Received command: '{command}'")
+        if command == "SNAP" or command.startswith("SNAP:"):
+            self.snap()  # SNAP:<game>,<ply> asks for archiving too; there is no card here
+        elif command == "PREVIEW:ON":
+            self.preview_enabled = True
+        elif command == "PREVIEW:OFF":
+            self.preview_enabled = False
+        elif command.startswith("FETCH:"):
+            self.line("ERROR:NoArchive")
+        elif command == "DIAG":
+            self.line("DIAG:180000,170000,110000,2048,4000000,0,0,0,0,0")
+        elif command == "STATS":
+            # Emulator only: fault counters, for the benchmark report
+            self.line("STATS:" + ",".join(f"{k}={v}" for k, v in self.stats.items()), faults=False)
+        # KEYFRAME, SETTLE:, DELTA:, CALIB:, TILES: are accepted and ignored (always full JPEG keyframes),
+        # and so are STANDBY, WAKE and IDLE: (the emulated sensor never sleeps)
+
+    def serve(self):
+        pending = b''
+        while True:
+            data = os.read(self.fd, 256)
+            if not data:
+                continue
+            pending += data
+            while b'\n' in pending:
+                raw, pending = pending.split(b'\n', 1)
+                command = raw.decode(errors='replace').strip()
+                if command:
+                    self.handle(command)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Emulate the ESP32-CAM's Serial2 protocol on a pty.")
+    parser.add_argument('--corpus', default=DEFAULT_CORPUS, help="Directory with *_00_original.png images")
+    parser.add_argument('--quality', type=int, default=60, help="OpenCV JPEG quality of emulated frames (0-100)")
+    parser.add_argument('--baud', type=int, default=115200, help="Emulated UART speed")
+    parser.add_argument('--latency-ms', type=float, default=0.0, help="Delay from SNAP to the first byte (settle + capture)")
+    parser.add_argument('--jitter-ms', type=float, default=0.0, help="Uniform +/- jitter on the latency")
+    parser.add_argument('--drop-rate', type=float, default=0.0, help="Probability that a frame byte is lost")
+    parser.add_argument('--corrupt-rate', type=float, default=0.0, help="Probability that a frame advertises a wrong SIZE")
+    parser.add_argument('--error-rate', type=float, default=0.0, help="Probability of answering ERROR:CaptureFail")
+    parser.add_argument('--no-chatter', dest='chatter', action='store_false', help="Don't emit CAM debug lines")
+    parser.add_argument('--seed', type=int, default=None, help="Random seed for reproducible fault patterns")
+    parser.add_argument('--link', default=None, help="Also create a symlink to the pty at this path")
+    args = parser.parse_args()
+
+    frames = load_corpus(args.corpus, args.quality)
+    sizes = [len(f[0]) for f in frames]
+    master, slave = os.openpty()
+    tty.setraw(slave)
+    slave_path = os.ttyname(slave)
+    if args.link:
+        if os.path.islink(args.link):
+            os.unlink(args.link)
+        os.symlink(slave_path, args.link)
+    print(f"CAM emulator on {slave_path}: {len(frames)} frames, {min(sizes)}-{max(sizes)} bytes", flush=True)
+    try:
+        CamEmulator(master, frames, args).serve()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if args.link and os.path.islink(args.link):
+            os.unlink(args.link)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,187 @@
+// Benchmark of the hub's CAM receive path (src/devkit_hub/cam_link.h) on a host, against
+// tools/cam_emulator.py or a real CAM behind a USB-UART adapter.
+//
+//   g++ -std=c++17 -O2 -Isrc/devkit_hub tools/cam_link_bench.cpp -o cam_link_bench
+//   ./cam_link_bench /dev/pts/7 --frames 50 [--baud 115200] [--timeout-ms 7000] [--stall-ms 500] [--preview]
+//
+// Each frame is requested like requestAndReceiveImage() does (drain, SNAP, feed until done, stalled
+// or timed out). Reports frames/s, bytes/s, latency and, for failed frames, how long it took until
+// the next good frame (recovery time).
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <vector>
+
+#include "cam_link.h"
+
+static uint64_t nowMs() {
+  using namespace std::chrono;
+  return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static speed_t baudConstant(long baud) {
+  switch (baud) {
+    case 9600: return B9600;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 921600: return B921600;
+    default: return B115200;
+  }
+}
+
+static int openSerial(const char* path, long baud) {
+  int fd = open(path, O_RDWR | O_NOCTTY);
+  if (fd < 0) {
+    perror(path);
+    return -1;
+  }
+  termios tio;
+  if (tcgetattr(fd, &tio) == 0) {
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, baudConstant(baud)); // Ignored by a pty; sets the adapter's rate for a real CAM
+    cfsetospeed(&tio, baudConstant(baud));
+    tcsetattr(fd, TCSANOW, &tio);
+  }
+  return fd;
+}
+
+static void sendLine(int fd, const char* line) {
+  char buffer[64];
+  int len = snprintf(buffer, sizeof(buffer), "%s\r\n", line); // Serial.println()
+  if (write(fd, buffer, len) != len) {
+    perror("write");
+  }
+}
+
+static double mean(const std::vector<double>& values) {
+  double sum = 0;
+  for (double v : values) {
+    sum += v;
+  }
+  return values.empty() ? 0 : sum / values.size();
+}
+
+static double percentile(std::vector<double> values, double p) {
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  size_t index = (size_t)(p * (values.size() - 1) + 0.5);
+  return values[index];
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <tty> [--frames N] [--baud B] [--timeout-ms T] [--stall-ms S] [--preview]\n", argv[0]);
+    return 2;
+  }
+  const char* path = argv[1];
+  int frames = 20;
+  long baud = 115200;
+  uint64_t timeoutMs = 2000 + 5000; // CAM_SETTLE_DEADLINE_MS + 5 s, as on the hub
+  uint64_t stallMs = 500;           // CAM_STALL_TIMEOUT_MS
+  bool preview = false;
+  for (int i = 2; i < argc; i++) {
+    if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) frames = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--baud") == 0 && i + 1 < argc) baud = atol(argv[++i]);
+    else if (strcmp(argv[i], "--timeout-ms") == 0 && i + 1 < argc) timeoutMs = atol(argv[++i]);
+    else if (strcmp(argv[i], "--stall-ms") == 0 && i + 1 < argc) stallMs = atol(argv[++i]);
+    else if (strcmp(argv[i], "--preview") == 0) preview = true;
+    else {
+      fprintf(stderr, "Unknown argument %s\n", argv[i]);
+      return 2;
+    }
+  }
+
+  int fd = openSerial(path, baud);
+  if (fd < 0) {
+    return 1;
+  }
+  // Same buffer sizes as the hub
+  static uint8_t image[30 * 1024];
+  static uint8_t previewBuffer[4 * 1024];
+  static uint8_t chunk[256];
+  CamReceiver receiver(image, sizeof(image), previewBuffer, sizeof(previewBuffer));
+  sendLine(fd, preview ? "PREVIEW:ON" : "PREVIEW:OFF");
+
+  std::vector<double> latencies;
+  std::vector<double> recoveries;
+  size_t goodBytes = 0;
+  int good = 0, timeouts = 0, stalls = 0, errors = 0;
+  uint64_t failedAt = 0; // When the current run of failures started (0 = none)
+  uint64_t benchStart = nowMs();
+
+  for (int frame = 0; frame < frames; frame++) {
+    tcflush(fd, TCIFLUSH); // Drop stale bytes from an earlier failed frame
+    receiver.begin();
+    sendLine(fd, "SNAP");
+    uint64_t start = nowMs();
+    uint64_t lastByte = start;
+    CamRecvStatus status = CAM_RECV_BUSY;
+    const char* failure = nullptr;
+    while (status == CAM_RECV_BUSY) {
+      uint64_t now = nowMs();
+      if (now - start >= timeoutMs) {
+        failure = "timeout";
+        timeouts++;
+        break;
+      }
+      if (receiver.midFrame() && now - lastByte >= stallMs) {
+        failure = "stalled";
+        stalls++;
+        break;
+      }
+      pollfd pfd = {fd, POLLIN, 0};
+      if (poll(&pfd, 1, 10) <= 0) {
+        continue;
+      }
+      ssize_t n = read(fd, chunk, sizeof(chunk));
+      if (n <= 0) {
+        continue;
+      }
+      lastByte = nowMs();
+      status = receiver.feed(chunk, (size_t)n);
+    }
+    uint64_t end = nowMs();
+    if (status == CAM_RECV_DONE) {
+      good++;
+      goodBytes += receiver.header().size + receiver.previewSize();
+      latencies.push_back((double)(end - start));
+      if (failedAt != 0) {
+        recoveries.push_back((double)(end - failedAt));
+        failedAt = 0;
+      }
+    } else {
+      if (status == CAM_RECV_ERROR) {
+        failure = receiver.error();
+        errors++;
+      }
+      printf("frame %d failed: %s (state %d, %zu / %zu bytes)\n", frame, failure, receiver.state(),
+             receiver.bytesRead(), receiver.header().size);
+      if (failedAt == 0) {
+        failedAt = end;
+      }
+    }
+  }
+
+  double seconds = (nowMs() - benchStart) / 1000.0;
+  printf("\n%d/%d frames in %.2f s: %.2f frames/s, %.0f bytes/s (%.0f%% of %ld baud)\n", good, frames, seconds,
+         good / seconds, goodBytes / seconds, 100.0 * goodBytes * 10 / seconds / baud, baud);
+  printf("failures: %d cam/protocol errors, %d stalls, %d timeouts\n", errors, stalls, timeouts);
+  printf("latency ms: min %.0f avg %.0f p99 %.0f max %.0f\n", percentile(latencies, 0), mean(latencies),
+         percentile(latencies, 0.99), percentile(latencies, 1));
+  if (!recoveries.empty()) {
+    printf("recovery ms (failure -> next good frame): avg %.0f max %.0f over %zu failures\n", mean(recoveries),
+           percentile(recoveries, 1), recoveries.size());
+  }
+  close(fd);
+  return 0;
+}
@@ -0,0 +1,164 @@
+"""
+Exports the piece classifier as an int8-quantized TFLite model for CPU-only servers.
+
+Builds the float Keras model from models/model_weights.h5, calibrates full-integer quantization on
+square tiles cut from the debug image corpus (vision/debug_images), checks the quantized model
+against the float one on tiles of other corpus frames, and writes the model only if they agree:
+
+    python tools/export_tflite.py --out models/model_int8.tflite
+    CLASSIFIER=int8 python vision_server/app.py
+
+Tiles are cut as the server cuts them: find_and_warp_board() (a plain 400x400 resize when no board
+is found), split_board_into_squares() and resize_square(). Even-numbered frames calibrate, odd ones
+check. The check reports top-1 agreement per class and the time per board (64 squares) of both
+models, and exits with status 1 below --min-agreement.
+
+The exported model takes uint8 input and gives uint8 output; the server maps pixels to the
+quantized input with one table lookup (quantization_lut() in vision/piece_recognizer.py).
+Exporting needs TensorFlow; serving the exported model only needs a TFLite interpreter
+(tflite-runtime or ai-edge-litert).
+"""
+import argparse
+import contextlib
+import glob
+import os
+import shutil
+import sys
+import tempfile
+import time
+
+import cv2
+import numpy as np
+
+project_root = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
+sys.path.insert(0, project_root)
+
+from vision import board_detector, piece_recognizer
+from vision.board_detector import find_and_warp_board, split_board_into_squares
+from vision.piece_recognizer import CLASS_MAP, resize_square
+
+DEFAULT_CORPUS = os.path.join(project_root, 'vision', 'debug_images')
+DEFAULT_WEIGHTS = os.path.join(project_root, 'models', 'model_weights.h5')
+DEFAULT_OUT = os.path.join(project_root, 'models', 'model_int8.tflite')
+BOARD_SIZE = 400
+
+
+def corpus_tiles(corpus_dir: str) -> tuple[np.ndarray, np.ndarray]:
+    """
+    Cuts the 64 model-sized squares of every corpus original.
+
+    Returns:
+        (calibration tiles, check tiles): uint8 arrays of shape (N,) + MODEL_INPUT_SHAPE, from the
+        even- and odd-numbered frames.
+    """
+    paths = sorted(glob.glob(os.path.join(corpus_dir, '*_00_original.png')))
+    if len(paths) < 2:
+        raise SystemExit(f"Need at least 2 *_00_original.png images in {corpus_dir}")
+    tiles = ([], [])
+    with open(os.devnull, 'w') as devnull, contextlib.redirect_stdout(devnull):
+        for n, path in enumerate(paths):
+            image = cv2.imread(path, cv2.IMREAD_COLOR)
+            if image is None:
+                continue
+            board = find_and_warp_board(image, BOARD_SIZE)
+            if board is None:
+                board = cv2.resize(image, (BOARD_SIZE, BOARD_SIZE))
+            tiles[n % 2].extend(resize_square(sq) for sq in split_board_into_squares(board))
+    return np.stack(tiles[0]), np.stack(tiles[1])
+
+
+def convert(model, calibration: np.ndarray, samples: int, seed: int) -> bytes:
+    """Full-integer quantization of the Keras model, calibrated on up to `samples` tiles."""
+    import tensorflow as tf
+
+    rng = np.random.default_rng(seed)
+    picked = rng.permutation(len(calibration))[:samples]
+
+    def representative_dataset():
+        for i in picked:
+            yield [calibration[i:i + 1].astype(np.float32) / 255.0]
+
+    converter = tf.lite.TFLiteConverter.from_keras_model(model)
+    converter.optimizations = [tf.lite.Optimize.DEFAULT]
+    converter.representative_dataset = representative_dataset
+    converter.target_spec.supported_ops = [tf.lite.OpsSet.TFLITE_BUILTINS_INT8]
+    converter.inference_input_type = tf.uint8
+    converter.inference_output_type = tf.uint8
+    return converter.convert()
+
+
+def ms_per_board(predict, tiles: np.ndarray) -> float:
+    """Mean time of predict() on 64-tile batches."""
+    boards = [tiles[i:i + 64] for i in range(0, len(tiles) - 63, 64)]
+    predict(boards[0])  # Warm-up (graph build, tensor allocation)
+    start = time.perf_counter()
+    for board in boards:
+        predict(board)
+    return 1000 * (time.perf_counter() - start) / len(boards)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Export the piece classifier as an int8 TFLite model.")
+    parser.add_argument('--weights', default=DEFAULT_WEIGHTS, help="Keras weights of the float model")
+    parser.add_argument('--corpus', default=DEFAULT_CORPUS, help="Directory with *_00_original.png images")
+    parser.add_argument('--out', default=DEFAULT_OUT, help="Where to write the quantized model")
+    parser.add_argument('--samples', type=int, default=500, help="Calibration tiles (random subset)")
+    parser.add_argument('--min-agreement', type=float, default=0.98, help="Required top-1 agreement with the float model")
+    parser.add_argument('--threads', type=int, default=None, help="Interpreter threads for the check (default: all CPUs)")
+    parser.add_argument('--seed', type=int, default=0, help="Random seed for the calibration subset")
+    parser.add_argument('--force', action='store_true', help="Write the model even if the check fails")
+    args = parser.parse_args()
+
+    with contextlib.redirect_stdout(sys.stderr):
+        piece_recognizer.load_model_weights(args.weights)
+    model = piece_recognizer.piece_classifier_model
+    if model is None:
+        raise SystemExit(f"Could not load the float model from {args.weights}")
+
+    debug_dir = tempfile.mkdtemp(prefix='export_tflite_')
+    board_detector.DEBUG_IMAGE_DIR = debug_dir  # Failure images of the detector, not the corpus
+    try:
+        calibration, check = corpus_tiles(args.corpus)
+    finally:
+        shutil.rmtree(debug_dir, ignore_errors=True)
+    print(f"{len(calibration)} calibration tiles, {len(check)} check tiles")
+
+    tflite_model = convert(model, calibration, args.samples, args.seed)
+    with tempfile.NamedTemporaryFile(suffix='.tflite', delete=False) as f:
+        f.write(tflite_model)
+        candidate = f.name
+
+    # The check runs the quantized model through the same code path as the server
+    with contextlib.redirect_stdout(sys.stderr):
+        piece_recognizer.load_tflite_model(candidate, args.threads)
+    if piece_recognizer.tflite_interpreter is None:
+        raise SystemExit("The exported model could not be loaded")
+
+    def predict_float(batch):
+        return np.asarray(model.predict_on_batch(batch.astype(np.float32) / 255.0))
+
+    float_classes = np.concatenate([predict_float(check[i:i + 64]).argmax(axis=1) for i in range(0, len(check), 64)])
+    int8_classes = np.concatenate([piece_recognizer.predict_tflite(check[i:i + 64]).argmax(axis=1)
+                                   for i in range(0, len(check), 64)])
+    agreement = float(np.mean(float_classes == int8_classes))
+    print(f"Top-1 agreement with the float model: {100 * agreement:.2f}% of {len(check)} tiles")
+    for index, symbol in CLASS_MAP.items():
+        mask = float_classes == index
+        if mask.any():
+            print(f"  {symbol or 'empty':<6}{int(mask.sum()):>6} tiles, {100 * np.mean(int8_classes[mask] == index):6.2f}% agree")
+
+    float_ms = ms_per_board(predict_float, check)
+    int8_ms = ms_per_board(piece_recognizer.predict_tflite, check)
+    print(f"Per board: float {float_ms:.1f} ms, int8 {int8_ms:.1f} ms ({float_ms / int8_ms:.1f}x); "
+          f"model {os.path.getsize(args.weights) // 1024} KB -> {len(tflite_model) // 1024} KB")
+
+    if agreement < args.min_agreement and not args.force:
+        os.unlink(candidate)
+        print(f"Agreement below {100 * args.min_agreement:.1f}%; not writing {args.out}", file=sys.stderr)
+        sys.exit(1)
+    shutil.move(candidate, args.out)
+    print(f"Wrote {args.out}")
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,196 @@
+// Host simulation of the hub running several boards (src/devkit_hub/clock_instance.h).
+//
+//   g++ -std=c++17 -O2 -Isrc/devkit_hub tools/multi_board_sim.cpp -o multi_board_sim
+//   ./multi_board_sim [--boards 1,2,4,8] [--minutes 10] [--think-ms 400,4000] [--capture-ms 650]
+//
+// Two parts, for every board count:
+// - CPU time of the press path (pressBoard(), what the button interrupt runs) and of the per-pass
+//   tick over all boards, measured on this machine. The switch happens in the press path, so its
+//   cost is the press-to-switch latency apart from the interrupt entry.
+// - The hub's loop() on a virtual clock: presses on all boards at random think times, each switching
+//   its clock at once and queuing its transition; every pass sends the queued BLE updates, ticks
+//   every board and runs one capture (blocking for --capture-ms), like main.cpp. Reports how long
+//   a press waits for its BLE update and its image, and how many captures the policy dropped.
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "clock_instance.h"
+
+const int QUEUE_LEN = 8 * MAX_BOARDS;
+const uint32_t NOTIFY_MS = 2; // One state notification, waiting for a TX buffer included
+
+static double percentile(std::vector<double> values, double p) {
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  return values[(size_t)(p * (values.size() - 1) + 0.5)];
+}
+
+static void startGames(ClockInstance* boards, int count, uint32_t nowMs) {
+  for (int i = 0; i < count; i++) {
+    boards[i] = ClockInstance();
+    boards[i].clock.configure({TC_FISCHER, 3600000UL, 2000, {{0, 0}, {0, 0}}}); // Long enough not to flag
+    boards[i].clock.handle(EVENT_P2_PRESS, nowMs);
+    boards[i].captures.configure(CAPTURE_LATEST, 1);
+  }
+}
+
+// --- CPU cost of one press and of one tick pass, in ns ---
+static void measureCpu(int count, double* pressNs, double* tickNs) {
+  using namespace std::chrono;
+  static ClockInstance boards[MAX_BOARDS];
+  TransitionQueue<QUEUE_LEN> queue;
+  startGames(boards, count, 0);
+  const int presses = 2000000;
+  uint32_t now = 0;
+  uint32_t sink = 0;
+  auto start = steady_clock::now();
+  for (int i = 0; i < presses; i++) {
+    uint8_t board = (uint8_t)(i % count);
+    GameState state = boards[board].clock.state();
+    now += 7;
+    ClockTransition t = pressBoard(boards, board, (state == RUNNING_P1) ? EVENT_P1_PRESS : EVENT_P2_PRESS, now, queue);
+    sink += t.p1Ms;
+    BoardTransition drained;
+    queue.pop(&drained); // loop() keeps the queue short; keep it from filling here
+  }
+  *pressNs = duration<double, std::nano>(steady_clock::now() - start).count() / presses;
+
+  const int passes = 2000000 / count;
+  start = steady_clock::now();
+  for (int i = 0; i < passes; i++) {
+    now += 1;
+    for (int board = 0; board < count; board++) {
+      sink += boards[board].clock.tick(now).p2Ms;
+    }
+  }
+  *tickNs = duration<double, std::nano>(steady_clock::now() - start).count() / passes;
+  if (sink == 42) {
+    printf(" "); // Keeps the loops from being optimized away
+  }
+}
+
+struct SimResult {
+  size_t presses;
+  size_t switchesOffPress; // Transitions not anchored at their press time (should be 0)
+  std::vector<double> bleMs;
+  std::vector<double> imageMs;
+  uint32_t capturesRun;
+  uint32_t capturesDropped;
+};
+
+// --- loop() on a virtual clock ---
+static SimResult simulate(int count, uint32_t durationMs, uint32_t thinkMinMs, uint32_t thinkMaxMs,
+                          uint32_t captureMs, unsigned seed) {
+  static ClockInstance boards[MAX_BOARDS];
+  TransitionQueue<QUEUE_LEN> queue;
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<uint32_t> think(thinkMinMs, thinkMaxMs);
+  startGames(boards, count, 0);
+
+  uint32_t nextPress[MAX_BOARDS];
+  for (int i = 0; i < count; i++) {
+    nextPress[i] = think(rng);
+  }
+  SimResult result = {};
+  uint32_t now = 0;
+
+  // Presses that happen while loop() is busy are taken by the interrupt at their own time
+  auto pressesUntil = [&](uint32_t untilMs) {
+    for (int i = 0; i < count; i++) {
+      while (nextPress[i] <= untilMs) {
+        GameState state = boards[i].clock.state();
+        ClockTransition t = pressBoard(boards, (uint8_t)i, (state == RUNNING_P1) ? EVENT_P1_PRESS : EVENT_P2_PRESS,
+                                       nextPress[i], queue);
+        result.presses++;
+        if (t.atMs != nextPress[i]) {
+          result.switchesOffPress++;
+        }
+        nextPress[i] += think(rng);
+      }
+    }
+  };
+
+  while (now < durationMs) {
+    pressesUntil(now);
+    // processQueuedTransitions(): one BLE update per transition, then the capture request
+    BoardTransition t;
+    while (queue.pop(&t)) {
+      now += NOTIFY_MS;
+      pressesUntil(now);
+      result.bleMs.push_back(now - t.clock.atMs);
+      boards[t.board].captures.request(t.clock.atMs);
+    }
+    for (int i = 0; i < count; i++) {
+      boards[i].clock.tick(now);
+    }
+    // runNextCapture()
+    int board = nextCaptureBoard(boards, count, now);
+    CaptureJob job;
+    if (board >= 0 && boards[board].captures.next(&job, now)) {
+      pressesUntil(now + captureMs); // Presses keep coming during the capture
+      now += captureMs;
+      boards[board].captures.markDelivered(job.ply);
+      result.imageMs.push_back(now - job.requestedMs);
+    }
+    now += 1; // delay(1)
+  }
+  for (int i = 0; i < count; i++) {
+    if (!boards[i].clock.isRunning()) {
+      fprintf(stderr, "board %d stopped (%d), results are off\n", i, boards[i].clock.state());
+    }
+    result.capturesRun += boards[i].captures.run();
+    result.capturesDropped += boards[i].captures.dropped();
+  }
+  return result;
+}
+
+int main(int argc, char** argv) {
+  std::vector<int> boardCounts = {1, 2, 4, 8};
+  uint32_t minutes = 10;
+  uint32_t thinkMinMs = 400, thinkMaxMs = 4000;
+  uint32_t captureMs = 650; // Settle + capture + UART transfer of a QVGA frame
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--boards") == 0 && i + 1 < argc) {
+      boardCounts.clear();
+      for (char* p = strtok(argv[++i], ","); p != nullptr; p = strtok(nullptr, ",")) {
+        boardCounts.push_back(std::min(std::max(atoi(p), 1), MAX_BOARDS));
+      }
+    } else if (strcmp(argv[i], "--minutes") == 0 && i + 1 < argc) {
+      minutes = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--think-ms") == 0 && i + 1 < argc) {
+      sscanf(argv[++i], "%u,%u", &thinkMinMs, &thinkMaxMs);
+    } else if (strcmp(argv[i], "--capture-ms") == 0 && i + 1 < argc) {
+      captureMs = atoi(argv[++i]);
+    } else {
+      fprintf(stderr, "usage: %s [--boards 1,2,4,8] [--minutes N] [--think-ms min,max] [--capture-ms N]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  printf("Press path (interrupt) and tick pass, CPU time on this host\n");
+  printf("%7s %10s %14s\n", "boards", "press ns", "tick pass ns");
+  for (int count : boardCounts) {
+    double pressNs, tickNs;
+    measureCpu(count, &pressNs, &tickNs);
+    printf("%7d %10.1f %14.1f\n", count, pressNs, tickNs);
+  }
+
+  printf("\nloop() over %u min, think %u-%u ms per move, %u ms per capture, LATEST policy\n", minutes, thinkMinMs,
+         thinkMaxMs, captureMs);
+  printf("%7s %8s %10s %16s %18s %9s %9s\n", "boards", "presses", "off-press", "ble ms p50/p99", "image ms p50/p99",
+         "captured", "dropped");
+  for (int count : boardCounts) {
+    SimResult r = simulate(count, minutes * 60000, thinkMinMs, thinkMaxMs, captureMs, 1);
+    printf("%7d %8zu %10zu %7.0f/%-8.0f %8.0f/%-9.0f %9u %9u\n", count, r.presses, r.switchesOffPress,
+           percentile(r.bleMs, 0.5), percentile(r.bleMs, 0.99), percentile(r.imageMs, 0.5),
+           percentile(r.imageMs, 0.99), r.capturesRun, r.capturesDropped);
+  }
+  return 0;
+}
@@ -0,0 +1,251 @@
+// Host test of the time-control engine (src/devkit_hub/time_control.h): exact millisecond
+// accounting for every policy, the flag fall, a millis() wrap mid-move and the TIME_CONTROL parser.
+//
+//   g++ -std=c++17 -O2 -Wall -Wextra -Isrc/devkit_hub tools/time_control_test.cpp -o time_control_test
+//   ./time_control_test
+//
+// Prints each failed check and exits with status 1 if any failed.
+#include <stdio.h>
+
+#include "time_control.h"
+
+static int failures = 0;
+static int checks = 0;
+
+#define CHECK_EQ(actual, expected)                                                                   \
+  do {                                                                                               \
+    checks++;                                                                                        \
+    unsigned long a_ = (unsigned long)(actual), e_ = (unsigned long)(expected);                      \
+    if (a_ != e_) {                                                                                  \
+      failures++;                                                                                    \
+      printf("FAIL %s:%d: %s == %lu, expected %lu\n", __FILE__, __LINE__, #actual, a_, e_);          \
+    }                                                                                                \
+  } while (0)
+
+static TimeControlConfig parsed(const char* spec) {
+  TimeControlConfig config = DEFAULT_TIME_CONTROL;
+  if (!parseTimeControl(spec, &config)) {
+    failures++;
+    printf("FAIL: could not parse \"%s\"\n", spec);
+  }
+  return config;
+}
+
+// P1 presses at t0, so P2 moves first; then P2 ends a move after usedMs.
+static TimeControl afterP2Move(const char* spec, uint32_t t0, uint32_t usedMs) {
+  TimeControl clock(parsed(spec));
+  clock.handle(EVENT_P1_PRESS, t0);
+  clock.handle(EVENT_P2_PRESS, t0 + usedMs);
+  return clock;
+}
+
+static void testSuddenDeath() {
+  TimeControl clock(parsed("SUDDEN,60000"));
+  ClockTransition t = clock.handle(EVENT_P1_PRESS, 1000);
+  CHECK_EQ(t.action, ACTION_START);
+  CHECK_EQ(t.running, 2);
+  clock.tick(11000);
+  CHECK_EQ(clock.remainingMs(2), 50000);
+  CHECK_EQ(clock.remainingMs(1), 60000);
+  t = clock.handle(EVENT_P2_PRESS, 13500);
+  CHECK_EQ(t.action, ACTION_SWITCH);
+  CHECK_EQ(t.player, 2);
+  CHECK_EQ(t.running, 1);
+  CHECK_EQ(t.p2Ms, 47500);
+  CHECK_EQ(t.delayMs, 0);
+  // The waiting player's press does nothing
+  t = clock.handle(EVENT_P2_PRESS, 14000);
+  CHECK_EQ(t.action, ACTION_NONE);
+  CHECK_EQ(clock.remainingMs(1), 59500);
+  CHECK_EQ(clock.movesMade(2), 1);
+  CHECK_EQ(clock.movesMade(1), 0);
+}
+
+static void testFischer() {
+  TimeControl clock = afterP2Move("FISCHER,180000,2000", 0, 5000);
+  CHECK_EQ(clock.remainingMs(2), 180000 - 5000 + 2000);
+  clock.handle(EVENT_P1_PRESS, 5000 + 300);
+  CHECK_EQ(clock.remainingMs(1), 180000 - 300 + 2000);
+  // The increment is added even when it takes the clock above the base time
+  CHECK_EQ(afterP2Move("FISCHER,180000,2000", 0, 100).remainingMs(2), 181900);
+}
+
+static void testBronstein() {
+  CHECK_EQ(afterP2Move("BRONSTEIN,180000,2000", 0, 1500).remainingMs(2), 180000);
+  CHECK_EQ(afterP2Move("BRONSTEIN,180000,2000", 0, 2000).remainingMs(2), 180000);
+  CHECK_EQ(afterP2Move("BRONSTEIN,180000,2000", 0, 5000).remainingMs(2), 177000);
+}
+
+static void testUsDelay() {
+  CHECK_EQ(afterP2Move("DELAY,180000,2000", 0, 1500).remainingMs(2), 180000);
+  CHECK_EQ(afterP2Move("DELAY,180000,2000", 0, 5000).remainingMs(2), 177000);
+
+  TimeControl clock(parsed("DELAY,180000,2000"));
+  ClockTransition t = clock.handle(EVENT_P1_PRESS, 0);
+  CHECK_EQ(t.delayMs, 2000);
+  t = clock.tick(500);
+  CHECK_EQ(t.delayMs, 1500);
+  CHECK_EQ(t.p2Ms, 180000);
+  // A tick straddling the end of the delay charges only the part after it
+  t = clock.tick(2700);
+  CHECK_EQ(t.delayMs, 0);
+  CHECK_EQ(t.p2Ms, 179300);
+  t = clock.tick(3700);
+  CHECK_EQ(t.p2Ms, 178300);
+  // The delay starts over on the next move
+  t = clock.handle(EVENT_P2_PRESS, 3700);
+  CHECK_EQ(t.delayMs, 2000);
+  CHECK_EQ(t.running, 1);
+}
+
+static void testPeriods() {
+  // 60 s, bonus 30 s after each player's 2nd move, no increment
+  TimeControl clock(parsed("PERIODS,60000,0,2,30000"));
+  clock.handle(EVENT_P1_PRESS, 0);
+  clock.handle(EVENT_P2_PRESS, 1000);  // P2 move 1
+  clock.handle(EVENT_P1_PRESS, 3000);  // P1 move 1
+  CHECK_EQ(clock.remainingMs(2), 59000);
+  CHECK_EQ(clock.remainingMs(1), 58000);
+  clock.handle(EVENT_P2_PRESS, 4000);  // P2 move 2: bonus
+  CHECK_EQ(clock.remainingMs(2), 58000 + 30000);
+  clock.handle(EVENT_P1_PRESS, 4500);  // P1 move 2: bonus
+  CHECK_EQ(clock.remainingMs(1), 57500 + 30000);
+  clock.handle(EVENT_P2_PRESS, 5000);  // P2 move 3: no bonus
+  CHECK_EQ(clock.remainingMs(2), 87500);
+
+  // Two periods on top of a Fischer increment: "90/40 + 30, 30 s per move" style, shrunk
+  TimeControl two(parsed("PERIODS,10000,100,1,5000,2,1000"));
+  two.handle(EVENT_P1_PRESS, 0);
+  two.handle(EVENT_P2_PRESS, 400);                  // Move 1: increment + first bonus
+  CHECK_EQ(two.remainingMs(2), 10000 - 400 + 100 + 5000);
+  two.handle(EVENT_P1_PRESS, 400);
+  two.handle(EVENT_P2_PRESS, 1400);                 // Move 2: increment + second bonus
+  CHECK_EQ(two.remainingMs(2), 14700 - 1000 + 100 + 1000);
+  two.handle(EVENT_P1_PRESS, 1400);
+  two.handle(EVENT_P2_PRESS, 1600);                 // Move 3: increment only
+  CHECK_EQ(two.remainingMs(2), 14800 - 200 + 100);
+}
+
+static void testFlagFall() {
+  TimeControl clock(parsed("SUDDEN,1000"));
+  clock.handle(EVENT_P1_PRESS, 0);
+  ClockTransition t = clock.tick(999);
+  CHECK_EQ(t.action, ACTION_NONE);
+  CHECK_EQ(clock.remainingMs(2), 1);
+  t = clock.tick(1000);
+  CHECK_EQ(t.action, ACTION_FLAG);
+  CHECK_EQ(t.player, 2);
+  CHECK_EQ(t.running, 0);
+  CHECK_EQ(t.p2Ms, 0);
+  CHECK_EQ(clock.state(), GAME_OVER);
+  // A finished game ignores presses and keeps the clocks
+  t = clock.handle(EVENT_P2_PRESS, 1200);
+  CHECK_EQ(t.action, ACTION_NONE);
+  CHECK_EQ(clock.remainingMs(1), 1000);
+  t = clock.handle(EVENT_RESET, 1300);
+  CHECK_EQ(t.action, ACTION_RESET);
+  CHECK_EQ(clock.state(), IDLE);
+  CHECK_EQ(clock.remainingMs(2), 1000);
+
+  // A press after the flag fell, with no tick in between, reports the flag instead of switching
+  TimeControl late(parsed("FISCHER,1000,5000"));
+  late.handle(EVENT_P1_PRESS, 0);
+  t = late.handle(EVENT_P2_PRESS, 1500);
+  CHECK_EQ(t.action, ACTION_FLAG);
+  CHECK_EQ(t.player, 2);
+  CHECK_EQ(late.remainingMs(2), 0);
+  CHECK_EQ(late.movesMade(2), 0);
+
+  // US delay: the flag falls delay + remaining after the move started
+  TimeControl delayed(parsed("DELAY,1000,2000"));
+  delayed.handle(EVENT_P1_PRESS, 0);
+  CHECK_EQ(delayed.tick(2999).action, ACTION_NONE);
+  CHECK_EQ(delayed.tick(3000).action, ACTION_FLAG);
+}
+
+static void testMillisWrap() {
+  const uint32_t start = 0xFFFFF000UL; // 4096 ms before millis() wraps
+  TimeControl clock(parsed("SUDDEN,60000"));
+  clock.handle(EVENT_P1_PRESS, start);
+  clock.tick(0xFFFFFFFFUL);
+  CHECK_EQ(clock.remainingMs(2), 60000 - 4095);
+  ClockTransition t = clock.handle(EVENT_P2_PRESS, 0x00000800UL); // 2048 ms after the wrap
+  CHECK_EQ(t.action, ACTION_SWITCH);
+  CHECK_EQ(t.p2Ms, 60000 - 4096 - 2048);
+
+  // Delay and increment across the wrap
+  TimeControl delayed(parsed("DELAY,60000,5000"));
+  delayed.handle(EVENT_P1_PRESS, start);
+  delayed.handle(EVENT_P2_PRESS, 0x00000800UL); // 6144 ms used, 5000 not charged
+  CHECK_EQ(delayed.remainingMs(2), 60000 - 1144);
+  TimeControl fischer(parsed("FISCHER,60000,1000"));
+  fischer.handle(EVENT_P1_PRESS, start);
+  fischer.handle(EVENT_P2_PRESS, 0x00000800UL);
+  CHECK_EQ(fischer.remainingMs(2), 60000 - 6144 + 1000);
+}
+
+static void testConfigure() {
+  TimeControl clock(parsed("SUDDEN,60000"));
+  clock.handle(EVENT_P1_PRESS, 0);
+  CHECK_EQ(clock.configure(parsed("FISCHER,30000,1000")), false);
+  CHECK_EQ(clock.config().kind, TC_SUDDEN_DEATH);
+  clock.handle(EVENT_RESET, 100);
+  CHECK_EQ(clock.configure(parsed("FISCHER,30000,1000")), true);
+  CHECK_EQ(clock.remainingMs(1), 30000);
+  // The new policy applies: an increment after the first move
+  clock.handle(EVENT_P1_PRESS, 0);
+  clock.handle(EVENT_P2_PRESS, 500);
+  CHECK_EQ(clock.remainingMs(2), 30500);
+}
+
+static void testParser() {
+  TimeControlConfig config = DEFAULT_TIME_CONTROL;
+  CHECK_EQ(parseTimeControl("FISCHER,180000,2000", &config), true);
+  CHECK_EQ(config.kind, TC_FISCHER);
+  CHECK_EQ(config.baseMs, 180000);
+  CHECK_EQ(config.incrementMs, 2000);
+  CHECK_EQ(parseTimeControl("PERIODS,5400000,30000,40,1800000,60,900000", &config), true);
+  CHECK_EQ(config.periods[0].afterMoves, 40);
+  CHECK_EQ(config.periods[0].bonusMs, 1800000);
+  CHECK_EQ(config.periods[1].afterMoves, 60);
+  CHECK_EQ(config.periods[1].bonusMs, 900000);
+  CHECK_EQ(parseTimeControl("SUDDEN,300000", &config), true);
+  CHECK_EQ(config.incrementMs, 0);
+
+  // Rejected; the config is left unchanged
+  const char* bad[] = {
+    "PERIODS,5400000,30000,40,1800000,60,900000,80", // More values than the format has
+    "SUDDEN,1,2,3,4,5,6,7",
+    "BOGUS,1000",
+    "FISCHER",
+    "FISCHER,",
+    "FISCHER,1000,",
+    "FISCHER,1000,x",
+    "FISCHER,1000 ",
+    "SUDDEN,0",
+    "PERIODS,60000,0",                                // Periods need a move count
+  };
+  for (const char* spec : bad) {
+    checks++;
+    if (parseTimeControl(spec, &config)) {
+      failures++;
+      printf("FAIL: accepted \"%s\"\n", spec);
+    }
+  }
+  CHECK_EQ(config.kind, TC_SUDDEN_DEATH);
+  CHECK_EQ(config.baseMs, 300000);
+}
+
+int main() {
+  testSuddenDeath();
+  testFischer();
+  testBronstein();
+  testUsDelay();
+  testPeriods();
+  testFlagFall();
+  testMillisWrap();
+  testConfigure();
+  testParser();
+  printf("%d checks, %d failed\n", checks, failures);
+  return failures ? 1 : 0;
+}
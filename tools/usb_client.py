@@ -0,0 +1,239 @@
+"""
+Reference client for the hub's wired link on its USB serial port (Linux, standard library only).
+
+Speaks the framing of src/devkit_hub/usb_link.h: attaches with HELLO, keeps the link up with a PING
+every second, prints the hub's log (debug channel) and its messages (client channel), reassembles
+previews, images, GET answers, archived frames and BENCH images, and sends commands typed on stdin
+or given with --cmd:
+
+    python tools/usb_client.py /dev/ttyUSB0 --save-dir /tmp/frames --cmd DIAG
+    # or against the host stand-in: ./usb_link_bench, then
+    python tools/usb_client.py /dev/pts/7 --save-dir /tmp/frames --duration 10
+
+For every finished transfer it prints the bytes, the time from start marker to end marker and the
+rate as a share of the wire speed (baud / 10 bytes per second).
+"""
+import argparse
+import json
+import os
+import select
+import sys
+import termios
+import time
+import tty
+
+SYNC = 0xC5
+CH_CLIENT, CH_DEBUG, CH_LINK = 0, 1, 2
+MAX_PAYLOAD = 1024
+PING_INTERVAL_S = 1.0  # The hub drops the client after 5 s without a frame
+
+# Start markers of raw transfers, and what ends each (end marker, or one of the failure messages)
+TRANSFER_STARTS = {'preview_start': 'preview', 'image_start': 'image', 'frame_start': 'frame',
+                   'archive_start': 'archive', 'bench_start': 'bench'}
+TRANSFER_ENDS = {'preview_end', 'image_end', 'frame_end', 'archive_end', 'bench_end'}
+TRANSFER_ABORTS = {'image_cancelled', 'frame_cancelled', 'archive_error'}
+
+
+def crc16_ccitt(data: bytes, crc: int = 0xFFFF) -> int:
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) & 0xFFFF if crc & 0x8000 else (crc << 1) & 0xFFFF
+    return crc
+
+
+def encode_frame(channel: int, payload: bytes) -> bytes:
+    body = bytes([channel, len(payload) & 0xFF, len(payload) >> 8]) + payload
+    crc = crc16_ccitt(body)
+    return bytes([SYNC]) + body + bytes([crc & 0xFF, crc >> 8])
+
+
+class FrameDecoder:
+    """Byte-stream to frames, like UsbFrameDecoder; raw text before the first HELLO is skipped."""
+
+    def __init__(self):
+        self.buffer = bytearray()
+        self.errors = 0
+
+    def feed(self, data: bytes) -> list[tuple[int, bytes]]:
+        self.buffer += data
+        frames = []
+        while True:
+            start = self.buffer.find(SYNC)
+            if start < 0:
+                self.buffer.clear()
+                return frames
+            del self.buffer[:start]
+            if len(self.buffer) < 4:
+                return frames
+            length = self.buffer[2] | (self.buffer[3] << 8)
+            if length > MAX_PAYLOAD:
+                self.errors += 1
+                del self.buffer[:1]
+                continue
+            if len(self.buffer) < length + 6:
+                return frames
+            body = bytes(self.buffer[1:4 + length])
+            crc = self.buffer[4 + length] | (self.buffer[5 + length] << 8)
+            if crc16_ccitt(body) != crc:
+                self.errors += 1
+                del self.buffer[:1]  # Resync at the next sync byte
+                continue
+            frames.append((body[0], body[3:]))
+            del self.buffer[:length + 6]
+
+
+def open_serial(path: str, baud: int) -> int:
+    fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+    tty.setraw(fd)
+    speed = getattr(termios, f'B{baud}', None)
+    if speed is None:
+        raise SystemExit(f"Unsupported baud rate {baud}")
+    attrs = termios.tcgetattr(fd)
+    attrs[4] = attrs[5] = speed  # Ignored by a pty
+    termios.tcsetattr(fd, termios.TCSANOW, attrs)
+    return fd
+
+
+class UsbClient:
+    def __init__(self, fd: int, args: argparse.Namespace):
+        self.fd = fd
+        self.args = args
+        self.decoder = FrameDecoder()
+        self.debug_text = ''
+        self.transfer = None  # Dict of the raw transfer in progress
+        self.saved = 0
+        self.rates = []
+
+    def send(self, channel: int, text: str):
+        os.write(self.fd, encode_frame(channel, text.encode()))
+
+    def command(self, text: str):
+        print(f">> {text}", flush=True)
+        self.send(CH_CLIENT, text)
+
+    def on_debug(self, payload: bytes):
+        self.debug_text += payload.decode(errors='replace')
+        *lines, self.debug_text = self.debug_text.split('\n')
+        for line in lines:
+            print(f"[hub] {line.rstrip()}", flush=True)
+
+    def on_client(self, payload: bytes):
+        if self.transfer is not None and self.transfer['received'] < self.transfer['size']:
+            self.transfer['data'] += payload  # Raw chunk: everything until size bytes are in
+            self.transfer['received'] += len(payload)
+            return
+        try:
+            message = json.loads(payload)
+        except ValueError:
+            print(f"<< {len(payload)} unexpected raw bytes", flush=True)
+            return
+        kind = message.get('type', '')
+        if kind in TRANSFER_STARTS:
+            self.transfer = {'kind': TRANSFER_STARTS[kind], 'message': message, 'size': message.get('size', 0),
+                             'received': 0, 'data': bytearray(), 'start': time.monotonic()}
+            if not self.args.quiet:
+                print(f"<< {payload.decode()}", flush=True)
+        elif kind in TRANSFER_ENDS and self.transfer is not None:
+            self.finish_transfer()
+        else:
+            if kind in TRANSFER_ABORTS:
+                self.transfer = None
+            print(f"<< {payload.decode()}", flush=True)
+
+    def finish_transfer(self):
+        transfer, self.transfer = self.transfer, None
+        elapsed = time.monotonic() - transfer['start']
+        size = len(transfer['data'])
+        rate = size / elapsed if elapsed > 0 else 0.0
+        wire = self.args.baud / 10.0
+        complete = 'complete' if size == transfer['size'] else f"INCOMPLETE ({transfer['size']} expected)"
+        if transfer['kind'] != 'preview':
+            self.rates.append(rate / wire)
+        line = (f"{transfer['kind']}: {size} bytes in {elapsed * 1000:.1f} ms, {rate / 1000:.1f} KB/s "
+                f"({100 * rate / wire:.0f}% of wire speed), {complete}")
+        if self.args.save_dir:
+            message = transfer['message']
+            ext = 'jpg' if transfer['data'][:2] == b'\xff\xd8' else 'bin'
+            name = f"{self.saved:04d}_{transfer['kind']}_ply{message.get('ply', 'x')}.{ext}"
+            with open(os.path.join(self.args.save_dir, name), 'wb') as f:
+                f.write(transfer['data'])
+            self.saved += 1
+            line += f", saved {name}"
+        print(line, flush=True)
+
+    def run(self):
+        self.send(CH_LINK, 'HELLO')
+        ready = False
+        last_ping = time.monotonic()
+        deadline = time.monotonic() + self.args.duration if self.args.duration else None
+        inputs = [self.fd] + ([sys.stdin] if not self.args.no_stdin else [])
+        while deadline is None or time.monotonic() < deadline:
+            readable, _, _ = select.select(inputs, [], [], 0.1)
+            if self.fd in readable:
+                try:
+                    data = os.read(self.fd, 4096)
+                except OSError:
+                    print("Serial port closed.", file=sys.stderr)
+                    return
+                for channel, payload in self.decoder.feed(data):
+                    if channel == CH_DEBUG:
+                        self.on_debug(payload)
+                    elif channel == CH_CLIENT:
+                        self.on_client(payload)
+                    elif channel == CH_LINK and payload.startswith(b'READY:'):
+                        print(f"Attached, hub sends up to {payload[6:].decode()} bytes per frame", flush=True)
+                        if not ready:
+                            for command in self.args.cmd:
+                                self.command(command)
+                        ready = True
+            if sys.stdin in readable:
+                line = sys.stdin.readline()
+                if not line:
+                    inputs.remove(sys.stdin)
+                elif line.strip():
+                    self.command(line.strip())
+            if time.monotonic() - last_ping >= PING_INTERVAL_S:
+                try:
+                    # Opening the port may have reset the hub, so HELLO is repeated until it answers
+                    self.send(CH_LINK, 'PING' if ready else 'HELLO')
+                except OSError:
+                    print("Serial port closed.", file=sys.stderr)
+                    return
+                last_ping = time.monotonic()
+
+    def close(self):
+        try:
+            self.send(CH_LINK, 'BYE')
+        except OSError:
+            pass
+        if self.rates:
+            rates = sorted(self.rates)
+            print(f"{len(rates)} transfers at {100 * rates[len(rates) // 2]:.0f}% of wire speed (median), "
+                  f"{100 * rates[0]:.0f}% worst; {self.decoder.errors} bad frames", flush=True)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Wired client for the chess clock hub's USB serial link.")
+    parser.add_argument('port', help="Serial device of the hub (or the pty of usb_link_bench)")
+    parser.add_argument('--baud', type=int, default=921600, help="USB_BAUD of the hub firmware")
+    parser.add_argument('--cmd', action='append', default=[], help="Command to send once attached (repeatable)")
+    parser.add_argument('--save-dir', default=None, help="Write every received transfer to this directory")
+    parser.add_argument('--duration', type=float, default=None, help="Detach after this many seconds")
+    parser.add_argument('--no-stdin', action='store_true', help="Don't read commands from stdin")
+    parser.add_argument('--quiet', action='store_true', help="Don't print the start markers of transfers")
+    args = parser.parse_args()
+
+    if args.save_dir:
+        os.makedirs(args.save_dir, exist_ok=True)
+    client = UsbClient(open_serial(args.port, args.baud), args)
+    try:
+        client.run()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        client.close()
+
+
+if __name__ == '__main__':
+    main()
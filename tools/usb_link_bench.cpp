@@ -0,0 +1,263 @@
+// Stand-in for the hub's USB client link (src/devkit_hub/usb_link.h) on a pty, to run
+// tools/usb_client.py against and to check that image frames leave at wire speed.
+//
+//   g++ -std=c++17 -O2 -Isrc/devkit_hub tools/usb_link_bench.cpp -o usb_link_bench
+//   ./usb_link_bench [--frames 20] [--size 12000] [--baud 921600] [--gap-ms 200]
+//   # prints the pty path, e.g. /dev/pts/7; then in another shell:
+//   python tools/usb_client.py /dev/pts/7 --save-dir /tmp/frames
+//
+// The hub's Serial is modelled as a 4 KB TX buffer drained into the pty at baud / 10 bytes per
+// second. Once a client sends HELLO, --frames images go out like pumpImageTransfer() sends them:
+// image_start, then pumpChunks() with IMAGE_PACING once per 1 ms loop() pass, then image_end, with
+// a log line on the debug channel per image. Client commands are answered on the debug channel.
+// Reports the share of wire time spent sending while an image was in flight (utilization) and the
+// framing overhead.
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "ble_transport.h"
+#include "usb_link.h"
+
+const size_t TX_BUFFER_SIZE = 4096;                 // Serial.setTxBufferSize() on the hub
+const ChunkPacing IMAGE_PACING = {0, 0, 8, true};   // As in main.cpp
+
+static double nowMs() {
+  using namespace std::chrono;
+  return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+// The hub's UART TX side: a byte buffer that empties into the pty at the baud rate
+class EmulatedUart {
+public:
+  EmulatedUart(int fd, long baud) : fd_(fd), bytesPerMs_(baud / 10000.0) {}
+
+  // Blocks while the buffer is full, like Serial.write()
+  void write(const uint8_t* data, size_t len) {
+    while (TX_BUFFER_SIZE - buffer_.size() < len) {
+      drain();
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    if (buffer_.empty()) {
+      lastDrainMs_ = nowMs(); // The line was idle until now
+    }
+    buffer_.insert(buffer_.end(), data, data + len);
+  }
+
+  int availableForWrite() const { return (int)(TX_BUFFER_SIZE - buffer_.size()); }
+
+  // Moves the bytes the line has sent since the last call to the pty
+  void drain() {
+    double now = nowMs();
+    size_t bytes = std::min(buffer_.size(), (size_t)((now - lastDrainMs_) * bytesPerMs_));
+    if (bytes == 0) {
+      return;
+    }
+    size_t done = 0;
+    while (done < bytes) {
+      ssize_t n = ::write(fd_, buffer_.data() + done, bytes - done);
+      if (n <= 0) {
+        break; // Client not reading; the pty is full
+      }
+      done += n;
+    }
+    buffer_.erase(buffer_.begin(), buffer_.begin() + done);
+    lastDrainMs_ += done / bytesPerMs_;
+    sent_ += done;
+  }
+
+  // Waits like delay(), with the line still sending
+  void delayMs(double ms) {
+    double until = nowMs() + ms;
+    while (nowMs() < until) {
+      drain();
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    drain();
+  }
+
+  size_t pending() const { return buffer_.size(); }
+  size_t sent() const { return sent_; }
+  double bytesPerMs() const { return bytesPerMs_; }
+
+private:
+  int fd_;
+  double bytesPerMs_;
+  std::vector<uint8_t> buffer_;
+  double lastDrainMs_ = 0;
+  size_t sent_ = 0;
+};
+
+// UsbTransport from main.cpp, on the emulated UART
+class PtyUsbTransport : public ClientTransport {
+public:
+  explicit PtyUsbTransport(EmulatedUart& uart) : uart_(uart) {}
+
+  using ClientTransport::notify;
+
+  bool connected() override { return true; }
+  size_t maxPayload() override { return USB_MAX_PAYLOAD; }
+
+  bool notify(const uint8_t* data, size_t len) override {
+    if (len > USB_MAX_PAYLOAD) {
+      return false;
+    }
+    uart_.write(frame_, encodeUsbFrame(USB_CH_CLIENT, data, len, frame_));
+    payloadBytes_ += len;
+    frames_++;
+    return true;
+  }
+
+  int sendableCount() override { return uart_.availableForWrite() / (int)(USB_MAX_PAYLOAD + USB_FRAME_OVERHEAD); }
+  void wait(unsigned long ms) override { uart_.delayMs(ms); }
+
+  size_t payloadBytes() const { return payloadBytes_; }
+  size_t wireBytes() const { return payloadBytes_ + frames_ * USB_FRAME_OVERHEAD; }
+
+private:
+  EmulatedUart& uart_;
+  uint8_t frame_[USB_MAX_PAYLOAD + USB_FRAME_OVERHEAD];
+  size_t payloadBytes_ = 0;
+  size_t frames_ = 0;
+};
+
+static void sendFrame(EmulatedUart& uart, uint8_t channel, const char* text) {
+  uint8_t frame[256 + USB_FRAME_OVERHEAD];
+  uart.write(frame, encodeUsbFrame(channel, (const uint8_t*)text, std::min(strlen(text), (size_t)256), frame));
+}
+
+// Reads what the client sent; returns false once it said BYE or closed the pty
+static bool pollClient(int fd, EmulatedUart& uart, UsbFrameDecoder<160>& decoder, bool* attached) {
+  uint8_t buf[256];
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof(buf))) > 0) {
+    for (ssize_t i = 0; i < n; i++) {
+      if (!decoder.feed(buf[i])) {
+        continue;
+      }
+      const char* payload = (const char*)decoder.payload();
+      char reply[240];
+      if (decoder.channel() == USB_CH_LINK && strcmp(payload, "HELLO") == 0) {
+        *attached = true;
+        snprintf(reply, sizeof(reply), "READY:%zu", USB_MAX_PAYLOAD);
+        sendFrame(uart, USB_CH_LINK, reply);
+      } else if (decoder.channel() == USB_CH_LINK && strcmp(payload, "BYE") == 0) {
+        return false;
+      } else if (decoder.channel() == USB_CH_CLIENT && *attached) {
+        snprintf(reply, sizeof(reply), "Client command: '%s' (not handled by the bench)\r\n", payload);
+        sendFrame(uart, USB_CH_DEBUG, reply);
+      }
+    }
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  int frames = 20;
+  size_t size = 12000;
+  long baud = 921600;
+  double gapMs = 200;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+      frames = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+      size = strtoul(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "--baud") == 0 && i + 1 < argc) {
+      baud = atol(argv[++i]);
+    } else if (strcmp(argv[i], "--gap-ms") == 0 && i + 1 < argc) {
+      gapMs = atof(argv[++i]);
+    } else {
+      fprintf(stderr, "usage: %s [--frames N] [--size bytes] [--baud N] [--gap-ms N]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+    perror("posix_openpt");
+    return 1;
+  }
+  int slave = open(ptsname(master), O_RDWR | O_NOCTTY); // Held open so the master reads no EOF before the client
+  termios tio;
+  tcgetattr(slave, &tio);
+  cfmakeraw(&tio);
+  tcsetattr(slave, TCSANOW, &tio);
+  fcntl(master, F_SETFL, O_NONBLOCK);
+  printf("Hub USB link on %s, %ld baud (%.1f KB/s on the wire)\n", ptsname(master), baud, baud / 10000.0);
+  printf("Waiting for HELLO...\n");
+  fflush(stdout);
+
+  EmulatedUart uart(master, baud);
+  PtyUsbTransport transport(uart);
+  UsbFrameDecoder<160> decoder;
+  bool attached = false;
+  while (!attached) {
+    pollClient(master, uart, decoder, &attached);
+    uart.delayMs(1);
+  }
+
+  std::vector<uint8_t> image(size);
+  for (size_t i = 0; i < size; i++) {
+    image[i] = (uint8_t)(i * 131 + (i >> 8)); // Includes 0xC5 bytes, so the client has to frame properly
+  }
+  image[0] = 0xFF;
+  image[1] = 0xD8;
+  double inFlightMs = 0;
+  size_t inFlightWireBytes = 0;
+  std::vector<double> frameMs;
+  bool open = true;
+  for (int f = 0; f < frames && open; f++) {
+    char marker[200];
+    snprintf(marker, sizeof(marker),
+             "{\"type\":\"image_start\",\"size\":%zu,\"sharpness\":0,\"settle_ms\":0,\"settle_timeout\":0,"
+             "\"frame\":\"key\",\"id\":%d,\"ply\":%d,\"skipped\":0,\"lag_ms\":0}", size, f + 1, f);
+    size_t sentBefore = uart.sent() + uart.pending();
+    double start = nowMs();
+    transport.notify(marker);
+    ChunkTransfer transfer = {image.data(), size, 0, true};
+    while (open && !pumpChunks(transport, transfer, IMAGE_PACING)) {
+      open = pollClient(master, uart, decoder, &attached);
+      uart.delayMs(1); // delay(1) at the end of loop()
+    }
+    waitForCredit(transport, IMAGE_PACING);
+    transport.notify("{\"type\":\"image_end\"}");
+    while (uart.pending() > 0) {
+      uart.delayMs(0.1);
+    }
+    double elapsed = nowMs() - start;
+    frameMs.push_back(elapsed);
+    inFlightMs += elapsed;
+    inFlightWireBytes += uart.sent() - sentBefore;
+    char line[96];
+    snprintf(line, sizeof(line), "Sent frame %d (%zu bytes) in %.1f ms\r\n", f, size, elapsed);
+    sendFrame(uart, USB_CH_DEBUG, line);
+    for (double waited = 0; open && waited < gapMs; waited += 1) {
+      open = pollClient(master, uart, decoder, &attached);
+      uart.delayMs(1);
+    }
+  }
+  while (uart.pending() > 0) {
+    uart.delayMs(1);
+  }
+
+  std::sort(frameMs.begin(), frameMs.end());
+  double ideal = (size + USB_FRAME_OVERHEAD * ((size + USB_MAX_PAYLOAD - 1) / USB_MAX_PAYLOAD)) / uart.bytesPerMs();
+  printf("%zu frames of %zu bytes: %.1f ms median, %.1f ms max (%.1f ms at wire speed)\n", frameMs.size(), size,
+         frameMs.empty() ? 0 : frameMs[frameMs.size() / 2], frameMs.empty() ? 0 : frameMs.back(), ideal);
+  printf("Wire utilization while a frame was in flight: %.1f%%\n",
+         inFlightMs > 0 ? 100.0 * inFlightWireBytes / (inFlightMs * uart.bytesPerMs()) : 0);
+  printf("Framing overhead: %zu client payload bytes, %zu on the wire (%.2f%%)\n", transport.payloadBytes(),
+         transport.wireBytes(), 100.0 * (transport.wireBytes() - transport.payloadBytes()) / std::max((size_t)1, transport.wireBytes()));
+  printf("Bad frames from the client: %u\n", decoder.errors());
+  close(slave);
+  close(master);
+  return 0;
+}
@@ -0,0 +1,279 @@
+"""
+Benchmark of the server's vision pipeline over the debug image corpus, in one process.
+
+Replays the corpus originals (*_00_original.png in vision/debug_images) as CAM-like JPEGs through
+each stage of /analyze and times them: decode, find_and_warp_board, split_board_into_squares,
+classify_squares (and with --per-square the 64 classify_square() calls it replaced), generate_fen,
+and the whole pipeline. Reports p50/p90/p99/max latency per stage, pipeline images/s and the peak
+memory of each stage (tracemalloc, in a separate untimed pass), and can write and compare results:
+
+    python tools/vision_bench.py --repeat 5 --json /tmp/before.json
+    # ... change the pipeline ...
+    python tools/vision_bench.py --repeat 5 --json /tmp/after.json --baseline /tmp/before.json
+    python tools/vision_bench.py --compare /tmp/before.json /tmp/after.json --threshold 10
+
+A comparison lists every stage's p50 and p90 change and exits with status 1 if any p50 got slower by
+more than --threshold percent, so it can gate a change.
+
+Frames where no board is found still go through the later stages, as a plain 400x400 resize, so
+every frame exercises the classifier; they are counted as detect_failed. On failure the detector
+writes its debug images, as it does in the server; the benchmark points it at a temporary directory.
+Without models/model_weights.h5 (or --weights) the classifier returns placeholders and the classify
+timings mean nothing. --tflite times the quantized model instead; since that path doesn't import
+TensorFlow, max RSS shows its memory too. The results record which model ran.
+"""
+import argparse
+import contextlib
+import glob
+import json
+import os
+import platform
+import resource
+import shutil
+import sys
+import tempfile
+import time
+import tracemalloc
+
+import cv2
+import numpy as np
+
+project_root = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
+sys.path.insert(0, project_root)
+
+from vision import board_detector, piece_recognizer
+from vision.board_detector import find_and_warp_board, split_board_into_squares
+
+try:
+    from vision.fen_generator import generate_fen
+except ImportError:  # python-chess missing: the fen stage is skipped
+    generate_fen = None
+
+DEFAULT_CORPUS = os.path.join(project_root, 'vision', 'debug_images')
+DEFAULT_WEIGHTS = os.path.join(project_root, 'models', 'model_weights.h5')
+FRAME_SIZE = (320, 240)    # QVGA, as the CAM sends it
+BOARD_SIZE = 400           # find_and_warp_board() output
+
+STAGES = ['decode', 'detect_warp', 'split', 'classify_square', 'classify', 'fen', 'pipeline']
+
+
+def load_corpus(corpus_dir: str, quality: int) -> list[tuple[str, bytes]]:
+    """Encodes the corpus originals as CAM-sized JPEGs; returns (name, jpeg) pairs."""
+    paths = sorted(glob.glob(os.path.join(corpus_dir, '*_00_original.png')))
+    if not paths:
+        raise SystemExit(f"No *_00_original.png images in {corpus_dir}")
+    frames = []
+    for path in paths:
+        image = cv2.imread(path, cv2.IMREAD_COLOR)
+        if image is None:
+            print(f"Skipping unreadable image {path}", file=sys.stderr)
+            continue
+        frame = cv2.resize(image, FRAME_SIZE, interpolation=cv2.INTER_AREA)
+        _, jpeg = cv2.imencode('.jpg', frame, [cv2.IMWRITE_JPEG_QUALITY, quality])
+        frames.append((os.path.basename(path), jpeg.tobytes()))
+    return frames
+
+
+def run_frame(jpeg: bytes, previous_fen: str | None, per_square: bool, timer) -> tuple[str | None, bool]:
+    """
+    Runs one frame through the pipeline, timing each stage with timer(stage, fn, *args).
+
+    Returns:
+        (generated FEN or None, whether the board was detected).
+    """
+    image = timer('decode', cv2.imdecode, np.frombuffer(jpeg, np.uint8), cv2.IMREAD_COLOR)
+    board = timer('detect_warp', find_and_warp_board, image, BOARD_SIZE)
+    detected = board is not None
+    if not detected:
+        board = cv2.resize(image, (BOARD_SIZE, BOARD_SIZE))
+    squares = timer('split', split_board_into_squares, board)
+    if per_square:
+        timer('classify_square', lambda: [piece_recognizer.classify_square(sq) for sq in squares])
+    classifications = timer('classify', piece_recognizer.classify_squares, squares)
+    fen = None
+    if generate_fen is not None:
+        try:
+            fen = timer('fen', generate_fen, classifications, previous_fen)
+        except ValueError:
+            pass  # Illegal placement (e.g. placeholder classifications); the time is still recorded
+    return fen, detected
+
+
+def model_name() -> str:
+    if piece_recognizer.tflite_interpreter is not None:
+        return 'int8'
+    return 'float' if piece_recognizer.piece_classifier_model is not None else 'placeholder'
+
+
+def percentile(values: list[float], q: float) -> float:
+    return float(np.percentile(values, q)) if values else 0.0
+
+
+def run_benchmark(args: argparse.Namespace) -> dict:
+    frames = load_corpus(args.corpus, args.quality)
+    times = {stage: [] for stage in STAGES}
+    skipped = {}
+
+    def timed(stage, fn, *fn_args):
+        start = time.perf_counter()
+        try:
+            return fn(*fn_args)
+        finally:
+            times[stage].append(time.perf_counter() - start)
+
+    def untimed(stage, fn, *fn_args):
+        return fn(*fn_args)
+
+    detect_failed = 0
+    with open(os.devnull, 'w') as devnull, contextlib.redirect_stdout(devnull):
+        # Warm-up: first calls build the model graph, allocate OpenCV buffers...
+        for _ in range(args.warmup):
+            for _, jpeg in frames:
+                run_frame(jpeg, None, args.per_square, untimed)
+
+        for _ in range(args.repeat):
+            previous_fen = None
+            for _, jpeg in frames:
+                start = time.perf_counter()
+                fen, detected = run_frame(jpeg, previous_fen, args.per_square, timed)
+                elapsed = time.perf_counter() - start
+                if args.per_square:
+                    elapsed -= times['classify_square'][-1]  # Not part of the server's path
+                times['pipeline'].append(elapsed)
+                detect_failed += not detected
+                previous_fen = fen or previous_fen
+
+        # Memory pass: peak traced allocation of each stage above the level it started at. The
+        # pipeline peak adds what earlier stages of the same frame still hold at that point.
+        peaks = {stage: 0 for stage in STAGES}
+        frame_start = [0]
+
+        def traced(stage, fn, *fn_args):
+            before = tracemalloc.get_traced_memory()[0]
+            tracemalloc.reset_peak()
+            try:
+                return fn(*fn_args)
+            finally:
+                peak = tracemalloc.get_traced_memory()[1] - before
+                peaks[stage] = max(peaks[stage], peak)
+                peaks['pipeline'] = max(peaks['pipeline'], before - frame_start[0] + peak)
+
+        tracemalloc.start()
+        for _, jpeg in frames:
+            frame_start[0] = tracemalloc.get_traced_memory()[0]
+            run_frame(jpeg, None, args.per_square, traced)
+        tracemalloc.stop()
+
+    stages = {}
+    for stage in STAGES:
+        values = times[stage]
+        if not values:
+            skipped[stage] = 'not run'
+            continue
+        ms = [1000 * v for v in values]
+        stages[stage] = {'count': len(ms), 'mean_ms': round(float(np.mean(ms)), 3),
+                         'p50_ms': round(percentile(ms, 50), 3), 'p90_ms': round(percentile(ms, 90), 3),
+                         'p99_ms': round(percentile(ms, 99), 3), 'max_ms': round(max(ms), 3),
+                         'peak_kb': round(peaks[stage] / 1024, 1)}
+    pipeline_s = sum(times['pipeline'])
+    return {
+        'meta': {'time': time.strftime('%Y-%m-%d %H:%M:%S'), 'python': platform.python_version(),
+                 'numpy': np.__version__, 'opencv': cv2.__version__, 'machine': platform.machine(),
+                 'corpus': os.path.relpath(args.corpus, project_root), 'frames': len(frames),
+                 'repeat': args.repeat, 'quality': args.quality,
+                 'model': model_name()},
+        'stages': stages,
+        'skipped': skipped,
+        'images_per_s': round(len(times['pipeline']) / pipeline_s, 2) if pipeline_s else None,
+        'detect_failed': detect_failed // max(1, args.repeat),
+        'max_rss_mb': round(resource.getrusage(resource.RUSAGE_SELF).ru_maxrss / 1024, 1),
+    }
+
+
+def print_results(results: dict):
+    meta = results['meta']
+    print(f"{meta['frames']} frames x {meta['repeat']}, model {meta['model']}, "
+          f"board not found in {results['detect_failed']}")
+    print(f"{'stage':<16}{'p50 ms':>10}{'p90 ms':>10}{'p99 ms':>10}{'max ms':>10}{'peak KB':>10}")
+    for stage, s in results['stages'].items():
+        print(f"{stage:<16}{s['p50_ms']:>10.2f}{s['p90_ms']:>10.2f}{s['p99_ms']:>10.2f}"
+              f"{s['max_ms']:>10.2f}{s['peak_kb']:>10.0f}")
+    for stage, why in results['skipped'].items():
+        print(f"{stage:<16}{why:>10}")
+    print(f"{results['images_per_s']} images/s, max RSS {results['max_rss_mb']} MB")
+
+
+def compare(base: dict, new: dict, threshold: float) -> bool:
+    """Prints the per-stage change from base to new; True if a stage's p50 regressed beyond threshold %."""
+    regressed = False
+    print(f"{'stage':<16}{'p50 base':>10}{'p50 new':>10}{'change':>9}{'p90 base':>10}{'p90 new':>10}{'change':>9}")
+    for stage in STAGES:
+        if stage not in base['stages'] or stage not in new['stages']:
+            continue
+        b, n = base['stages'][stage], new['stages'][stage]
+        line, flag = f"{stage:<16}", ''
+        for key in ('p50_ms', 'p90_ms'):
+            change = 100 * (n[key] - b[key]) / b[key] if b[key] else 0.0
+            line += f"{b[key]:>10.2f}{n[key]:>10.2f}{change:>+8.1f}%"
+            if key == 'p50_ms' and change > threshold:
+                regressed = True
+                flag = '  REGRESSION'
+        print(line + flag)
+    if base.get('images_per_s') and new.get('images_per_s'):
+        change = 100 * (new['images_per_s'] - base['images_per_s']) / base['images_per_s']
+        print(f"images/s: {base['images_per_s']} -> {new['images_per_s']} ({change:+.1f}%)")
+    for key in ('frames', 'model', 'machine'):
+        if base['meta'].get(key) != new['meta'].get(key):
+            print(f"Note: {key} differs ({base['meta'].get(key)} vs {new['meta'].get(key)})")
+    return regressed
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Benchmark the vision pipeline over the debug image corpus.")
+    parser.add_argument('--corpus', default=DEFAULT_CORPUS, help="Directory with *_00_original.png images")
+    parser.add_argument('--weights', default=DEFAULT_WEIGHTS, help="Model weights (placeholder classifier if missing)")
+    parser.add_argument('--tflite', default=None, help="Time this quantized model (tools/export_tflite.py) instead")
+    parser.add_argument('--quality', type=int, default=60, help="JPEG quality the frames are encoded with (0-100)")
+    parser.add_argument('--repeat', type=int, default=3, help="Timed passes over the corpus")
+    parser.add_argument('--warmup', type=int, default=1, help="Untimed passes before timing")
+    parser.add_argument('--per-square', action='store_true', help="Also time 64 classify_square() calls per frame")
+    parser.add_argument('--json', default=None, help="Write the results to this file")
+    parser.add_argument('--baseline', default=None, help="Compare this run with an earlier --json result")
+    parser.add_argument('--compare', nargs=2, metavar=('BASE', 'NEW'), help="Only compare two --json results")
+    parser.add_argument('--threshold', type=float, default=10.0, help="p50 slowdown (%%) counted as a regression")
+    args = parser.parse_args()
+
+    if args.compare:
+        with open(args.compare[0]) as f_base, open(args.compare[1]) as f_new:
+            sys.exit(1 if compare(json.load(f_base), json.load(f_new), args.threshold) else 0)
+
+    if args.tflite:
+        with contextlib.redirect_stdout(sys.stderr):
+            piece_recognizer.load_tflite_model(args.tflite)
+        if piece_recognizer.tflite_interpreter is None:
+            raise SystemExit(f"Could not load {args.tflite}")
+    elif os.path.exists(args.weights):
+        with contextlib.redirect_stdout(sys.stderr):
+            piece_recognizer.load_model_weights(args.weights)
+    else:
+        print(f"No model weights at {args.weights}; timing the placeholder classifier", file=sys.stderr)
+
+    debug_dir = tempfile.mkdtemp(prefix='vision_bench_')
+    board_detector.DEBUG_IMAGE_DIR = debug_dir  # Failure images of the detector, not the corpus
+    try:
+        results = run_benchmark(args)
+    finally:
+        shutil.rmtree(debug_dir, ignore_errors=True)
+
+    print_results(results)
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump(results, f, indent=2)
+    if args.baseline:
+        with open(args.baseline) as f:
+            print()
+            sys.exit(1 if compare(json.load(f), results, args.threshold) else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,105 @@
+import queue
+import threading
+import time
+
+import numpy as np
+
+from .piece_recognizer import classify_batch, resize_square
+
+# Cross-request micro-batching of square classification. Every /analyze request resizes its
+# 64 squares in its own thread and hands them to one worker thread. The worker takes the oldest
+# waiting board, then keeps collecting boards (from any clock) until it has max_boards of them or
+# the oldest has waited max_wait_ms. It then runs a single model call for all of them and hands
+# each request its 64 results. With one clock the extra latency is at most max_wait_ms; with many,
+# the model runs a few large batches instead of one call per board.
+DEFAULT_MAX_BOARDS = 8
+DEFAULT_MAX_WAIT_MS = 5.0
+
+
+class _BoardRequest:
+    def __init__(self, batch: np.ndarray):
+        self.batch = batch
+        self.enqueued = time.perf_counter()
+        self.done = threading.Event()
+        self.result = None
+
+
+class MicroBatcher:
+    """
+    Merges the boards of concurrent requests into batched classify_batch() calls.
+
+    Args:
+        max_boards: Most boards (of 64 squares) per model call.
+        max_wait_ms: How long the oldest board may wait for others to join its batch. 0 classifies
+                     each board on its own, in the calling thread.
+        classify: The batched classifier (classify_batch() by default; replaceable for benchmarks).
+    """
+
+    def __init__(self, max_boards: int = DEFAULT_MAX_BOARDS, max_wait_ms: float = DEFAULT_MAX_WAIT_MS,
+                 classify=classify_batch):
+        self.max_boards = max(1, max_boards)
+        self.max_wait = max_wait_ms / 1000.0
+        self.classify = classify
+        self.requests = queue.Queue()
+        self.lock = threading.Lock()
+        self.stats = {'boards': 0, 'batches': 0, 'squares': 0, 'wait_s': 0.0, 'model_s': 0.0}
+        if self.max_wait > 0:
+            threading.Thread(target=self._run, name='square-batcher', daemon=True).start()
+
+    def classify_board(self, square_images: list[np.ndarray]) -> list[tuple[str | None, str | None]]:
+        """Classifies one board's squares, possibly in a batch with other requests' boards."""
+        if not square_images:
+            return []
+        batch = np.stack([resize_square(img) for img in square_images])
+        if self.max_wait <= 0:
+            start = time.perf_counter()
+            result = self.classify(batch)
+            self._count([len(batch)], 0.0, time.perf_counter() - start)
+            return result
+        request = _BoardRequest(batch)
+        self.requests.put(request)
+        request.done.wait()
+        return request.result
+
+    def _run(self):
+        while True:
+            pending = [self.requests.get()]
+            deadline = pending[0].enqueued + self.max_wait
+            while len(pending) < self.max_boards:
+                remaining = deadline - time.perf_counter()
+                try:
+                    pending.append(self.requests.get(timeout=remaining) if remaining > 0 else self.requests.get_nowait())
+                except queue.Empty:
+                    break
+            start = time.perf_counter()
+            try:
+                results = self.classify(np.concatenate([r.batch for r in pending]))
+            except Exception as e:
+                print(f"Error in batched classification: {e}")
+                results = [(None, None)] * sum(len(r.batch) for r in pending)
+            model_s = time.perf_counter() - start
+            offset = 0
+            for r in pending:
+                r.result = results[offset:offset + len(r.batch)]
+                offset += len(r.batch)
+                r.done.set()
+            self._count([len(r.batch) for r in pending], sum(start - r.enqueued for r in pending), model_s)
+
+    def _count(self, sizes: list[int], wait_s: float, model_s: float):
+        with self.lock:
+            self.stats['boards'] += len(sizes)
+            self.stats['batches'] += 1
+            self.stats['squares'] += sum(sizes)
+            self.stats['wait_s'] += wait_s
+            self.stats['model_s'] += model_s
+
+    def report(self) -> dict:
+        """Batches run, boards per batch, and mean queue wait and model time per board."""
+        with self.lock:
+            s = dict(self.stats)
+        boards, batches = s['boards'], s['batches']
+        return {'boards': boards, 'batches': batches, 'squares': s['squares'],
+                'max_boards': self.max_boards, 'max_wait_ms': self.max_wait * 1000,
+                'boards_per_batch': round(boards / batches, 2) if batches else None,
+                'wait_ms': round(1000 * s['wait_s'] / boards, 3) if boards else None,
+                'model_ms_per_board': round(1000 * s['model_s'] / boards, 3) if boards else None}
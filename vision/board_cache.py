@@ -0,0 +1,172 @@
+import threading
+import time
+from collections import OrderedDict
+
+import cv2
+import numpy as np
+
+from .board_detector import board_homography, find_board_corners, order_points, warp_board
+
+# Board corners and homography per clock ('session_id'), so frames after the first are warped
+# without the contour search. A clock's camera doesn't move during a game; when it does (bumped,
+# re-aimed), the cached corners stop matching and the cheap check below sends the frame back through
+# find_board_corners().
+#
+# The check samples the grayscale step across the board outline: at BORDER_SAMPLES points along
+# each edge, the mean of a few pixels just inside minus just outside. The profile taken when the
+# corners were found is the reference. A frame keeps the cache if its profile still correlates with
+# the reference and has at least MIN_CONTRAST_RATIO of its contrast; a moved board gives an
+# unrelated (or flat) profile, a lighting change mostly scales it.
+BORDER_SAMPLES = 16         # Per edge
+BORDER_OFFSET_FRACTION = 0.02  # Inside/outside distance from the edge, as a fraction of the board size
+MIN_PROFILE_CORRELATION = 0.6
+MIN_CONTRAST_RATIO = 0.5
+MAX_SESSIONS = 64           # Least recently used sessions are dropped beyond this
+
+
+def border_profile(gray: np.ndarray, rect: np.ndarray) -> np.ndarray:
+    """
+    Samples the intensity step across the board outline.
+
+    Args:
+        gray: Grayscale frame.
+        rect: Board corners ordered by order_points() (tl, tr, br, bl).
+
+    Returns:
+        4 * BORDER_SAMPLES inside-minus-outside differences.
+    """
+    h, w = gray.shape[:2]
+    center = rect.mean(axis=0)
+    size = max(np.linalg.norm(rect[1] - rect[0]), np.linalg.norm(rect[3] - rect[0]))
+    offset = max(2.0, BORDER_OFFSET_FRACTION * size)
+    t = (np.arange(BORDER_SAMPLES) + 0.5) / BORDER_SAMPLES
+    points = []
+    normals = []
+    for i in range(4):
+        a, b = rect[i], rect[(i + 1) % 4]
+        edge = b - a
+        normal = np.array([-edge[1], edge[0]]) / (np.linalg.norm(edge) + 1e-6)
+        if np.dot(center - (a + b) / 2, normal) < 0:
+            normal = -normal  # Pointing into the board
+        points.append(a + t[:, None] * edge)
+        normals.append(np.repeat(normal[None, :], BORDER_SAMPLES, axis=0))
+    points = np.concatenate(points)
+    normals = np.concatenate(normals)
+    inside = np.rint(points + normals * offset).astype(np.int32)
+    outside = np.rint(points - normals * offset).astype(np.int32)
+    # Outline at the frame edge (boards filling the frame): clamp, those samples just carry less contrast
+    inside[:, 0] = np.clip(inside[:, 0], 1, w - 2)
+    inside[:, 1] = np.clip(inside[:, 1], 1, h - 2)
+    outside[:, 0] = np.clip(outside[:, 0], 1, w - 2)
+    outside[:, 1] = np.clip(outside[:, 1], 1, h - 2)
+    # 3x3 means at each sample point, without filtering the whole frame
+    profile = np.zeros(len(points), dtype=np.float32)
+    for dy in (-1, 0, 1):
+        for dx in (-1, 0, 1):
+            profile += gray[inside[:, 1] + dy, inside[:, 0] + dx].astype(np.float32)
+            profile -= gray[outside[:, 1] + dy, outside[:, 0] + dx].astype(np.float32)
+    return profile / 9.0
+
+
+def profile_matches(reference: np.ndarray, profile: np.ndarray) -> bool:
+    """True if a frame's border profile still looks like the one the corners were found with."""
+    ref_contrast = float(np.mean(np.abs(reference)))
+    contrast = float(np.mean(np.abs(profile)))
+    if ref_contrast < 1e-3:
+        return False  # Nothing to compare against
+    if contrast < MIN_CONTRAST_RATIO * ref_contrast:
+        return False
+    if np.std(reference) < 1e-3 or np.std(profile) < 1e-3:
+        # Uniform step all around: only the contrast can be compared
+        return bool(np.sign(np.mean(reference)) == np.sign(np.mean(profile)))
+    return float(np.corrcoef(reference, profile)[0, 1]) >= MIN_PROFILE_CORRELATION
+
+
+class BoardCornerCache:
+    """
+    Per-session board corners and homography, with hit and time statistics.
+
+    warp() returns the top-down board like find_and_warp_board(), but for a session with cached
+    corners that pass the border check it skips the contour search. Safe to call from several
+    request threads: the session dict and the statistics are guarded by self.lock, while the check,
+    the contour search and the warp run outside it. Entries are replaced, never changed in place.
+    """
+
+    def __init__(self, max_sessions: int = MAX_SESSIONS):
+        self.max_sessions = max_sessions
+        self.lock = threading.Lock()
+        self.sessions = OrderedDict()  # session_id -> dict(rect, M, shape, profile)
+        self.stats = {'hits': 0, 'misses': 0, 'invalidated': 0, 'failed': 0}
+        self.hit_seconds = 0.0     # Time spent on frames served from the cache (check + warp)
+        self.detect_seconds = 0.0  # Time spent on frames that ran find_board_corners() (+ warp)
+
+    def warp(self, session_id: str, image: np.ndarray, output_size: int = 400) -> tuple[np.ndarray | None, str]:
+        """
+        Finds and warps the board of one session's frame.
+
+        Returns:
+            (warped board or None if no board was found, 'hit' | 'miss' | 'invalidated').
+        """
+        start = time.perf_counter()
+        with self.lock:
+            entry = self.sessions.get(session_id)
+            if entry is not None:
+                self.sessions.move_to_end(session_id)
+        gray = cv2.cvtColor(image, cv2.COLOR_BGR2GRAY)
+        outcome = 'miss'
+        if entry is not None:
+            if (entry['shape'] == image.shape and entry['size'] == output_size
+                    and profile_matches(entry['profile'], border_profile(gray, entry['rect']))):
+                warped = warp_board(image, entry['M'], output_size)
+                with self.lock:
+                    self.stats['hits'] += 1
+                    self.hit_seconds += time.perf_counter() - start
+                return warped, 'hit'
+            outcome = 'invalidated'
+            with self.lock:
+                if self.sessions.get(session_id) is entry:  # Another frame may have replaced it meanwhile
+                    del self.sessions[session_id]
+
+        with self.lock:
+            self.stats['misses' if outcome == 'miss' else 'invalidated'] += 1
+        corners = find_board_corners(image)
+        if corners is None:
+            with self.lock:
+                self.stats['failed'] += 1
+                self.detect_seconds += time.perf_counter() - start
+            return None, outcome
+        rect = order_points(corners)
+        M = board_homography(rect, output_size)
+        warped = warp_board(image, M, output_size)
+        entry = {'rect': rect, 'M': M, 'shape': image.shape, 'size': output_size,
+                 'profile': border_profile(gray, rect)}
+        with self.lock:
+            self.sessions[session_id] = entry
+            self.sessions.move_to_end(session_id)
+            while len(self.sessions) > self.max_sessions:
+                self.sessions.popitem(last=False)
+            self.detect_seconds += time.perf_counter() - start
+        return warped, outcome
+
+    def forget(self, session_id: str):
+        """Drops a session's corners (the camera was re-aimed, or the session ended)."""
+        with self.lock:
+            self.sessions.pop(session_id, None)
+
+    def report(self) -> dict:
+        """Hit rate, per-frame times and the time the cache saved so far."""
+        with self.lock:
+            stats = dict(self.stats)
+            sessions = len(self.sessions)
+            hit_seconds, detect_seconds = self.hit_seconds, self.detect_seconds
+        hits = stats['hits']
+        detections = stats['misses'] + stats['invalidated']
+        total = hits + detections
+        hit_ms = 1000 * hit_seconds / hits if hits else None
+        detect_ms = 1000 * detect_seconds / detections if detections else None
+        saved_ms = hits * (detect_ms - hit_ms) if hits and detections else 0.0
+        return {**stats, 'sessions': sessions,
+                'hit_rate': hits / total if total else None,
+                'hit_ms': round(hit_ms, 3) if hit_ms is not None else None,
+                'detect_ms': round(detect_ms, 3) if detect_ms is not None else None,
+                'saved_ms': round(saved_ms, 1)}
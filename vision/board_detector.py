@@ -8,6 +8,47 @@ DEBUG_IMAGE_DIR = os.path.join(os.path.dirname(__file__), 'debug_images')
 if not os.path.exists(DEBUG_IMAGE_DIR):
     os.makedirs(DEBUG_IMAGE_DIR)
 
+# Coarse-to-fine detection (opt-in, levels=None or > 0): the contour search runs on a pyramid level
+# (cv2.pyrDown halves the image until it is about DETECTION_WIDTH wide), then each corner is refined
+# at full resolution with cv2.cornerSubPix in a window of CORNER_WINDOW_PER_LEVEL px (half-size) per
+# pyramid level. pyrDown smooths as it halves, so the pyramid level skips the blur and uses a smaller
+# threshold block. The default stays the full-resolution search: on the debug corpus the pyramid
+# finds boards the full-resolution search misses, but several of them are not the board
+# (tools/board_corner_check.py lists the frames where the two disagree).
+DETECTION_WIDTH = 160
+CORNER_WINDOW_PER_LEVEL = 3
+FULL_RES_BLOCK_SIZE = 11  # adaptiveThreshold block at full resolution (after a 5x5 blur)
+PYRAMID_BLOCK_SIZE = 7    # ... and on a pyramid level
+
+def pyramid_levels(image_shape: tuple) -> int:
+    """Number of pyrDown steps that keep the detection image at least DETECTION_WIDTH wide."""
+    levels, width = 0, image_shape[1]
+    while width // 2 >= DETECTION_WIDTH:
+        width //= 2
+        levels += 1
+    return levels
+
+def refine_corners(gray: np.ndarray, corners: np.ndarray, half_window: int) -> np.ndarray:
+    """
+    Moves coarse corners to the sub-pixel corner of the full-resolution image.
+
+    Corners whose window doesn't fit in the image (boards touching the frame edge), or that
+    would move further than the window, keep their coarse position.
+    """
+    h, w = gray.shape[:2]
+    refined = corners.astype(np.float32).copy()
+    inside = [i for i, (x, y) in enumerate(refined)
+              if half_window <= x < w - half_window and half_window <= y < h - half_window]
+    if not inside:
+        return refined
+    points = refined[inside].reshape(-1, 1, 2).copy()
+    criteria = (cv2.TERM_CRITERIA_EPS + cv2.TERM_CRITERIA_MAX_ITER, 30, 0.01)
+    cv2.cornerSubPix(gray, points, (half_window, half_window), (-1, -1), criteria)
+    for i, point in zip(inside, points.reshape(-1, 2)):
+        if np.all(np.abs(point - refined[i]) <= half_window):
+            refined[i] = point
+    return refined
+
 def order_points(pts):
     # initialzie a list of coordinates that will be ordered
     # such that the first entry in the list is the top-left,
@@ -73,12 +114,65 @@ def find_and_warp_board(image: np.ndarray, output_size: int = 400) -> np.ndarray
     Returns:
         A warped square image of the board, or None if no board is found.
     """
+    corners = find_board_corners(image)
+    if corners is None:
+        return None
+    # Warp the perspective straight to the output size (one interpolation, no resize)
+    return warp_board(image, board_homography(corners, output_size), output_size)
+
+def board_homography(corners: np.ndarray, output_size: int = 400) -> np.ndarray:
+    """
+    Computes the perspective transform from the image to a top-down output_size square board.
+
+    Args:
+        corners: The four board corners in the image (any order), e.g. from find_board_corners().
+        output_size: Edge length of the warped board.
+
+    Returns:
+        A 3x3 matrix for cv2.warpPerspective().
+    """
+    rect = order_points(np.asarray(corners, dtype=np.float32))
+    dst = np.array([
+        [0, 0],
+        [output_size - 1, 0],
+        [output_size - 1, output_size - 1],
+        [0, output_size - 1]], dtype="float32")
+    return cv2.getPerspectiveTransform(rect, dst)
+
+def warp_board(image: np.ndarray, M: np.ndarray, output_size: int = 400) -> np.ndarray:
+    """Warps the board straight to an output_size square with a homography from board_homography()."""
+    return cv2.warpPerspective(image, M, (output_size, output_size))
+
+def find_board_corners(image: np.ndarray, levels: int | None = 0, refine: bool = True) -> np.ndarray | None:
+    """
+    Finds the four board corners: the 4-point approximation of the largest contour
+    (preferring its convex hull), searched on the full-resolution image or, with levels,
+    on a pyramid level and refined at full resolution. Saves debug images on failure.
+
+    Args:
+        image: Input image (NumPy array).
+        levels: Pyramid levels to search on; 0 (default) searches the full-resolution
+                image, None picks them from the image width (pyramid_levels()).
+        refine: Refine pyramid-level corners at full resolution (False: just scale them up).
+
+    Returns:
+        A (4, 2) float32 array of corner coordinates (unordered), or None if no board is found.
+    """
     timestamp = time.strftime("%Y%m%d-%H%M%S") # For unique filenames
 
     gray = cv2.cvtColor(image, cv2.COLOR_BGR2GRAY)
-    blurred = cv2.GaussianBlur(gray, (5, 5), 0)
-    thresh = cv2.adaptiveThreshold(blurred, 255, cv2.ADAPTIVE_THRESH_GAUSSIAN_C,
-                                   cv2.THRESH_BINARY_INV, 11, 2)
+    if levels is None:
+        levels = pyramid_levels(gray.shape)
+    if levels > 0:
+        small = gray
+        for _ in range(levels):
+            small = cv2.pyrDown(small)
+        thresh = cv2.adaptiveThreshold(small, 255, cv2.ADAPTIVE_THRESH_GAUSSIAN_C,
+                                       cv2.THRESH_BINARY_INV, PYRAMID_BLOCK_SIZE, 2)
+    else:
+        blurred = cv2.GaussianBlur(gray, (5, 5), 0)
+        thresh = cv2.adaptiveThreshold(blurred, 255, cv2.ADAPTIVE_THRESH_GAUSSIAN_C,
+                                       cv2.THRESH_BINARY_INV, FULL_RES_BLOCK_SIZE, 2)
 
     contours, _ = cv2.findContours(thresh, cv2.RETR_EXTERNAL, cv2.CHAIN_APPROX_SIMPLE)
 
@@ -125,27 +219,30 @@ def find_and_warp_board(image: np.ndarray, output_size: int = 400) -> np.ndarray
 
     # --- Process the result ---
     if corners is not None:
-        # Warp the perspective using the found corners
-        warped = four_point_transform(image, corners.astype(np.float32))
-        resized_warped = cv2.resize(warped, (output_size, output_size))
-
         # --- Optional: Save successful debug image ---
         # img_success = image.copy()
         # cv2.drawContours(img_success, [corners.reshape(-1, 1, 2)], -1, (0, 255, 0), 2) # Draw successful corners in green
         # cv2.imwrite(os.path.join(DEBUG_IMAGE_DIR, f'{timestamp}_04_success_corners.png'), img_success)
         # -------------------------------------------
-        return resized_warped
+        if levels == 0:
+            return corners.astype(np.float32)
+        # Back to full resolution (pixel centers scale as (x + 0.5) * 2^levels - 0.5), then refine
+        scale = float(2 ** levels)
+        coarse = (corners.astype(np.float32) + 0.5) * scale - 0.5
+        return refine_corners(gray, coarse, CORNER_WINDOW_PER_LEVEL * 2 ** levels) if refine else coarse
     else:
         # --- FAILURE: Save comprehensive debug images ---
         print(f"Could not find a 4-point approximation. Saving debug images to {DEBUG_IMAGE_DIR}")
         cv2.imwrite(os.path.join(DEBUG_IMAGE_DIR, f'{timestamp}_00_original.png'), image)
         cv2.imwrite(os.path.join(DEBUG_IMAGE_DIR, f'{timestamp}_01_thresh.png'), thresh)
 
-        img_with_contours = image.copy()
+        # Contours are in detection-level coordinates
+        view = image if levels == 0 else cv2.resize(image, (thresh.shape[1], thresh.shape[0]), interpolation=cv2.INTER_AREA)
+        img_with_contours = view.copy()
         cv2.drawContours(img_with_contours, contours, -1, (0, 255, 0), 1) # All contours green
         cv2.imwrite(os.path.join(DEBUG_IMAGE_DIR, f'{timestamp}_02_all_contours.png'), img_with_contours)
 
-        img_with_attempts = image.copy()
+        img_with_attempts = view.copy()
         # Draw largest contour (red)
         cv2.drawContours(img_with_attempts, [largest_contour], -1, (0, 0, 255), 2)
         # Draw convex hull (cyan)
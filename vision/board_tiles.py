@@ -0,0 +1,86 @@
+import struct
+import cv2
+import numpy as np
+
+from .board_detector import order_points, split_board_into_squares
+
+# Packed 8x8 tile grids produced by the ESP32-CAM in calibrated mode (see src/cam_camera/main.cpp).
+# The CAM warps each frame with the stored board homography and sends the rectified board as one
+# color JPEG, a8 at the top left:
+#   "TIL2" | tile_px u8 | tile_count u8 (64) | JPEG of the 8*tile_px square board
+# The piece classifier was trained on color squares cut from the warped board, so the tiles are
+# kept in color and at about the resolution a QVGA frame has of the board (25 px per square);
+# resize_square() then scales them to the model input exactly as for /analyze.
+# tools/board_tiles_check.py compares them with the /analyze squares on the debug corpus.
+TILES_MAGIC = b'TIL2'
+TILES_HEADER = struct.Struct('<4sBB')
+DEFAULT_TILE_PX = 25
+
+
+def is_tile_grid(data: bytes) -> bool:
+    return data[:4] == TILES_MAGIC
+
+
+def compute_tile_homography(corners: np.ndarray, tile_px: int = DEFAULT_TILE_PX, board_size: int = 8) -> np.ndarray:
+    """
+    Computes the homography the CAM uses to sample its frames.
+
+    Args:
+        corners: The four board corners in the CAM frame (any order), e.g. from find_board_corners().
+        tile_px: Edge length of one square tile in the rectified board.
+        board_size: The number of squares along one edge (usually 8).
+
+    Returns:
+        A 3x3 matrix (normalized so H[2, 2] == 1) mapping a pixel (u, v) of the rectified
+        board_size*tile_px square board to the source frame pixel it is sampled from.
+    """
+    side = board_size * tile_px
+    rect = order_points(np.asarray(corners, dtype=np.float32))
+    dst = np.array([
+        [0, 0],
+        [side - 1, 0],
+        [side - 1, side - 1],
+        [0, side - 1]], dtype="float32")
+    H = cv2.getPerspectiveTransform(dst, rect)
+    return H / H[2, 2]
+
+
+def format_calibration_command(H: np.ndarray) -> str:
+    """Formats the CAM calibration command ('CALIB:h00,h01,...,h22')."""
+    return "CALIB:" + ",".join(f"{v:.6g}" for v in H.flatten())
+
+
+def unpack_tiles(data: bytes) -> list[np.ndarray]:
+    """
+    Unpacks a tile grid into 64 BGR square images (a8..h1), ready for classify_square().
+
+    Raises:
+        ValueError: if the payload is not a well-formed tile grid.
+    """
+    if len(data) < TILES_HEADER.size or not is_tile_grid(data):
+        raise ValueError("Not a tile grid payload")
+    _, tile_px, tile_count = TILES_HEADER.unpack_from(data, 0)
+    if tile_count != 64 or tile_px == 0:
+        raise ValueError(f"Malformed tile grid ({tile_count} tiles of {tile_px}px)")
+    board = cv2.imdecode(np.frombuffer(data, np.uint8, offset=TILES_HEADER.size), cv2.IMREAD_COLOR)
+    side = 8 * tile_px
+    if board is None or board.shape[:2] != (side, side):
+        shape = 'undecodable' if board is None else f"{board.shape[1]}x{board.shape[0]}"
+        raise ValueError(f"Malformed tile grid (board image {shape}, expected {side}x{side})")
+    return split_board_into_squares(board)
+
+
+def pack_tiles(board: np.ndarray, tile_px: int = DEFAULT_TILE_PX, quality: int = 60) -> bytes:
+    """
+    Packs a rectified 8*tile_px square BGR board like the CAM does (tools/board_tiles_check.py).
+
+    Raises:
+        ValueError: if the board is not 8*tile_px square or can't be encoded.
+    """
+    side = 8 * tile_px
+    if board.shape[:2] != (side, side):
+        raise ValueError(f"Board must be {side}x{side}, got {board.shape[1]}x{board.shape[0]}")
+    ok, jpeg = cv2.imencode('.jpg', board, [cv2.IMWRITE_JPEG_QUALITY, quality])
+    if not ok:
+        raise ValueError("Could not encode the board")
+    return TILES_HEADER.pack(TILES_MAGIC, tile_px, 64) + jpeg.tobytes()
@@ -0,0 +1,139 @@
+import struct
+import threading
+from collections import OrderedDict
+
+import cv2
+import numpy as np
+
+# Delta frames produced by the ESP32-CAM in delta mode (see src/cam_camera/main.cpp).
+# Keyframes are plain JPEGs; delta frames carry only the tiles that changed:
+#   "DLT1" | frame_id u16 | ref_id u16 | width u16 | height u16 | tile_px u8 | tile_count u8
+#   then tile_count x ( col u8 | row u8 | jpeg_len u16 | jpeg bytes )
+DELTA_MAGIC = b'DLT1'
+DELTA_HEADER = struct.Struct('<4sHHHHBB')
+DELTA_TILE_HEADER = struct.Struct('<BBH')
+MAX_SESSIONS = 64           # Least recently used decoders are dropped beyond this
+
+
+class KeyframeRequired(Exception):
+    """Raised when a delta frame can't be applied; the client should send KEYFRAME to the clock."""
+
+
+def is_delta_frame(data: bytes) -> bool:
+    return data[:4] == DELTA_MAGIC
+
+
+class DeltaFrameDecoder:
+    """
+    Rebuilds full frames from a stream of keyframes and delta frames.
+
+    One decoder per clock: it holds the last reconstructed frame, which every delta
+    frame is applied to. decode() holds self.lock, so concurrent requests of one clock
+    apply their frames one after the other.
+    """
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.reference = None  # Last reconstructed frame (BGR)
+        self.reference_id = None
+
+    def decode(self, data: bytes, frame_id: int | None = None) -> np.ndarray:
+        """
+        Decodes one frame.
+
+        Args:
+            data: Frame payload as received from the clock.
+            frame_id: Id of a keyframe (from the BLE image_start message). Deltas carry their own id.
+
+        Returns:
+            The full reconstructed frame (BGR).
+
+        Raises:
+            KeyframeRequired: if a delta's reference frame is not the one held by this decoder,
+                              or the payload is malformed.
+        """
+        with self.lock:
+            return self._decode(data, frame_id)
+
+    def _decode(self, data: bytes, frame_id: int | None) -> np.ndarray:
+        if not is_delta_frame(data):
+            frame = cv2.imdecode(np.frombuffer(data, np.uint8), cv2.IMREAD_COLOR)
+            if frame is None:
+                raise ValueError("Could not decode keyframe")
+            self.reference = frame
+            self.reference_id = frame_id
+            return frame.copy()
+
+        if len(data) < DELTA_HEADER.size:
+            raise KeyframeRequired("Truncated delta header")
+        _, delta_id, ref_id, width, height, tile_px, tile_count = DELTA_HEADER.unpack_from(data, 0)
+        if self.reference is None or self.reference_id != ref_id:
+            raise KeyframeRequired(f"Delta {delta_id} references frame {ref_id}, decoder holds {self.reference_id}")
+        if self.reference.shape[:2] != (height, width):
+            raise KeyframeRequired(f"Delta size {width}x{height} does not match reference")
+
+        frame = self.reference.copy()
+        offset = DELTA_HEADER.size
+        for _ in range(tile_count):
+            if offset + DELTA_TILE_HEADER.size > len(data):
+                raise KeyframeRequired("Truncated delta tile header")
+            col, row, jpeg_len = DELTA_TILE_HEADER.unpack_from(data, offset)
+            offset += DELTA_TILE_HEADER.size
+            tile = cv2.imdecode(np.frombuffer(data[offset:offset + jpeg_len], np.uint8), cv2.IMREAD_COLOR)
+            offset += jpeg_len
+            if tile is None:
+                raise KeyframeRequired(f"Could not decode tile ({col}, {row})")
+            y0, x0 = row * tile_px, col * tile_px
+            th, tw = tile.shape[:2]
+            if y0 + th > height or x0 + tw > width:
+                raise KeyframeRequired(f"Tile ({col}, {row}) outside the frame")
+            frame[y0:y0 + th, x0:x0 + tw] = tile
+
+        self.reference = frame
+        self.reference_id = delta_id
+        return frame.copy()
+
+
+class DeltaDecoderSessions:
+    """
+    One DeltaFrameDecoder per clock ('session_id'), created by the first keyframe with a frame id.
+
+    Plain JPEGs without a frame id are decoded without a decoder, so clients that don't use delta
+    mode cost no reference frame. At most max_sessions decoders are kept, least recently used
+    dropped first; the session dict is guarded by self.lock like BoardCornerCache's.
+    """
+
+    def __init__(self, max_sessions: int = MAX_SESSIONS):
+        self.max_sessions = max_sessions
+        self.lock = threading.Lock()
+        self.sessions = OrderedDict()  # session_id -> DeltaFrameDecoder
+
+    def decode(self, session_id: str, data: bytes, frame_id: int | None = None) -> np.ndarray:
+        """
+        Decodes one frame of a session, like DeltaFrameDecoder.decode().
+
+        Raises:
+            KeyframeRequired: for a delta frame the session's decoder can't apply (or has no decoder).
+            ValueError: if a keyframe can't be decoded.
+        """
+        delta = is_delta_frame(data)
+        if not delta and frame_id is None:
+            frame = cv2.imdecode(np.frombuffer(data, np.uint8), cv2.IMREAD_COLOR)
+            if frame is None:
+                raise ValueError("Could not decode keyframe")
+            return frame
+        with self.lock:
+            decoder = self.sessions.get(session_id)
+            if decoder is None:
+                if delta:
+                    raise KeyframeRequired(f"No reference frame for session {session_id}")
+                decoder = self.sessions[session_id] = DeltaFrameDecoder()
+            self.sessions.move_to_end(session_id)
+            while len(self.sessions) > self.max_sessions:
+                self.sessions.popitem(last=False)
+        return decoder.decode(data, frame_id)
+
+    def forget(self, session_id: str):
+        """Drops a session's reference frame; its next delta needs a keyframe first."""
+        with self.lock:
+            self.sessions.pop(session_id, None)
@@ -0,0 +1,190 @@
+import threading
+from collections import OrderedDict
+
+import cv2
+import numpy as np
+
+# Incremental recognition per clock ('session_id'). Between two turns only the squares of the move
+# change (2 for a normal move, 3-4 for captures en passant and castling), so only squares whose
+# image changed are classified again; the others keep their previous classification.
+#
+# Each square keeps a signature: the grayscale square downsampled to SIGNATURE_PX x SIGNATURE_PX,
+# taken when the square was last classified. Its change score is the mean absolute difference to the
+# new frame's signature, after matching the new frame to the reference's brightness and contrast and removing
+# the remaining board-wide shift (median over the squares), so an exposure or lighting change alone
+# doesn't flag the whole board. Squares scoring above CHANGE_THRESHOLD are
+# reclassified and get a new signature; the rest keep the old one, so slow drift still adds up.
+#
+# A full scan of all 64 squares runs for a new session, every FULL_SCAN_INTERVAL frames, when the
+# caller says the warp changed (board corners re-detected), when more than MAX_CHANGED_SQUARES
+# squares changed, when the client's previous_fen is not the position last returned, and when the
+# merged result is inconsistent (not exactly one king per side).
+SIGNATURE_PX = 16
+CHANGE_THRESHOLD = 10.0     # Mean absolute gray level difference
+MAX_CHANGED_SQUARES = 12    # More than this: hand over the board, camera bump... classify everything
+FULL_SCAN_INTERVAL = 20     # Frames
+MAX_SESSIONS = 64           # Least recently used sessions are dropped beyond this
+
+
+def square_signatures(board_image: np.ndarray, board_size: int = 8) -> np.ndarray:
+    """
+    Downsampled grayscale squares of a warped board.
+
+    Returns:
+        A (board_size**2, SIGNATURE_PX, SIGNATURE_PX) float32 array, ordered like
+        split_board_into_squares() (a8 to h1).
+    """
+    gray = board_image if board_image.ndim == 2 else cv2.cvtColor(board_image, cv2.COLOR_BGR2GRAY)
+    side = board_size * SIGNATURE_PX
+    small = cv2.resize(gray, (side, side), interpolation=cv2.INTER_AREA).astype(np.float32)
+    return (small.reshape(board_size, SIGNATURE_PX, board_size, SIGNATURE_PX)
+                 .transpose(0, 2, 1, 3).reshape(-1, SIGNATURE_PX, SIGNATURE_PX))
+
+
+def change_scores(reference: np.ndarray, current: np.ndarray) -> np.ndarray:
+    """Per-square change scores between two square_signatures(), exposure change removed."""
+    # Match the new frame's board-wide brightness and contrast to the reference's
+    current = (current - current.mean()) * (reference.std() / max(float(current.std()), 1.0)) + reference.mean()
+    diff = current - reference
+    shift = np.median(diff.mean(axis=(1, 2)))
+    return np.abs(diff - shift).mean(axis=(1, 2))
+
+
+def board_placement(classifications: list[tuple[str | None, str | None]]) -> str:
+    """Piece placement field of the FEN for 64 classifications (a8 to h1), as generate_fen() writes it."""
+    rows = []
+    for rank in range(8):
+        row, empty = '', 0
+        for symbol, _ in classifications[rank * 8:(rank + 1) * 8]:
+            if symbol is None:
+                empty += 1
+                continue
+            if empty:
+                row += str(empty)
+                empty = 0
+            row += symbol
+        rows.append(row + (str(empty) if empty else ''))
+    return '/'.join(rows)
+
+
+def is_consistent(classifications: list[tuple[str | None, str | None]]) -> bool:
+    """Exactly one king per side; anything else means some square was misread."""
+    symbols = [symbol for symbol, _ in classifications]
+    return symbols.count('K') == 1 and symbols.count('k') == 1
+
+
+class IncrementalRecognizer:
+    """
+    Per-session square signatures and classifications, with counts of the squares classified.
+
+    Safe to call from several request threads: the session dict and the statistics are guarded by
+    self.lock, while the classification (which may wait for a MicroBatcher batch) runs outside it.
+    Entries are replaced, never changed in place.
+
+    Args:
+        classify: Classifies a list of square images, e.g. MicroBatcher.classify_board.
+    """
+
+    def __init__(self, classify, threshold: float = CHANGE_THRESHOLD,
+                 full_scan_interval: int = FULL_SCAN_INTERVAL, max_sessions: int = MAX_SESSIONS):
+        self.classify = classify
+        self.threshold = threshold
+        self.full_scan_interval = full_scan_interval
+        self.max_sessions = max_sessions
+        self.lock = threading.Lock()
+        self.sessions = OrderedDict()  # session_id -> dict(signatures, classifications, frames)
+        self.stats = {'frames': 0, 'full_scans': 0, 'squares_classified': 0}
+        self.full_scan_reasons = {}
+
+    def recognize(self, session_id: str, board_image: np.ndarray, squares: list[np.ndarray],
+                  previous_fen: str | None = None, force_full: bool = False) -> tuple[list, dict]:
+        """
+        Classifies one session's board, reusing the previous classification of unchanged squares.
+
+        Args:
+            board_image: The warped board the squares were split from.
+            squares: Its 64 squares from split_board_into_squares().
+            previous_fen: FEN the client holds for the previous turn, if any.
+            force_full: Classify every square (e.g. the board was warped with new corners).
+
+        Returns:
+            (64 classifications, {'scan': 'full' | 'incremental', 'classified': n, 'reason': ...}).
+        """
+        signatures = square_signatures(board_image)
+        with self.lock:
+            entry = self.sessions.get(session_id)
+            if entry is not None:
+                self.sessions.move_to_end(session_id)
+
+        reason = None
+        if entry is None:
+            reason = 'new_session'
+        elif force_full:
+            reason = 'warp_changed'
+        elif entry['signatures'].shape != signatures.shape:
+            reason = 'board_size'
+        elif entry['frames'] >= self.full_scan_interval:
+            reason = 'periodic'
+        elif previous_fen and previous_fen.split(' ')[0] != board_placement(entry['classifications']):
+            reason = 'previous_fen'
+
+        changed = []
+        if reason is None:
+            scores = change_scores(entry['signatures'], signatures)
+            changed = np.flatnonzero(scores > self.threshold).tolist()
+            if len(changed) > MAX_CHANGED_SQUARES:
+                reason = 'many_changes'
+
+        if reason is None:
+            classifications = list(entry['classifications'])
+            kept_signatures = entry['signatures'].copy()
+            if changed:
+                for i, result in zip(changed, self.classify([squares[i] for i in changed])):
+                    classifications[i] = result
+                    kept_signatures[i] = signatures[i]
+            classified = len(changed)
+            if not is_consistent(classifications):
+                # Trust nothing that was copied: classify the squares that weren't just classified
+                skipped = set(changed)
+                rest = [i for i in range(len(squares)) if i not in skipped]
+                for i, result in zip(rest, self.classify([squares[i] for i in rest])):
+                    classifications[i] = result
+                kept_signatures = signatures
+                classified += len(rest)
+                reason = 'inconsistent'
+            entry = {'signatures': kept_signatures, 'classifications': classifications,
+                     'frames': 0 if reason else entry['frames'] + 1}
+        else:
+            classifications = self.classify(squares)
+            classified = len(squares)
+            entry = {'signatures': signatures, 'classifications': classifications, 'frames': 0}
+
+        with self.lock:
+            self.sessions[session_id] = entry
+            self.sessions.move_to_end(session_id)
+            while len(self.sessions) > self.max_sessions:
+                self.sessions.popitem(last=False)
+            self.stats['frames'] += 1
+            self.stats['squares_classified'] += classified
+            if reason:
+                self.stats['full_scans'] += 1
+                self.full_scan_reasons[reason] = self.full_scan_reasons.get(reason, 0) + 1
+        info = {'scan': 'full' if reason else 'incremental', 'classified': classified}
+        if reason:
+            info['reason'] = reason
+        return classifications, info
+
+    def forget(self, session_id: str):
+        """Drops a session's signatures; its next frame is classified in full."""
+        with self.lock:
+            self.sessions.pop(session_id, None)
+
+    def report(self) -> dict:
+        """Frames, full scans by reason, and the mean number of squares classified per frame."""
+        with self.lock:
+            stats = dict(self.stats)
+            sessions = len(self.sessions)
+            reasons = dict(self.full_scan_reasons)
+        frames = stats['frames']
+        return {**stats, 'sessions': sessions, 'full_scan_reasons': reasons,
+                'squares_per_frame': round(stats['squares_classified'] / frames, 2) if frames else None}
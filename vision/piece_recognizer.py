@@ -1,12 +1,21 @@
+import os
+import threading
+
 import numpy as np
 import cv2
-import tensorflow as tf 
-from tensorflow import keras
-from tensorflow.keras import layers
+
+# TensorFlow is imported when the float model is built (build_model()). The quantized model
+# (load_tflite_model()) only needs a TFLite interpreter, so a server running it doesn't pay
+# TensorFlow's import time and memory.
 
 # Global variable to hold the loaded model
 piece_classifier_model = None
 
+# Int8 model exported by tools/export_tflite.py; used instead of the Keras model when loaded
+tflite_interpreter = None
+tflite_input_lut = None        # uint8 pixel -> quantized model input
+tflite_lock = threading.Lock() # The interpreter's tensors are shared state
+
 # Define the expected input size for the model (adjust if necessary based on model details)
 # The Rizo-R repo mentions training with 150x300, which seems odd for squares.
 # Let's assume a square input for now, e.g., 150x150. Needs verification.
@@ -28,6 +37,9 @@ CLASS_MAP = {
 
 def build_model():
     """Builds the Keras model architecture based on Rizo-R/chess-cv description."""
+    from tensorflow import keras
+    from tensorflow.keras import layers
+
     model = keras.Sequential(
         [
             keras.Input(shape=MODEL_INPUT_SHAPE),
@@ -75,9 +87,133 @@ def load_model_weights(weights_path: str):
         print(f"Error building model or loading weights: {e}")
         piece_classifier_model = None
 
+def tflite_interpreter_class():
+    """The TFLite Interpreter class: the standalone runtimes if installed, else TensorFlow's."""
+    try:
+        from tflite_runtime.interpreter import Interpreter
+        return Interpreter
+    except ImportError:
+        pass
+    try:
+        from ai_edge_litert.interpreter import Interpreter
+        return Interpreter
+    except ImportError:
+        pass
+    import tensorflow as tf
+    return tf.lite.Interpreter
+
+def quantization_lut(input_details: dict) -> np.ndarray | None:
+    """
+    Maps uint8 pixels straight to a quantized model input.
+
+    The model was calibrated on pixels / 255; the table folds that scaling and the input
+    quantization (scale, zero point) into one lookup. None if the input is float.
+    """
+    if input_details['dtype'] == np.float32:
+        return None
+    scale, zero_point = input_details['quantization']
+    limits = np.iinfo(input_details['dtype'])
+    values = np.round(np.arange(256) / 255.0 / scale + zero_point)
+    return np.clip(values, limits.min, limits.max).astype(input_details['dtype'])
+
+def load_tflite_model(model_path: str, num_threads: int | None = None):
+    """Loads an int8 model from tools/export_tflite.py; classify_batch() then runs it instead of the Keras model."""
+    global tflite_interpreter, tflite_input_lut
+    try:
+        print(f"Loading quantized model from: {model_path}")
+        interpreter = tflite_interpreter_class()(model_path=model_path, num_threads=num_threads or os.cpu_count())
+        interpreter.allocate_tensors()
+        tflite_input_lut = quantization_lut(interpreter.get_input_details()[0])
+        tflite_interpreter = interpreter
+        print("Quantized model ready.")
+    except Exception as e:
+        print(f"Error loading quantized model: {e}")
+        tflite_interpreter = None
+
+def predict_tflite(batch: np.ndarray) -> np.ndarray:
+    """Runs the quantized model on a uint8 batch like classify_batch() takes; returns dequantized probabilities."""
+    with tflite_lock:
+        input_details = tflite_interpreter.get_input_details()[0]
+        if tuple(input_details['shape']) != batch.shape:
+            # The batch size follows the request (64 squares, or several boards when merged)
+            tflite_interpreter.resize_tensor_input(input_details['index'], batch.shape)
+            tflite_interpreter.allocate_tensors()
+        if tflite_input_lut is not None:
+            tflite_interpreter.set_tensor(input_details['index'], tflite_input_lut[batch])
+        else:
+            tflite_interpreter.set_tensor(input_details['index'], batch.astype('float32') / 255.0)
+        tflite_interpreter.invoke()
+        output_details = tflite_interpreter.get_output_details()[0]
+        output = tflite_interpreter.get_tensor(output_details['index']).astype(np.float32)
+    scale, zero_point = output_details['quantization']
+    return (output - zero_point) * scale if scale else output
+
+def resize_square(square_image: np.ndarray) -> np.ndarray:
+    """Resizes a square image to the model input (MODEL_INPUT_SHAPE, height x width), still uint8."""
+    # cv2.resize takes (width, height)
+    return cv2.resize(square_image, (MODEL_INPUT_SIZE[1], MODEL_INPUT_SIZE[0]))
+
+def decode_prediction(probabilities: np.ndarray) -> tuple[str | None, str | None]:
+    """Maps one row of model output to (piece_symbol, piece_color) like classify_square()."""
+    piece_symbol = CLASS_MAP.get(int(np.argmax(probabilities)), None)
+    if piece_symbol is None:
+        return None, None
+    return piece_symbol, 'b' if piece_symbol.islower() else 'w' # Black pieces are lowercase in FEN
+
+def placeholder_classification() -> tuple[str | None, str | None]:
+    """Random result used while no model is loaded."""
+    is_empty = np.random.choice([True, False], p=[0.6, 0.4])
+    if is_empty:
+        return None, None
+    piece = np.random.choice(['P', 'N', 'B', 'R', 'Q', 'K'])
+    color_choice = np.random.choice(['w', 'b'])
+    piece_symbol = piece.upper() if color_choice == 'w' else piece.lower()
+    return piece_symbol, color_choice
+
+def classify_batch(batch: np.ndarray) -> list[tuple[str | None, str | None]]:
+    """
+    Classifies resized squares in a single model call.
+
+    Args:
+        batch: uint8 array of shape (N,) + MODEL_INPUT_SHAPE, e.g. stacked resize_square() outputs
+               of one or more boards. Scaled to [0, 1] float here, once for the whole batch (or
+               mapped to the int8 model's input through its lookup table).
+
+    Returns:
+        N (piece_symbol, piece_color) tuples, in batch order; (None, None) for all of them on error.
+    """
+    if piece_classifier_model is None and tflite_interpreter is None:
+        print("Error: Piece classifier model not loaded. Returning placeholder.")
+        return [placeholder_classification() for _ in range(len(batch))]
+    try:
+        if tflite_interpreter is not None:
+            predictions = predict_tflite(batch)
+        else:
+            # predict_on_batch runs the whole batch at once, without predict()'s per-call setup
+            predictions = np.asarray(piece_classifier_model.predict_on_batch(batch.astype('float32') / 255.0))
+        return [decode_prediction(row) for row in predictions]
+    except Exception as e:
+        print(f"Error during batch classification: {e}")
+        return [(None, None)] * len(batch)
+
+def classify_squares(square_images: list[np.ndarray]) -> list[tuple[str | None, str | None]]:
+    """
+    Classifies all squares of a board (or any list of squares) in one batched model call.
+
+    Args:
+        square_images: Square images, e.g. the 64 from split_board_into_squares().
+
+    Returns:
+        One (piece_symbol, piece_color) tuple per square, as classify_square() returns them.
+    """
+    if not square_images:
+        return []
+    return classify_batch(np.stack([resize_square(img) for img in square_images]))
+
 def classify_square(square_image: np.ndarray) -> tuple[str | None, str | None]:
     """
     Classifies the piece type and color on a given square image using the loaded model.
+    For whole boards use classify_squares(), which runs one model call for all 64 squares.
 
     Args:
         square_image: A NumPy array representing the image of a single square.
@@ -88,50 +224,7 @@ def classify_square(square_image: np.ndarray) -> tuple[str | None, str | None]:
                       Uses uppercase for white, lowercase for black as per FEN.
         piece_color: 'w' for white, 'b' for black, or None if empty.
     """
-    if piece_classifier_model is None:
-        print("Error: Piece classifier model not loaded. Returning placeholder.")
-        # Placeholder logic from before (can be removed if model loading is required)
-        is_empty = np.random.choice([True, False], p=[0.6, 0.4])
-        if is_empty:
-            return None, None
-        else:
-            piece = np.random.choice(['P', 'N', 'B', 'R', 'Q', 'K'])
-            color_choice = np.random.choice(['w', 'b'])
-            piece_symbol = piece.upper() if color_choice == 'w' else piece.lower()
-            return piece_symbol, color_choice
-
-    try:
-        # 1. Preprocess square_image
-        #    - Resize to model's expected input size
-        #    - Convert to float32
-        #    - Normalize pixel values (common practice: / 255.0)
-        #    - Add batch dimension
-        img_resized = cv2.resize(square_image, MODEL_INPUT_SIZE)
-        img_normalized = img_resized.astype('float32') / 255.0
-        input_data = np.expand_dims(img_normalized, axis=0) # Add batch dimension
-
-        # 2. Predict using the loaded model
-        prediction = piece_classifier_model.predict(input_data)
-        
-        # 3. Decode the prediction
-        #    - Find the index with the highest probability
-        predicted_class_index = np.argmax(prediction[0])
-        piece_symbol = CLASS_MAP.get(predicted_class_index, None) # Get symbol from map
-
-        # 4. Determine piece color from symbol
-        if piece_symbol is None:
-            piece_color = None
-        elif piece_symbol.islower(): # Black pieces are lowercase in FEN
-            piece_color = 'b'
-        else: # White pieces are uppercase
-            piece_color = 'w'
-
-        # print(f"Prediction: {prediction}, Index: {predicted_class_index}, Symbol: {piece_symbol}, Color: {piece_color}")
-        return piece_symbol, piece_color
-
-    except Exception as e:
-        print(f"Error during square classification: {e}")
-        return None, None # Return None on error
+    return classify_squares([square_image])[0]
 
 # The simple color detection function is likely not needed if the model predicts piece+color
 # def detect_piece_color_simple(square_image: np.ndarray, square_is_light: bool) -> str | None:
@@ -12,9 +12,14 @@ import numpy as np
 import io
 
 # Import our vision modules (now relative to project_root)
-from vision.board_detector import find_and_warp_board, split_board_into_squares
-from vision.piece_recognizer import classify_square, load_model_weights
+from vision.board_detector import find_and_warp_board, find_board_corners, split_board_into_squares
+from vision.board_cache import BoardCornerCache
+from vision.board_tiles import DEFAULT_TILE_PX, compute_tile_homography, format_calibration_command, unpack_tiles
+from vision.piece_recognizer import load_model_weights, load_tflite_model
+from vision.batch_classifier import MicroBatcher
+from vision.incremental_recognizer import IncrementalRecognizer
 from vision.fen_generator import generate_fen
+from vision.frame_delta import DeltaDecoderSessions, KeyframeRequired, is_delta_frame
 
 app = Flask(__name__)
 
@@ -25,9 +30,18 @@ if not os.path.exists(UPLOAD_FOLDER):
 # app.config['UPLOAD_FOLDER'] = UPLOAD_FOLDER # Flask doesn't strictly need this config for BytesIO handling
 
 # --- Model Loading ---
+# CLASSIFIER=int8 runs the quantized model from tools/export_tflite.py on a TFLite interpreter
+# instead of the Keras model (CPU servers; TensorFlow isn't even imported). Default: float.
+CLASSIFIER = os.environ.get('CLASSIFIER', 'float')
+TFLITE_MODEL_PATH = os.environ.get('TFLITE_MODEL_PATH', os.path.join(project_root, 'models/model_int8.tflite'))
 # Model path relative to project root
 MODEL_PATH = os.path.join(project_root, 'models/model_weights.h5')
-if os.path.exists(MODEL_PATH):
+if CLASSIFIER == 'int8' and os.path.exists(TFLITE_MODEL_PATH):
+    load_tflite_model(TFLITE_MODEL_PATH)
+elif os.path.exists(MODEL_PATH):
+    if CLASSIFIER == 'int8':
+        print(f"\n*** WARNING: Quantized model not found at {TFLITE_MODEL_PATH}, using the float model ***")
+        print("*** Run tools/export_tflite.py to create it. ***\n")
     load_model_weights(MODEL_PATH)
 else:
     print(f"\n*** WARNING: Model file not found at {MODEL_PATH} ***")
@@ -36,6 +50,33 @@ else:
 
 # ---------------------
 
+# Frames whose CAM sharpness score (forwarded by the client as the optional
+# 'sharpness' form field) is below this are rejected before any vision work,
+# so the client can request a new capture. 0 disables the check.
+MIN_SHARPNESS = int(os.environ.get('MIN_SHARPNESS', '0'))
+
+# Delta frame decoders, one per clock ('session_id' form field). Keyframes sent with a
+# session_id and 'frame_id' become the reference for that clock's following delta frames;
+# the least recently used decoders are dropped beyond MAX_SESSIONS (vision/frame_delta.py).
+delta_decoders = DeltaDecoderSessions()
+
+# All squares of a board are classified in one model call, and boards of concurrent requests
+# (many clocks on one server) are merged into larger calls: up to BATCH_MAX_BOARDS boards, waiting
+# at most BATCH_WAIT_MS for others to join (0 = no merging). See vision/batch_classifier.py.
+square_batcher = MicroBatcher(max_boards=int(os.environ.get('BATCH_MAX_BOARDS', '8')),
+                              max_wait_ms=float(os.environ.get('BATCH_WAIT_MS', '5')))
+
+# Board corners and homography per clock ('session_id'), reused while a cheap border check still
+# matches (see vision/board_cache.py). Frames without a session_id always run the full detection.
+board_cache = BoardCornerCache()
+
+# Per clock, only squares whose image changed since they were last classified go through the model;
+# the rest keep their previous classification. All 64 are classified again every FULL_SCAN_INTERVAL
+# frames, when the board corners were re-detected, and on inconsistent results (see
+# vision/incremental_recognizer.py). Frames without a session_id are always classified in full.
+incremental = IncrementalRecognizer(square_batcher.classify_board,
+                                    full_scan_interval=int(os.environ.get('FULL_SCAN_INTERVAL', '20')))
+
 @app.route('/analyze', methods=['POST'])
 def analyze_board():
     """Analyzes a chessboard image, optionally using previous FEN, and returns the new FEN string."""
@@ -56,31 +97,65 @@ def analyze_board():
         except ValueError:
             return jsonify({"error": "Invalid format for previous_fen"}), 400
 
+    # Get optional CAM sharpness score from form data
+    sharpness = request.form.get('sharpness')
+    if sharpness is not None:
+        try:
+            sharpness = int(sharpness)
+        except ValueError:
+            return jsonify({"error": "Invalid format for sharpness"}), 400
+        if sharpness < MIN_SHARPNESS:
+            print(f"Rejecting blurry frame (sharpness {sharpness} < {MIN_SHARPNESS})")
+            return jsonify({"error": "Image too blurry", "retry": True}), 422
+
     if file:
         try:
             # Read image file into memory
             in_memory_file = io.BytesIO()
             file.save(in_memory_file)
             in_memory_file.seek(0)
-            file_bytes = np.frombuffer(in_memory_file.read(), np.uint8)
-            img = cv2.imdecode(file_bytes, cv2.IMREAD_COLOR)
+            data = in_memory_file.read()
+            session_id = request.form.get('session_id')
+            if session_id or is_delta_frame(data):
+                if not session_id:
+                    return jsonify({"error": "Delta frames require a session_id"}), 400
+                frame_id = request.form.get('frame_id', type=int)
+                try:
+                    img = delta_decoders.decode(session_id, data, frame_id)
+                except KeyframeRequired as e:
+                    print(f"Session {session_id}: {e}")
+                    return jsonify({"error": "Keyframe required", "keyframe_required": True}), 409
+                except ValueError:
+                    img = None
+            else:
+                img = cv2.imdecode(np.frombuffer(data, np.uint8), cv2.IMREAD_COLOR)
 
             if img is None:
                  return jsonify({"error": "Could not decode image"}), 400
 
             # --- Steps 1 & 2: Detect, Warp, Split --- 
-            warped_board = find_and_warp_board(img)
+            cache_outcome = None
+            if session_id:
+                warped_board, cache_outcome = board_cache.warp(session_id, img)
+                print(f"Session {session_id}: board corners {cache_outcome}")
+            else:
+                warped_board = find_and_warp_board(img)
             if warped_board is None:
                 return jsonify({"error": "Could not detect chessboard in the image"}), 400
             squares = split_board_into_squares(warped_board)
             if len(squares) != 64:
                  return jsonify({"error": f"Could not split board into 64 squares (got {len(squares)})"}), 500
 
-            # --- Step 3: Classify Each Square ---
-            classifications = []
-            for square_img in squares:
-                piece_symbol, piece_color = classify_square(square_img)
-                classifications.append((piece_symbol, piece_color))
+            # --- Step 3: Classify Squares (one batched model call, shared with concurrent requests) ---
+            scan = None
+            if session_id:
+                # Only the changed squares, unless the warp changed or a full scan is due
+                full_scan = cache_outcome != 'hit' or request.form.get('full_scan') == '1'
+                classifications, scan = incremental.recognize(session_id, warped_board, squares,
+                                                              previous_fen, force_full=full_scan)
+                print(f"Session {session_id}: {scan['scan']} scan, {scan['classified']} squares classified")
+            else:
+                classifications = square_batcher.classify_board(squares)
             if len(classifications) != 64:
                 return jsonify({"error": f"Classification resulted in {len(classifications)} squares, expected 64"}), 500
 
@@ -88,7 +163,12 @@ def analyze_board():
             # Pass previous_fen (which might be None) to the generator
             fen_string = generate_fen(classifications, previous_fen)
 
-            return jsonify({"fen": fen_string}), 200
+            response = {"fen": fen_string}
+            if cache_outcome:
+                response["board_cache"] = cache_outcome  # "hit", "miss" or "invalidated"
+            if scan:
+                response["scan"] = scan  # {"scan": "full"|"incremental", "classified": n, "reason": ...}
+            return jsonify(response), 200
 
         except Exception as e:
             # Log the exception for debugging
@@ -97,6 +177,76 @@ def analyze_board():
     
     return jsonify({"error": "File processing failed"}), 500
 
+@app.route('/board_cache', methods=['GET'])
+def board_cache_stats():
+    """Reports how often /analyze reused cached board corners and the detection time that saved."""
+    return jsonify(board_cache.report()), 200
+
+@app.route('/batching', methods=['GET'])
+def batching_stats():
+    """Reports how many boards the square classifier merged per model call, and their wait."""
+    return jsonify(square_batcher.report()), 200
+
+@app.route('/incremental', methods=['GET'])
+def incremental_stats():
+    """Reports how many squares /analyze classified per frame and why full scans ran."""
+    return jsonify(incremental.report()), 200
+
+@app.route('/board_cache/<session_id>', methods=['DELETE'])
+def forget_board_corners(session_id):
+    """Drops a clock's cached corners, signatures and delta reference, e.g. after the camera was re-aimed; the next frame runs the full detection."""
+    board_cache.forget(session_id)
+    incremental.forget(session_id)
+    delta_decoders.forget(session_id)
+    return jsonify({"ok": True}), 200
+
+@app.route('/calibrate', methods=['POST'])
+def calibrate_board():
+    """Finds the board in a full CAM frame and returns the homography for the CAM's calibrated tile mode."""
+    if 'file' not in request.files:
+        return jsonify({"error": "No file part in the request"}), 400
+
+    file_bytes = np.frombuffer(request.files['file'].read(), np.uint8)
+    img = cv2.imdecode(file_bytes, cv2.IMREAD_COLOR)
+    if img is None:
+        return jsonify({"error": "Could not decode image"}), 400
+
+    tile_px = request.form.get('tile_px', DEFAULT_TILE_PX, type=int)
+    corners = find_board_corners(img)
+    if corners is None:
+        return jsonify({"error": "Could not detect chessboard in the image"}), 400
+
+    H = compute_tile_homography(corners, tile_px)
+    # The client writes 'command' to the clock, which forwards it to the CAM
+    return jsonify({"homography": H.flatten().tolist(), "tile_px": tile_px,
+                    "command": format_calibration_command(H)}), 200
+
+@app.route('/analyze_tiles', methods=['POST'])
+def analyze_tiles():
+    """Classifies a packed 8x8 tile grid from a calibrated CAM (no board detection or warp) and returns the FEN."""
+    if 'file' not in request.files:
+        return jsonify({"error": "No file part in the request"}), 400
+
+    previous_fen = request.form.get('previous_fen')
+    if previous_fen:
+        try:
+            _ = chess.Board(previous_fen)
+        except ValueError:
+            return jsonify({"error": "Invalid format for previous_fen"}), 400
+
+    try:
+        squares = unpack_tiles(request.files['file'].read())
+    except ValueError as e:
+        return jsonify({"error": str(e)}), 400
+
+    try:
+        classifications = square_batcher.classify_board(squares)
+        fen_string = generate_fen(classifications, previous_fen)
+        return jsonify({"fen": fen_string}), 200
+    except Exception as e:
+        app.logger.error(f"Error processing tiles: {e}", exc_info=True)
+        return jsonify({"error": f"An internal error occurred: {str(e)}"}), 500
+
 if __name__ == '__main__':
     # Run the Flask app
     # Use host='0.0.0.0' to make it accessible on your network